@@ -0,0 +1,71 @@
+#include <benchmark/benchmark.h>
+#include <ast.h>
+#include <memory>
+#include <vector>
+
+// The tree layout the parser used before AST became a flat array: one heap node per AST, each owning a vector of
+// children. Kept here only to compare against.
+struct PointerNode {
+  virtual ~PointerNode() = default;
+  ASTKind kind = ASTKind::Directive;
+  std::vector<std::unique_ptr<PointerNode>> children;
+};
+
+// Shape of the generated trees: a root with this many top level nodes, each with a few children
+static constexpr int top_level = 1 << 16;
+static constexpr int fanout = 4;
+
+static void BM_BuildPointerTree(benchmark::State &state) {
+  for (auto _ : state) {
+    auto root = std::make_unique<PointerNode>();
+    for (int i = 0; i < top_level; i++) {
+      auto node = std::make_unique<PointerNode>();
+      for (int j = 0; j < fanout; j++) {
+        node->children.push_back(std::make_unique<PointerNode>());
+      }
+      root->children.push_back(std::move(node));
+    }
+    
+    size_t count = 0;
+    for (const auto &node : root->children) {
+      count += node->children.size() + 1;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * top_level * (fanout + 1));
+}
+BENCHMARK(BM_BuildPointerTree)->Unit(benchmark::kMillisecond);
+
+class NodeCounter : public ASTVisitor<NodeCounter> {
+public:
+  size_t count = 0;
+  void visit_directive(const AST &ast, NodeID id) {
+    count++;
+    visit_children(ast, id);
+  }
+};
+
+// Builds, walks and frees the same shape of tree as BM_BuildPointerTree
+static void BM_BuildCompactTree(benchmark::State &state) {
+  size_t bytes = 0;
+  for (auto _ : state) {
+    AST ast;
+    size_t root = ast.mark();
+    for (int i = 0; i < top_level; i++) {
+      size_t start = ast.mark();
+      for (int j = 0; j < fanout; j++) {
+        ast.add(ASTKind::Directive, Interner::none, SourceLocation());
+      }
+      ast.add(ASTKind::Directive, Interner::none, SourceLocation(), start);
+    }
+    ast.add(ASTKind::TranslationUnit, Interner::none, SourceLocation(), root);
+    
+    NodeCounter counter;
+    counter.visit(ast, ast.root());
+    benchmark::DoNotOptimize(counter.count);
+    bytes = ast.memory_usage();
+  }
+  state.SetItemsProcessed(state.iterations() * top_level * (fanout + 1));
+  state.counters["bytes_per_node"] = static_cast<double>(bytes) / (top_level * (fanout + 1));
+}
+BENCHMARK(BM_BuildCompactTree)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,277 @@
+#include "corpus.h"
+
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+// Bump when the generators change, so results are never compared across different generated inputs
+static constexpr unsigned int generator_version = 2;
+
+static fs::path corpus_dir(const string &name) {
+  fs::path dir = fs::temp_directory_path() / ("cllvm_bench_v" + std::to_string(generator_version)) / name;
+  fs::create_directories(dir);
+  return dir;
+}
+
+static void add_file(Corpus &corpus, const fs::path &path) {
+  corpus.bytes += fs::file_size(path);
+  corpus.files.push_back(path.string());
+}
+
+static string generate_function(std::mt19937 &rng) {
+  auto n = std::to_string(rng() % 1000);
+  string source;
+  source += "/* generated function " + n + "\n * with a block comment spanning lines\n */\n";
+  source += "#define LIMIT_" + n + " " + n + "\n";
+  source += "static const unsigned int table_" + n + "[4] = { " + n + ", 0x1f, 'a', 3 };\n";
+  source += "struct record_" + n + " { int key; double weight; const char *label; };\n\n";
+  source += "int compute_" + n + "(int value, const char *name, struct record_" + n + " *out) {\n";
+  source += "  // scale the value\n";
+  source += "  if (value >= LIMIT_" + n + " && name != 0) {\n";
+  source += "    value += table_" + n + "[value % 4] << 2;\n";
+  source += "    out->weight = value * " + n + ".5;\n";
+  source += "  }\n";
+  source += "  for (int i = 0; i < 4; i++) {\n";
+  source += "    out->key ^= table_" + n + "[i];\n";
+  source += "  }\n";
+  source += "  out->label = \"record " + n + "\\n\";\n";
+  source += "  return value - \"" + n + "\"[0];\n";
+  source += "}\n\n";
+  return source;
+}
+
+const Corpus &synthetic_corpus() {
+  static Corpus corpus = [] {
+    Corpus result;
+    result.name = "synthetic";
+    std::mt19937 rng(42);
+
+    string source;
+    while (source.size() < 8 * 1024 * 1024) {
+      source += generate_function(rng);
+    }
+
+    fs::path path = corpus_dir(result.name) / "synthetic.c";
+    std::ofstream(path, std::ios::binary) << source;
+    add_file(result, path);
+    return result;
+  }();
+  return corpus;
+}
+
+const Corpus &macro_corpus() {
+  static Corpus corpus = [] {
+    Corpus result;
+    result.name = "macros";
+    std::mt19937 rng(13);
+
+    string source =
+      "#define MIN(a, b) ((a) < (b) ? (a) : (b))\n"
+      "#define MAX(a, b) ((a) > (b) ? (a) : (b))\n"
+      "#define CLAMP(x, lo, hi) MIN(MAX(x, lo), hi)\n"
+      "#define STR(x) #x\n"
+      "#define CAT(a, b) a ## b\n"
+      "#define XCAT(a, b) CAT(a, b)\n"
+      "#define VEC(T) CAT(vec_, T)\n"
+      "#define LOG(fmt, ...) log_message(__FILE__, __LINE__, fmt, ## __VA_ARGS__)\n"
+      "#define VEC_DEFINE(T) \\\n"
+      "  typedef struct { T *data; unsigned long len, cap; } VEC(T); \\\n"
+      "  static void XCAT(VEC(T), _push)(VEC(T) *v, T x) { \\\n"
+      "    if (v->len == v->cap) { v->cap = MAX(2 * v->cap, 8); LOG(\"grow \" STR(T)); } \\\n"
+      "    v->data[v->len++] = x; \\\n"
+      "  } \\\n"
+      "  static T XCAT(VEC(T), _get)(const VEC(T) *v, unsigned long i) { \\\n"
+      "    return v->data[CLAMP(i, 0, v->len - 1)]; \\\n"
+      "  }\n\n";
+
+    for (int i = 0; source.size() < 2 * 1024 * 1024; i++) {
+      auto n = std::to_string(i);
+      auto limit = std::to_string(rng() % 1000);
+      source += "typedef struct { int key; double weight; } item_" + n + ";\n";
+      source += "VEC_DEFINE(item_" + n + ")\n";
+      source += "int use_" + n + "(VEC(item_" + n + ") *items, int value) {\n";
+      source += "  value = CLAMP(value, 0, " + limit + ") + MIN(MAX(value, 1), MAX(2, " + limit + "));\n";
+      source += "  LOG(\"value %d of %s\", value, STR(use_" + n + "));\n";
+      source += "  return CAT(vec_item_" + n + ", _get)(items, value).key;\n";
+      source += "}\n\n";
+    }
+
+    fs::path path = corpus_dir(result.name) / "macros.c";
+    std::ofstream(path, std::ios::binary) << source;
+    add_file(result, path);
+    return result;
+  }();
+  return corpus;
+}
+
+const Corpus &conditional_corpus() {
+  static Corpus corpus = [] {
+    Corpus result;
+    result.name = "conditionals";
+    std::mt19937 rng(14);
+
+    string source;
+    for (int i = 0; source.size() < 4 * 1024 * 1024; i++) {
+      auto n = std::to_string(i);
+      source += "#if defined __x86_64__ && __x86_64__ == 1\n";
+      source += "typedef long word_" + n + ";\n";
+      source += "#elif defined __aarch64__ || defined(__arm__)\n";
+      source += generate_function(rng);
+      source += "#else\n# error \"unsupported target\"\n#endif\n\n";
+
+      source += "#ifdef __USE_LEGACY_" + n + "\n";
+      source += "# if LEGACY_LEVEL > 2\n";
+      source += generate_function(rng);
+      source += "# endif\n";
+      source += generate_function(rng);
+      source += "#endif\n\n";
+
+      source += "#if 0\n";
+      source += "/* it's the old version, which didn't check\n#endif\n */\n";
+      source += "don't use \"#else\" here \\\n#endif\n";
+      source += generate_function(rng);
+      source += "#endif\n\n";
+    }
+
+    fs::path path = corpus_dir(result.name) / "conditionals.c";
+    std::ofstream(path, std::ios::binary) << source;
+    add_file(result, path);
+    return result;
+  }();
+  return corpus;
+}
+
+const Corpus &expression_corpus() {
+  static Corpus corpus = [] {
+    Corpus result;
+    result.name = "expressions";
+    std::mt19937 rng(25);
+    const char *binary[] = {" * ", " / ", " % ", " + ", " - ", " << ", " >> ", " < ", " >= ", " == ", " != ",
+                            " & ", " ^ ", " | ", " && ", " || ", " = ", " += "};
+    const char *operands[] = {"x", "-y", "!flag", "*p++", "a[i]", "s.field", "q->next", "f(x, 1)", "42", "0x1fu"};
+    auto operand = [&] { return string(operands[rng() % std::size(operands)]); };
+    const size_t size = 1024 * 1024;
+
+    string flat = "x";
+    while (flat.size() < size) {
+      flat += binary[rng() % std::size(binary)] + operand();
+      if (rng() % 64 == 0) {
+        flat += " ? " + operand() + " : " + operand();
+      }
+    }
+
+    // each group nests to the deepest the parser allows, with an operator and operand at every level
+    string nested = "x";
+    while (nested.size() < size) {
+      nested += ", " + string(255, '(') + "x";
+      for (int depth = 0; depth < 255; depth++) {
+        nested += binary[rng() % 14] + operand() + ")";
+      }
+    }
+
+    string chains = "x";
+    for (int i = 0; chains.size() < size; i++) {
+      chains += i % 2 ? " ? " + operand() + " : x" + std::to_string(i) : " = y" + std::to_string(i);
+    }
+
+    fs::path dir = corpus_dir(result.name);
+    for (auto [name, source] : {std::pair{"flat.c", &flat}, {"nested.c", &nested}, {"chains.c", &chains}}) {
+      std::ofstream(dir / name, std::ios::binary) << *source << ";\n";
+      add_file(result, dir / name);
+    }
+    return result;
+  }();
+  return corpus;
+}
+
+const Corpus &test_files_corpus() {
+  static Corpus corpus = [] {
+    Corpus result;
+    result.name = "test_files";
+    fs::path dir = fs::path(__FILE__).parent_path().parent_path() / "test" / "test_files";
+
+    std::vector<fs::path> paths;
+    for (const auto &entry : fs::directory_iterator(dir)) {
+      if (entry.is_regular_file()) {
+        paths.push_back(entry.path());
+      }
+    }
+    std::sort(paths.begin(), paths.end());
+    for (const auto &path : paths) {
+      add_file(result, path);
+    }
+    return result;
+  }();
+  return corpus;
+}
+
+const Corpus &system_headers_corpus() {
+  static Corpus corpus = [] {
+    Corpus result;
+    result.name = "system_headers";
+
+    std::vector<fs::path> paths;
+    for (const auto &entry : fs::directory_iterator("/usr/include")) {
+      if (entry.is_regular_file() && entry.path().extension() == ".h") {
+        paths.push_back(entry.path());
+      }
+    }
+    std::sort(paths.begin(), paths.end());
+    for (const auto &path : paths) {
+      add_file(result, path);
+    }
+    return result;
+  }();
+  return corpus;
+}
+
+const Corpus &include_tree_corpus() {
+  static Corpus corpus = [] {
+    Corpus result;
+    result.name = "include_tree";
+    fs::path dir = corpus_dir(result.name);
+    std::mt19937 rng(7);
+
+    // a guarded header included from every other one, as common project headers are
+    fs::path common = dir / "common.h";
+    std::ofstream(common, std::ios::binary) << "#ifndef COMMON_H\n#define COMMON_H\n" << generate_function(rng)
+                                            << "#endif\n";
+
+    // a complete binary tree of headers, so each one is included once
+    constexpr int headers = 255;
+    std::vector<fs::path> paths = {common};
+    for (int i = 0; i < headers; i++) {
+      string source = "/* header " + std::to_string(i) + " */\n#include \"common.h\"\n";
+      for (int child : {2 * i + 1, 2 * i + 2}) {
+        if (child < headers) {
+          source += "#include \"header_" + std::to_string(child) + ".h\"\n";
+        }
+      }
+      for (int j = 0; j < 8; j++) {
+        source += generate_function(rng);
+      }
+
+      paths.push_back(dir / ("header_" + std::to_string(i) + ".h"));
+      std::ofstream(paths.back(), std::ios::binary) << source;
+    }
+
+    // the whole tree behind one guard, to be precompiled
+    fs::path prefix = dir / "tree.h";
+    std::ofstream(prefix, std::ios::binary) << "#ifndef TREE_H\n#define TREE_H\n#include \"header_0.h\"\n#endif\n";
+    paths.push_back(prefix);
+
+    fs::path main = dir / "main.c";
+    std::ofstream(main, std::ios::binary) << "#include \"header_0.h\"\nint main;\n";
+    add_file(result, main);
+    for (const auto &path : paths) {
+      add_file(result, path);
+    }
+    return result;
+  }();
+  return corpus;
+}
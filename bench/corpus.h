@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using std::string;
+
+// A fixed set of input files for the benchmarks. Generated corpora are rebuilt from a fixed seed on every run, so
+// results from different runs and machines measure the same input.
+struct Corpus {
+  string name;
+  std::vector<string> files;
+  size_t bytes = 0;
+};
+
+// About 8 MB of generated C in one file, with the mix of declarations, comments and literals of real sources
+const Corpus &synthetic_corpus();
+
+// About 2 MB of generated C built mostly out of macros: generic containers stamped out per element type, and
+// nested function-like, stringizing, pasting and variadic macros in every function body
+const Corpus &macro_corpus();
+
+// About 4 MB of generated C laid out like platform headers, where nearly everything is in a group that is not
+// compiled: branches for other targets, features that are not enabled and blocks left in #if 0
+const Corpus &conditional_corpus();
+
+// Three files of about 1 MB, each one generated expression joined by commas: a flat chain of thousands of operands
+// with operators of every precedence, parentheses nested as deeply as the parser allows, and long right to left
+// chains of ?: and assignments
+const Corpus &expression_corpus();
+
+// The sources under test/test_files
+const Corpus &test_files_corpus();
+
+// The headers directly under /usr/include, lexed as standalone files
+const Corpus &system_headers_corpus();
+
+// A generated tree of headers, each included exactly once, which all include one guarded common header. The first
+// file is the main file to parse, and the directory containing it has to be added to the include directories.
+// tree.h includes the whole tree behind an include guard.
+const Corpus &include_tree_corpus();
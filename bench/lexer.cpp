@@ -0,0 +1,234 @@
+#include "corpus.h"
+
+#include <benchmark/benchmark.h>
+#include <lexer.h>
+#include <token_buffer.h>
+#include <scan.h>
+#include <malloc.h>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+// Returns the number of tokens lexed, not counting the end of file
+static size_t lex_all(Lexer &lexer) {
+  size_t tokens = 0;
+  while (true) {
+    auto token = lexer.next();
+    if (token.type == CTokenType::CEndOfFile) {
+      return tokens;
+    }
+    benchmark::DoNotOptimize(token);
+    tokens++;
+  }
+}
+
+static void set_throughput(benchmark::State &state, size_t bytes, size_t tokens) {
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+  state.counters["tokens"] = static_cast<double>(tokens);
+  state.counters["tokens_per_second"] =
+      benchmark::Counter(static_cast<double>(tokens), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Lexer::next() over every file of a corpus, from mapped buffers
+static void BM_LexCorpus(benchmark::State &state, const Corpus &(*corpus)()) {
+  const Corpus &files = corpus();
+  std::vector<unique_ptr<SourceBuffer>> buffers;
+  for (const auto &path : files.files) {
+    buffers.push_back(SourceBuffer::from_file(path));
+  }
+
+  size_t tokens = 0;
+  for (auto _ : state) {
+    tokens = 0;
+    Interner strings;
+    for (const auto &buffer : buffers) {
+      Lexer lexer(*buffer, strings);
+      tokens += lex_all(lexer);
+    }
+  }
+  set_throughput(state, files.bytes, tokens);
+}
+BENCHMARK_CAPTURE(BM_LexCorpus, synthetic, synthetic_corpus)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_LexCorpus, test_files, test_files_corpus)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_LexCorpus, system_headers, system_headers_corpus)->Unit(benchmark::kMillisecond);
+
+// Input read through the std::istream fallback used for stdin and pipes. This reads the whole stream into a
+// buffer and then lexes it as a mapped file is lexed, so it is not the double-buffered stream lexer that mapping
+// replaced. That lexer is gone; the one comparison with it, made when mapping was added, lexed an 8 MB
+// generated file at 54 MB/s against 61 MB/s mapped.
+static void BM_LexStream(benchmark::State &state) {
+  const Corpus &corpus = synthetic_corpus();
+
+  size_t tokens = 0;
+  for (auto _ : state) {
+    std::ifstream source(corpus.files[0], std::ios::binary);
+    Interner strings;
+    Lexer lexer(static_cast<std::istream &>(source), strings);
+    tokens = lex_all(lexer);
+  }
+  set_throughput(state, corpus.bytes, tokens);
+}
+BENCHMARK(BM_LexStream)->Unit(benchmark::kMillisecond);
+
+// Input mapped by SourceBuffer, as the parser does for every file it opens
+static void BM_LexMapped(benchmark::State &state) {
+  const Corpus &corpus = synthetic_corpus();
+
+  size_t tokens = 0;
+  for (auto _ : state) {
+    auto buffer = SourceBuffer::from_file(corpus.files[0]);
+    Interner strings;
+    Lexer lexer(*buffer, strings);
+    tokens = lex_all(lexer);
+  }
+  set_throughput(state, corpus.bytes, tokens);
+}
+BENCHMARK(BM_LexMapped)->Unit(benchmark::kMillisecond);
+
+// Lexes the whole file into the compact structure of arrays layout, and reports the memory it takes per token
+// next to a CToken, either held by value or heap allocated behind a unique_ptr as Lexer::next() used to return it
+static void BM_LexToTokenBuffer(benchmark::State &state) {
+  auto source = SourceBuffer::from_file(synthetic_corpus().files[0]);
+  size_t tokens = 0;
+  size_t bytes = 0;
+  
+  for (auto _ : state) {
+    Interner strings;
+    auto buffer = TokenBuffer::lex(*source, strings);
+    tokens = buffer->size();
+    bytes = buffer->memory_usage();
+    benchmark::DoNotOptimize(buffer);
+  }
+  
+  auto heapToken = std::make_unique<CToken>();
+  // the allocator's chunk header sits in front of the usable size
+  size_t heapTokenBytes = sizeof(unique_ptr<CToken>) + malloc_usable_size(heapToken.get()) + sizeof(size_t);
+  
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * source->size()));
+  state.counters["tokens"] = static_cast<double>(tokens);
+  state.counters["buffer_bytes_per_token"] = static_cast<double>(bytes) / tokens;
+  state.counters["ctoken_bytes_per_token"] = sizeof(CToken);
+  state.counters["heap_ctoken_bytes_per_token"] = static_cast<double>(heapTokenBytes);
+}
+BENCHMARK(BM_LexToTokenBuffer)->Unit(benchmark::kMillisecond);
+
+// Iterates an already lexed buffer, as the parser does when a header is included again
+static void BM_ReplayTokenBuffer(benchmark::State &state) {
+  auto source = SourceBuffer::from_file(synthetic_corpus().files[0]);
+  Interner strings;
+  auto buffer = TokenBuffer::lex(*source, strings);
+  
+  for (auto _ : state) {
+    TokenReader reader(*buffer);
+    for (size_t i = 0; i < buffer->size(); i++) {
+      benchmark::DoNotOptimize(reader.next());
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * buffer->size()));
+}
+BENCHMARK(BM_ReplayTokenBuffer)->Unit(benchmark::kMillisecond);
+
+// Skips the comments and indentation of the system headers with each set of scan kernels this CPU supports
+static void BM_ScanKernels(benchmark::State &state) {
+  const ScanKernels *kernels = available_scan_kernels()[state.range(0)];
+  state.SetLabel(kernels->name);
+  
+  const Corpus &corpus = system_headers_corpus();
+  std::vector<unique_ptr<SourceBuffer>> headers;
+  for (const auto &path : corpus.files) {
+    headers.push_back(SourceBuffer::from_file(path));
+  }
+  
+  for (auto _ : state) {
+    for (const auto &header : headers) {
+      bool newline = false;
+      
+      // treat everything as alternating whitespace and comments, which is what dominates headers
+      for (const char *p = header->begin(); p < header->end();) {
+        p = kernels->skip_whitespace(p, newline);
+        if (*p == '/' && p[1] == '*') {
+          p = kernels->find_comment_end(p + 2) + 2;
+        } else {
+          p = kernels->find_line_end(p) + 1;
+        }
+      }
+      benchmark::DoNotOptimize(newline);
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus.bytes));
+}
+BENCHMARK(BM_ScanKernels)->DenseRange(0, static_cast<int>(available_scan_kernels().size()) - 1)->Unit(benchmark::kMillisecond);
+
+// Builds the line table of every system header, which is what turning the first location of a file into a line
+// costs. The lexer counts no lines, so this is paid only for files a line is asked of.
+static void BM_LineTable(benchmark::State &state) {
+  const Corpus &corpus = system_headers_corpus();
+  std::vector<unique_ptr<SourceBuffer>> headers(corpus.files.size());
+  
+  for (auto _ : state) {
+    // tables are kept once built, so each round starts from freshly read buffers
+    state.PauseTiming();
+    for (size_t i = 0; i < headers.size(); i++) {
+      headers[i] = SourceBuffer::from_file(corpus.files[i]);
+    }
+    state.ResumeTiming();
+    
+    for (const auto &header : headers) {
+      benchmark::DoNotOptimize(header->line_starts().size());
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus.bytes));
+}
+BENCHMARK(BM_LineTable)->Unit(benchmark::kMillisecond);
+
+// Keywords and identifiers separated by single spaces, so nearly all of the time goes on recognising words
+static void BM_LexIdentifiers(benchmark::State &state) {
+  static const char *words[] = {
+    "int", "value", "unsigned", "static", "const", "struct", "node", "next", "while", "return", "count",
+    "_Bool", "typedef", "size_t", "register", "restrict", "inline", "volatile", "do", "double", "doubled",
+    "if", "iffy", "for", "format", "sizeof", "signed", "switch", "case", "default", "buffer_length",
+  };
+  std::mt19937 rng(1);
+  string text;
+  while (text.size() < 4 * 1024 * 1024) {
+    text += words[rng() % std::size(words)];
+    text += ' ';
+  }
+  std::istringstream stream(text);
+  auto source = SourceBuffer::from_stream(stream);
+  
+  size_t tokens = 0;
+  for (auto _ : state) {
+    Interner strings;
+    Lexer lexer(*source, strings);
+    tokens = lex_all(lexer);
+  }
+  set_throughput(state, source->size(), tokens);
+}
+BENCHMARK(BM_LexIdentifiers)->Unit(benchmark::kMillisecond);
+
+// A table of string literals, as in embedded message tables and format strings, with an escape in one in four
+static void BM_LexStringTable(benchmark::State &state) {
+  static const char *entries[] = {
+    "\"could not open file\"", "\"%s: %d bytes written\\n\"", "\"unexpected end of input\"",
+    "\"invalid argument to --output\"", "\"expected ';' after expression\"", "\"\\tat line %u, column %u\"",
+    "\"the quick brown fox jumps over the lazy dog\"", "\"usage: program [options] file...\"",
+  };
+  std::mt19937 rng(1);
+  string text;
+  for (int i = 0; text.size() < 4 * 1024 * 1024; i++) {
+    text += entries[rng() % std::size(entries)];
+    text += i % 8 == 7 ? ",\n" : ", ";
+  }
+  std::istringstream stream(text);
+  auto source = SourceBuffer::from_stream(stream);
+  
+  size_t tokens = 0;
+  for (auto _ : state) {
+    Interner strings;
+    Lexer lexer(*source, strings);
+    tokens = lex_all(lexer);
+  }
+  set_throughput(state, source->size(), tokens);
+}
+BENCHMARK(BM_LexStringTable)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,161 @@
+#include "corpus.h"
+
+#include <benchmark/benchmark.h>
+#include <parser.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// The parser reports every include it enters and leaves on stdout, which would swamp the benchmark's own output
+class SilenceStdout {
+public:
+  SilenceStdout() : previous(std::cout.rdbuf(nullptr)) {}
+  ~SilenceStdout() { std::cout.rdbuf(previous); }
+
+private:
+  std::streambuf *previous;
+};
+
+// Parser::parse() over each file of a corpus as its own compilation
+static void BM_ParseCorpus(benchmark::State &state, const Corpus &(*corpus)()) {
+  const Corpus &files = corpus();
+  auto options = std::make_shared<Options>();
+  SilenceStdout silence;
+
+  for (auto _ : state) {
+    for (const auto &path : files.files) {
+      Parser parser(path, options);
+      benchmark::DoNotOptimize(parser.parse());
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * files.bytes));
+}
+BENCHMARK_CAPTURE(BM_ParseCorpus, synthetic, synthetic_corpus)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ParseCorpus, test_files, test_files_corpus)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ParseCorpus, macros, macro_corpus)->Unit(benchmark::kMillisecond);
+
+// One generated expression per file: a flat chain of operators of every precedence, deeply nested parentheses, and
+// long chains of ?: and assignments grouping right to left
+static void BM_ParseExpressions(benchmark::State &state) {
+  const Corpus &files = expression_corpus();
+  const string &path = files.files[state.range(0)];
+  auto options = std::make_shared<Options>();
+  state.SetLabel(std::filesystem::path(path).stem().string());
+  
+  size_t nodes = 0;
+  for (auto _ : state) {
+    Parser parser(path, options);
+    AST ast;
+    parser.parse_expression(ast);
+    nodes = ast.size();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * std::filesystem::file_size(path)));
+  state.counters["nodes"] = static_cast<double>(nodes);
+}
+BENCHMARK(BM_ParseExpressions)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+
+// Mostly inactive groups, skipped by scanning the bytes when lexing as the file is read, and by walking token
+// types when the whole file has been lexed into a buffer first
+static void BM_ParseConditionals(benchmark::State &state) {
+  const Corpus &files = conditional_corpus();
+  auto options = std::make_shared<Options>();
+  options->buffer_tokens = state.range(0);
+  state.SetLabel(options->buffer_tokens ? "buffered" : "lexed");
+  SilenceStdout silence;
+
+  for (auto _ : state) {
+    Parser parser(files.files[0], options);
+    benchmark::DoNotOptimize(parser.parse());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * files.bytes));
+}
+BENCHMARK(BM_ParseConditionals)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Parses the generated include tree, so the time goes on resolving, opening and entering includes. Run once
+// lexing each file as it is entered, and once with buffered tokens.
+static void BM_ParseIncludeTree(benchmark::State &state) {
+  const Corpus &tree = include_tree_corpus();
+  auto options = std::make_shared<Options>();
+  options->include_dirs.push_back(std::filesystem::path(tree.files[0]).parent_path().string());
+  options->buffer_tokens = state.range(0);
+  state.SetLabel(options->buffer_tokens ? "buffered" : "lexed");
+  SilenceStdout silence;
+
+  size_t skipped = 0;
+  for (auto _ : state) {
+    Parser parser(tree.files[0], options);
+    benchmark::DoNotOptimize(parser.parse());
+    skipped = parser.skipped_includes();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * tree.bytes));
+  state.counters["files"] = static_cast<double>(tree.files.size());
+  state.counters["skipped_includes"] = static_cast<double>(skipped);
+}
+BENCHMARK(BM_ParseIncludeTree)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// The include tree found at the end of a long list of search directories, as with many -I flags
+static void BM_ParseIncludeTreeLongSearchPath(benchmark::State &state) {
+  const Corpus &tree = include_tree_corpus();
+  auto options = std::make_shared<Options>();
+  for (int i = 0; i < 32; i++) {
+    auto dir = std::filesystem::temp_directory_path() / "cllvm_bench_search" / std::to_string(i);
+    std::filesystem::create_directories(dir);
+    options->include_dirs.push_back(dir.string());
+  }
+  options->include_dirs.push_back(std::filesystem::path(tree.files[0]).parent_path().string());
+  SilenceStdout silence;
+
+  for (auto _ : state) {
+    Parser parser(tree.files[0], options);
+    benchmark::DoNotOptimize(parser.parse());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * tree.bytes));
+  state.counters["search_dirs"] = static_cast<double>(options->include_dirs.size());
+}
+BENCHMARK(BM_ParseIncludeTreeLongSearchPath)->Unit(benchmark::kMillisecond);
+
+// A file including the whole include tree, parsed from scratch and then starting from a precompiled header of it
+static void BM_ParsePrecompiledTree(benchmark::State &state) {
+  const Corpus &tree = include_tree_corpus();
+  auto dir = std::filesystem::path(tree.files[0]).parent_path();
+  string main = (dir / "uses_tree.c").string();
+  std::ofstream(main) << "#include \"tree.h\"\nint main;\n";
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs.push_back(dir.string());
+  SilenceStdout silence;
+  
+  if (state.range(0)) {
+    string pch = (dir / "tree.pch").string();
+    Parser parser((dir / "tree.h").string(), options);
+    parser.parse();
+    parser.emit_pch(pch);
+    options->include_pch = pch;
+  }
+  state.SetLabel(state.range(0) ? "pch" : "cold");
+  
+  for (auto _ : state) {
+    Parser parser(main, options);
+    benchmark::DoNotOptimize(parser.parse());
+  }
+}
+BENCHMARK(BM_ParsePrecompiledTree)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// The same input parsed with lexing on the parser's thread and on a producer thread ahead of it. Pipelining only
+// pays off with a second core free for the producer.
+static void BM_ParsePipelined(benchmark::State &state, const Corpus &(*corpus)()) {
+  const Corpus &files = corpus();
+  auto options = std::make_shared<Options>();
+  options->include_dirs.push_back(std::filesystem::path(files.files[0]).parent_path().string());
+  options->pipeline_lexing = state.range(0);
+  state.SetLabel(options->pipeline_lexing ? "pipelined" : "serial");
+  SilenceStdout silence;
+  
+  for (auto _ : state) {
+    Parser parser(files.files[0], options);
+    benchmark::DoNotOptimize(parser.parse());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * files.bytes));
+}
+BENCHMARK_CAPTURE(BM_ParsePipelined, synthetic, synthetic_corpus)->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ParsePipelined, include_tree, include_tree_corpus)->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMillisecond);
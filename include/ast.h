@@ -5,13 +5,195 @@
 #ifndef CLLVM_AST_H
 #define CLLVM_AST_H
 
+#include "interner.h"
+#include "source_location.h"
 #include "token.h"
+
+#include <cstdint>
+#include <ostream>
 #include <vector>
 
+// Index of a node in its AST
+using NodeID = uint32_t;
+
+enum class ASTKind : uint8_t {
+  TranslationUnit,
+  Include,   // value is the name as written
+  Define,    // value is the macro name
+  Undef,     // value is the macro name
+  Pragma,    // value is the first word of the pragma, if any
+  Directive, // any other directive, which is given by the node's token
+  
+  // Expressions, where the node's token is the operator. Operands are children, in the order they are written.
+  Identifier,  // value is the name
+  Constant,    // value is the spelling, and token the type of constant
+  String,      // value is the literal as written, or none for adjacent literals, which are its children
+  Unary,       // a prefix operator, sizeof included
+  Postfix,     // ++ or -- after the operand
+  Binary,      // assignment and the comma operator included
+  Conditional, // ?:, with the condition and both results as children
+  Call,        // the function, then the arguments
+  Index,       // the array, then the subscript
+  Member,      // . or ->, with the member's name as value
+};
+
+// 16 bytes, with no pointers, so a tree is a few flat arrays that can be walked in order and freed at once. Where
+// a node came from is kept apart from it (see AST::location), as most walks never look.
+struct ASTNode {
+  ASTKind kind;
+  
+  // the directive of a Directive node, the operator of an expression, or the type of a Constant
+  CTokenType token;
+  
+  uint16_t reserved;
+  Symbol value;
+  
+  // the children are AST::children()[firstChild, firstChild + childCount)
+  uint32_t firstChild;
+  uint32_t childCount;
+};
+
+// Every node parsed from one translation unit. Nodes live in a single array and refer to each other by index, and
+// each node's children are a contiguous range of a second array, so building a tree costs no allocation per node
+// and destroying it frees two arrays no matter how large it is.
+//
+// Trees are built bottom up: children are added first, then the parent takes every node added since mark().
 class AST {
 public:
-  virtual ~AST() = default;
-  std::vector<unique_ptr<AST>> children;
+  [[nodiscard]] size_t mark() const { return pending.size(); }
+  
+  // Adds a node whose children are the nodes added since start was returned by mark()
+  NodeID add(ASTKind kind, Symbol value, SourceLocation location, size_t start);
+  
+  // Adds a node with no children
+  NodeID add(ASTKind kind, Symbol value, SourceLocation location) {
+    return add(kind, value, location, pending.size());
+  }
+  
+  // Adds a Directive node for the given directive token type
+  NodeID add_directive(CTokenType directive, SourceLocation location);
+  
+  // Adds a node with a token, such as an expression's operator, whose children are the nodes added since start
+  NodeID add(ASTKind kind, CTokenType token, Symbol value, SourceLocation location, size_t start);
+  
+  [[nodiscard]] const ASTNode &operator[](NodeID id) const { return nodes[id]; }
+  [[nodiscard]] size_t size() const { return nodes.size(); }
+  
+  // Where the node starts, which is the '#' of a directive or the start of an expression's first operand. The
+  // translation unit is the whole file, and has none.
+  [[nodiscard]] SourceLocation location(NodeID id) const { return locations[id]; }
+  
+  // Moves the locations in [first, last) by delta, for when the text they are in has been edited. Goes through
+  // every node.
+  void move_locations(SourceLocation first, SourceLocation last, int64_t delta);
+  
+  // The last node added, which is the root once the tree is finished
+  [[nodiscard]] NodeID root() const { return static_cast<NodeID>(nodes.size() - 1); }
+  
+  [[nodiscard]] const NodeID *children_begin(NodeID id) const { return childIDs.data() + nodes[id].firstChild; }
+  [[nodiscard]] const NodeID *children_end(NodeID id) const { return children_begin(id) + nodes[id].childCount; }
+  
+  // Bytes held by the tree
+  [[nodiscard]] size_t memory_usage() const;
+  
+  // How far building the tree had got, for going back to or carrying on from later. Only taken between top-level
+  // items, when the nodes added since are never children of nodes added before.
+  struct Position {
+    uint32_t nodes = 0;
+    uint32_t children = 0;
+    uint32_t pending = 0;
+  };
+  
+  [[nodiscard]] Position position() const;
+  
+  // Takes the root off a finished tree, so its children are pending again and more can be added
+  void reopen();
+  
+  // Removes the nodes added after at and returns them as a tree of their own, renumbered from 0, for append()
+  AST split(Position at);
+  
+  // Adds the nodes of other added after from, renumbered to follow the nodes here
+  void append(const AST &other, Position from);
+  
+private:
+  std::vector<ASTNode> nodes;
+  std::vector<SourceLocation> locations;
+  std::vector<NodeID> childIDs;
+  
+  // nodes that have not been taken as children yet
+  std::vector<NodeID> pending;
 };
 
+// Walks a tree with calls resolved at compile time. Derived classes define visit_<kind> for the kinds they care
+// about, and the defaults visit the children.
+template <typename Derived>
+class ASTVisitor {
+public:
+  void visit(const AST &ast, NodeID id) {
+    switch (ast[id].kind) {
+      case ASTKind::TranslationUnit:
+        return derived().visit_translation_unit(ast, id);
+      case ASTKind::Include:
+        return derived().visit_include(ast, id);
+      case ASTKind::Define:
+        return derived().visit_define(ast, id);
+      case ASTKind::Undef:
+        return derived().visit_undef(ast, id);
+      case ASTKind::Pragma:
+        return derived().visit_pragma(ast, id);
+      case ASTKind::Directive:
+        return derived().visit_directive(ast, id);
+      case ASTKind::Identifier:
+        return derived().visit_identifier(ast, id);
+      case ASTKind::Constant:
+        return derived().visit_constant(ast, id);
+      case ASTKind::String:
+        return derived().visit_string(ast, id);
+      case ASTKind::Unary:
+        return derived().visit_unary(ast, id);
+      case ASTKind::Postfix:
+        return derived().visit_postfix(ast, id);
+      case ASTKind::Binary:
+        return derived().visit_binary(ast, id);
+      case ASTKind::Conditional:
+        return derived().visit_conditional(ast, id);
+      case ASTKind::Call:
+        return derived().visit_call(ast, id);
+      case ASTKind::Index:
+        return derived().visit_index(ast, id);
+      case ASTKind::Member:
+        return derived().visit_member(ast, id);
+    }
+  }
+  
+  void visit_children(const AST &ast, NodeID id) {
+    for (const NodeID *child = ast.children_begin(id); child != ast.children_end(id); child++) {
+      visit(ast, *child);
+    }
+  }
+  
+  void visit_translation_unit(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_include(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_define(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_undef(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_pragma(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_directive(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_identifier(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_constant(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_string(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_unary(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_postfix(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_binary(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_conditional(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_call(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_index(const AST &ast, NodeID id) { visit_children(ast, id); }
+  void visit_member(const AST &ast, NodeID id) { visit_children(ast, id); }
+  
+private:
+  Derived &derived() { return static_cast<Derived &>(*this); }
+};
+
+// Writes the tree as indented text, one node a line, for --emit-ast
+void print_ast(const AST &ast, const Interner &strings, std::ostream &out);
+
 #endif //CLLVM_AST_H
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "options.h"
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::unique_ptr, std::shared_ptr, std::string;
+
+// The LLVM side of one translation unit. Each owns its own LLVMContext, so translation units can be compiled on
+// separate threads.
+class CodeGen {
+public:
+  CodeGen(const string &moduleName, shared_ptr<Options> options);
+
+  // Registers the host target with LLVM. Call once, before any CodeGen emits code.
+  static void initialize_targets();
+
+  // The triple of the host, which objects are compiled for
+  static string target_triple();
+
+  llvm::Module &module() { return *llvmModule; }
+
+  // Compiles the module for the host and writes a relocatable object file to path. With options->codegen_threads
+  // above one, the module is split into that many partitions, or one per function definition if there are fewer,
+  // which are compiled at once and linked back into one object with `ld -r`. With options->lto, writes bitcode with a
+  // module summary instead, for link_lto(). Throws if there is no target for the host, the file cannot be written or
+  // the partitions cannot be linked.
+  void emit_object(const string &path);
+
+private:
+  shared_ptr<Options> options;
+
+  llvm::LLVMContext context;
+  unique_ptr<llvm::Module> llvmModule;
+
+  void emit_bitcode(const string &path);
+
+  void emit_split(const string &path);
+};
+
+// Links the objects in parts into a single relocatable object at path, with the system linker's -r. Throws if
+// there is no linker or it fails.
+void link_relocatable(const std::vector<string> &parts, const string &path);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "interner.h"
+#include "source_manager.h"
+#include "token.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+using std::string, std::unique_ptr;
+
+namespace llvm {
+class MD5;
+}
+
+// Hashes the tokens a compilation is left with once includes, conditionals and macros are done with, which is
+// everything about its source that code generation sees. Comments, whitespace, inactive groups and macros that
+// are never used do not change the hash.
+class TokenHasher {
+public:
+  // With lines set, the line each token is on is hashed too, as debug information records it
+  explicit TokenHasher(bool lines);
+  ~TokenHasher();
+
+  TokenHasher(const TokenHasher &) = delete;
+  TokenHasher &operator=(const TokenHasher &) = delete;
+
+  // The line is looked up in sources, and only when lines are hashed
+  void add(const CToken &token, const Interner &strings, const SourceManager &sources);
+
+  // Hashes extra after the tokens, and returns the hash of it all as hex. Adds nothing more after this.
+  string finish(std::string_view extra);
+
+private:
+  unique_ptr<llvm::MD5> md5;
+  bool lines;
+
+  // tokens are gathered here and hashed a block at a time
+  char buffer[4096];
+  size_t used = 0;
+
+  void flush();
+};
+
+// Object files kept in a directory under the hash of everything that went into making them, so a translation
+// unit that comes out of preprocessing the same as before is not compiled again, whatever header was touched.
+// Each object's modification time is when it was last used, and the least recently used are removed once the
+// directory grows past its limit. Safe to use from several threads, and from several processes at once.
+class CompileCache {
+public:
+  // The cache in directory, shared by every compilation in this process that uses it
+  static CompileCache &at(const string &directory);
+
+  explicit CompileCache(string directory);
+
+  // Copies the object stored under key to path, marking it as just used. Returns false if there is none, or it
+  // could not be copied.
+  bool fetch(const string &key, const string &path);
+
+  // Copies the object at path into the cache under key, then removes the least recently used objects while the
+  // cache holds more than maxBytes. Errors are ignored, as the cache is only an optimization.
+  void store(const string &key, const string &path, uint64_t maxBytes);
+
+private:
+  string directory;
+
+  std::mutex mutex;
+
+  // bytes in the cache, counted once on the first store and kept up to date with this process's own stores
+  bool counted = false;
+  uint64_t total = 0;
+
+  // objects are spread over subdirectories named by the first two digits of their key
+  [[nodiscard]] string object_path(const string &key) const;
+
+  // Removes objects, oldest first, until the cache is well under maxBytes. Called with mutex held.
+  void evict(uint64_t maxBytes);
+};
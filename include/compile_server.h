@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+// A compilation asked of the compile server: a command line, run as if from directory
+struct CompileRequest {
+  string directory;
+  std::vector<string> args;
+};
+
+// What running the command line printed, and the status it would have exited with
+struct CompileResponse {
+  int status = 0;
+  string out;
+  string err;
+};
+
+// Requests and responses go over a stream socket as a 32-bit count or status followed by strings, each a 32-bit
+// length and then its bytes, in the byte order of the machine, as both ends are on it. Each returns false if the
+// connection failed or closed early. receive_request also returns false for a request with more arguments or
+// longer strings than these, rather than allocating whatever the counts ask for.
+constexpr uint32_t max_request_args = 1 << 16;
+constexpr uint32_t max_request_string = 1 << 20;
+
+bool send_request(int fd, const CompileRequest &request);
+bool receive_request(int fd, CompileRequest &request);
+bool send_response(int fd, const CompileResponse &response);
+bool receive_response(int fd, CompileResponse &response);
+
+// Sends a command line to the compile server at socketPath, run from the current directory, and writes what it
+// printed to out and err. Returns the status to exit with. This is all CLLVM-client does, so it links without
+// LLVM and starts in no time.
+int run_client(const string &socketPath, const std::vector<string> &args, std::ostream &out, std::ostream &err);
+
+// Compiles on behalf of clients, keeping what it learns warm from one compilation to the next: where includes
+// were found, included files read and lexed, and LLVM's targets, which are initialized once. Each connection is
+// answered on a thread of its own, in the client's working directory. Include lookups are checked for changes
+// to the directories they were made in at the start of each request, and headers against their size and
+// modification time each time they are used. What no compilation can use any more, lookups made again and
+// headers that changed, is let go at the start of each request too, so the caches only hold what is current.
+// Tracing is for the whole process, so requests with -ftime-trace are refused.
+class CompileServer {
+public:
+  // Listens on a Unix socket at socketPath, replacing the socket of a server that is no longer running. Throws
+  // if it cannot, or another server is running there.
+  explicit CompileServer(string socketPath);
+
+  // Removes the socket
+  ~CompileServer();
+
+  CompileServer(const CompileServer &) = delete;
+  CompileServer &operator=(const CompileServer &) = delete;
+
+  // Answers requests until stop() is called, then waits for those being answered
+  void run();
+
+  // Makes run() return. Async-signal-safe, so it can be called from a SIGTERM handler.
+  void stop();
+
+  [[nodiscard]] size_t requests_answered() const { return answered; }
+
+private:
+  string socketPath;
+  int listener = -1;
+  std::atomic<bool> stopping = false;
+
+  // connections still being answered, which run() waits for
+  std::mutex mutex;
+  std::condition_variable idle;
+  size_t active = 0;
+
+  std::atomic<size_t> answered = 0;
+
+  void answer(int connection);
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "options.h"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+using std::shared_ptr, std::string;
+
+// What compiling one input produced
+struct CompileResult {
+  bool failed = false;
+
+  // errors, followed by the statistics with --stats
+  string diagnostics;
+  
+  // what was asked to be printed, such as the tree with --emit-ast
+  string output;
+  
+  // whether the object was found in the compile cache, with --cache-dir
+  enum class CacheUse : uint8_t { None, Hit, Miss };
+  CacheUse cache = CacheUse::None;
+};
+
+// Compiles one input with its own parser and LLVM context
+CompileResult compile_file(const string &input, const shared_ptr<Options> &options);
+
+// Compiles every input on options->jobs threads. The diagnostics and output of each input are written to
+// diagnostics and output as a block, in the order the inputs were given, no matter which finishes first, followed
+// by the compile cache's hits and misses with --verbose or --stats. Returns the number of inputs that failed.
+size_t compile_all(const shared_ptr<Options> &options, std::ostream &diagnostics, std::ostream &output = std::cout);
+
+// Does what the command line in options asks, printing usage, the version or the output of compiling to out and
+// errors to err, as main does for a command line that is not --serve. Returns the status to exit with.
+int run(const shared_ptr<Options> &options, std::ostream &out, std::ostream &err);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "interner.h"
+#include "source_manager.h"
+#include "token_buffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using std::shared_ptr, std::unique_ptr, std::string;
+
+// Included files kept read and lexed across compilations, for the compile server. Each is lexed with an interner
+// of its own, as every compilation has its own, and is checked against the file's inode, size and modification
+// time each time a compilation opens it, so a header that was edited or replaced is read again.
+class HeaderCache {
+public:
+  struct Header {
+    unique_ptr<SourceBuffer> source;
+    Interner strings;
+
+    // lexed with strings, with the line table already built, so it is only ever read once shared
+    unique_ptr<TokenBuffer> tokens;
+
+    // the file as it was when it was read, and its absolute path
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    string path;
+  };
+
+  static HeaderCache &shared();
+
+  // The header at path, read and lexed again if it has changed since it was cached. Returns nullptr if it cannot
+  // be read. The header stays valid for as long as it is held, even if it is replaced in the cache.
+  shared_ptr<const Header> open(const string &path);
+
+  // Drops the headers whose file has changed or gone since it was read. open() only notices a change to a file it
+  // is asked for again, and a file that was replaced is asked for by another ID, so this is what keeps a
+  // long-running process from holding on to every version of every header it has read.
+  void revalidate();
+
+  void clear();
+
+  // headers kept for the next compilation
+  [[nodiscard]] size_t size() const {
+    std::lock_guard lock(mutex);
+    return headers.size();
+  }
+
+  // opens answered from the cache, and opens that had to read and lex the file
+  [[nodiscard]] size_t hits() const { return hitCount; }
+  [[nodiscard]] size_t misses() const { return missCount; }
+
+private:
+  mutable std::mutex mutex;
+  std::unordered_map<FileID, shared_ptr<const Header>> headers;
+
+  std::atomic<size_t> hitCount = 0;
+  std::atomic<size_t> missCount = 0;
+};
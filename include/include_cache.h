@@ -0,0 +1,94 @@
+#pragma once
+
+#include "source_manager.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using std::string, std::unique_ptr;
+
+// Remembers where include names resolve in each search directory, including where they do not, so each
+// (directory, name) pair is looked up on disk at most once per process. Shared by every parser in the process.
+//
+// A long-running process, such as the compile server, calls revalidate() before each compilation, which looks up
+// again the names in any directory that has changed since. Each compilation is bracketed by begin_compilation()
+// and end_compilation() there, so that the entries it was handed are kept until it is done with them.
+class IncludeCache {
+public:
+  // The state of a directory that results were found in, or not found in
+  struct Directory {
+    bool exists = false;
+    uint64_t inode = 0;
+    int64_t mtime = 0;
+
+    // bumped whenever the directory is found to have changed
+    uint64_t version = 0;
+  };
+
+  struct Entry {
+    string path;
+
+    // invalid if there is no such file in the directory
+    FileID id;
+
+    // the directory path is in, and its version when this was looked up
+    const Directory *directory = nullptr;
+    uint64_t version = 0;
+  };
+
+  static IncludeCache &shared();
+
+  // Resolves name relative to dir, or as given if dir is empty. A relative dir is taken relative to base, the
+  // working directory of the caller, as requests to the compile server each have their own. Returns nullptr if
+  // there is no such file. Entries stay valid until clear() is called, or, once looked up again, until every
+  // compilation that was running at the time has ended.
+  const Entry *lookup(const string &dir, std::string_view name, const string &base = "");
+
+  // Checks each directory a result came from against its inode and modification time, which change whenever a
+  // file is created, removed or renamed in it, so that the names in those that changed are looked up again. Also
+  // frees the entries that were looked up again while no compilation still running had started.
+  void revalidate();
+
+  // Marks a compilation as running, returning what to pass to end_compilation() when it is done
+  uint64_t begin_compilation();
+  void end_compilation(uint64_t started);
+
+  // Forgets every result, for when files may have been created or removed since they were looked up
+  void clear();
+
+  // lookups answered from the cache, and lookups that had to go to the file system
+  [[nodiscard]] size_t hits() const { return hitCount; }
+  [[nodiscard]] size_t misses() const { return missCount; }
+
+private:
+  std::mutex mutex;
+
+  // keyed by the base if dir is relative, the directory and name, joined with NULs, which cannot appear in any
+  std::unordered_map<string, unique_ptr<Entry>> entries;
+
+  // keyed by absolute path. Nodes never move, so entries can point at them.
+  std::unordered_map<string, Directory> directories;
+
+  // compilations begun, and the number each running one was given, oldest first
+  uint64_t begun = 0;
+  std::set<uint64_t> running;
+
+  // entries that have been looked up again, kept alive for whoever was handed them, in the order they were
+  // replaced. Only compilations begun by then can hold one.
+  struct Replaced {
+    uint64_t begun = 0;
+    unique_ptr<Entry> entry;
+  };
+  std::vector<Replaced> replaced;
+
+  std::atomic<size_t> hitCount = 0;
+  std::atomic<size_t> missCount = 0;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "interner.h"
+#include "token.h"
+
+#include <cstdint>
+
+// Watches the tokens of one file for the include guard pattern, where everything in the file is inside a single
+// `#ifndef X ... #endif`. Once the file has been read to the end, guard() names X if the pattern held, and the
+// file can be skipped whenever it is included again while X is still defined.
+class GuardDetector {
+public:
+  void observe(const CToken &token);
+
+  // The guard macro, or Interner::none if the file is not guarded or has not been read to the end yet
+  [[nodiscard]] Symbol guard() const { return state == State::Closed ? macro : Interner::none; }
+
+private:
+  enum class State : uint8_t {
+    Start,      // nothing read yet
+    Ifndef,     // read the opening #ifndef, expecting the macro name
+    Inside,     // inside the guarded region
+    Closed,     // read the matching #endif, so only the end of file may follow
+    NotGuarded,
+  };
+
+  State state = State::Start;
+  Symbol macro = Interner::none;
+
+  // conditional nesting depth inside the guarded region
+  unsigned int depth = 0;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "ast.h"
+#include "parser.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A change to a file's text: `removed` bytes at offset replaced by text
+struct TextEdit {
+  uint32_t offset = 0;
+  uint32_t removed = 0;
+  string text;
+};
+
+// Keeps the tokens and tree of a file up to date as it is edited, for editor integrations, so the work an edit
+// costs follows the size of the edit rather than of the file.
+//
+// Only the tokens around each edit are lexed again. The parser saves its state at directives of the file every
+// so often, and an edit is parsed from the last saved state before it, until the parser reaches a directive where
+// the previous parse saved the same state. The rest of the previous tree is kept from there. Edits that touch no
+// directive leave the tree as it is. Headers are read once, and are assumed not to change.
+class IncrementalParser {
+public:
+  // Parses text as the contents of filename. Throws what the parser throws.
+  IncrementalParser(const string &filename, std::string_view text, shared_ptr<Options> options);
+
+  // Applies the edits in order, each to the text the ones before it left, and brings the tree up to date. Throws
+  // what the parser throws, after which the tree is incomplete until an update succeeds.
+  void apply(const std::vector<TextEdit> &edits);
+
+  [[nodiscard]] std::string_view text() const { return {source->begin(), source->size()}; }
+
+  [[nodiscard]] const TokenBuffer &tokens() const { return *buffer; }
+
+  [[nodiscard]] const AST &tree() const { return ast; }
+
+  [[nodiscard]] const Interner &interner() const { return parser->interner(); }
+
+  [[nodiscard]] const SourceManager &source_manager() const { return parser->source_manager(); }
+
+  // What the last update did
+  struct Work {
+    size_t tokensLexed = 0;
+
+    // tokens of the file the parser went through, not counting those of headers
+    size_t tokensParsed = 0;
+
+    // the end of the previous tree was kept
+    bool reused = false;
+  };
+
+  [[nodiscard]] const Work &last_update() const { return work; }
+
+  // Tokens of the file parsed between saved states
+  static constexpr size_t checkpoint_interval = 1024;
+
+private:
+  // The parser's state as it reached a directive of the file
+  struct Checkpoint {
+    // index of the directive in the file's tokens
+    size_t token = 0;
+
+    AST::Position tree;
+    MacroTable macros;
+    std::array<Symbol, 256> keywordMacros{};
+    std::unordered_map<FileID, Symbol> includeGuards;
+    std::unordered_set<FileID> onceFiles;
+    std::vector<Parser::IncludeFrame::Conditional> conditionals;
+  };
+
+  unique_ptr<Parser> parser;
+  unique_ptr<SourceBuffer> source;
+  unique_ptr<TokenBuffer> buffer;
+
+  AST ast;
+
+  // the tree has its root, and the checkpoints cover the whole file
+  bool complete = false;
+
+  std::vector<Checkpoint> checkpoints;
+
+  Work work;
+
+  [[nodiscard]] Checkpoint save(size_t token) const;
+
+  void restore(const Checkpoint &checkpoint);
+
+  [[nodiscard]] bool same_state(const Checkpoint &checkpoint) const;
+
+  // Parses the tokens from first on, where the tokens that were [first, end - shift) are now [first, end). With
+  // resync set, the parser stops at the first directive past the change where it is in the same state as before.
+  void reparse(size_t first, size_t end, std::ptrdiff_t shift, bool resync);
+};
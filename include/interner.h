@@ -0,0 +1,110 @@
+#pragma once
+
+#include "number.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+using std::unique_ptr;
+
+// Handle for an interned string. Two symbols from the same Interner are equal exactly when their strings are.
+using Symbol = uint32_t;
+
+// Per-compilation table of identifier and literal spellings. Each distinct string is stored once, in chunks that
+// never move, so the views handed out stay valid for the lifetime of the table. Neither the strings nor the table
+// of them ever move either, so get() may be called for a symbol another thread has handed over while that thread
+// goes on interning. Interning from more than one thread at once is only safe while the table is shared (see
+// set_shared).
+class Interner {
+public:
+  // Carried by tokens whose spelling is fixed by their type. Always maps to the empty string.
+  static constexpr Symbol none = 0;
+
+  Interner();
+
+  Interner(const Interner &) = delete;
+  Interner &operator=(const Interner &) = delete;
+
+  // Makes interning take a lock, for while another thread interns too, as a TokenPipe's producer does. Only
+  // called while no other thread uses the table.
+  void set_shared(bool isShared) { shared = isShared; }
+
+  Symbol intern(std::string_view str);
+
+  // Interns a string without copying it, for strings in memory that outlives the table, such as a mapped
+  // precompiled header
+  Symbol intern_stored(std::string_view str);
+
+  // Interns the spelling of an integer or floating constant, decoding it the first time it is seen, so its value
+  // is looked up rather than worked out again wherever the constant is used
+  Symbol intern_number(std::string_view spelling);
+  Symbol intern_number_stored(std::string_view spelling);
+
+  // The value of a constant interned with intern_number, or an invalid Number for a symbol it was never given
+  [[nodiscard]] const Number &number(Symbol symbol) const {
+    size_t index = symbol + first_segment_size;
+    unsigned int segment = 63 - __builtin_clzll(index) - first_segment_bits;
+    if (!numbers[segment]) {
+      return undecoded;
+    }
+    return numbers[segment][index - (first_segment_size << segment)];
+  }
+
+  [[nodiscard]] std::string_view get(Symbol symbol) const {
+    size_t index = symbol + first_segment_size;
+    unsigned int segment = 63 - __builtin_clzll(index) - first_segment_bits;
+    return segments[segment][index - (first_segment_size << segment)];
+  }
+
+  // Number of distinct strings, including the empty string
+  [[nodiscard]] size_t size() const { return count; }
+
+private:
+  static constexpr size_t chunk_size = 64 * 1024;
+
+  // Strings indexed by symbol. Segment k holds the next first_segment_size << k symbols, so the segments cover
+  // every symbol and are never reallocated.
+  static constexpr unsigned int first_segment_bits = 10;
+  static constexpr size_t first_segment_size = size_t(1) << first_segment_bits;
+  std::array<unique_ptr<std::string_view[]>, 32 - first_segment_bits> segments;
+  size_t count = 0;
+
+  // Decoded constants, laid out as the strings are. A segment is only allocated once a constant is interned into
+  // it, so a table of identifiers alone takes no room for them.
+  std::array<unique_ptr<Number[]>, 32 - first_segment_bits> numbers;
+  static const Number undecoded;
+
+  std::vector<uint32_t> hashes;
+
+  // Open addressed hash table of symbols, with none marking an empty slot. The size is always a power of two.
+  std::vector<Symbol> slots;
+
+  bool shared = false;
+  std::mutex mutex;
+
+  // Holds the lock if the table is shared, and nothing otherwise
+  std::unique_lock<std::mutex> lock_if_shared() {
+    return shared ? std::unique_lock<std::mutex>(mutex) : std::unique_lock<std::mutex>();
+  }
+
+  std::vector<unique_ptr<char[]>> chunks;
+  char *chunkPos = nullptr;
+  size_t chunkLeft = 0;
+
+  const char *store(std::string_view str);
+
+  void append(std::string_view str, uint32_t hash);
+
+  // Finds str, or adds it with the storage given by store if it is not there yet
+  template <typename Store>
+  Symbol find_or_add(std::string_view str, Store store);
+
+  void grow();
+
+  void decode(Symbol symbol);
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include <token.h>
+
+// Perfect hash tables for the C99 keywords and the preprocessor directives, built at compile time. A word is
+// hashed from its length and its first, second and last characters, so a lookup reads at most three characters
+// and does a single comparison against the only candidate.
+
+struct KeywordEntry {
+  std::string_view spelling;
+  CTokenType type;
+};
+
+namespace keyword_hash {
+
+constexpr uint32_t key(const char *word, size_t length) {
+  auto byte = [](char ch) { return static_cast<uint32_t>(static_cast<unsigned char>(ch)); };
+  return byte(word[0]) | byte(length > 1 ? word[1] : 0) << 8 | byte(word[length - 1]) << 16 |
+         static_cast<uint32_t>(length) << 24;
+}
+
+template <size_t Bits>
+constexpr size_t slot(uint32_t key, uint32_t multiplier) {
+  return (key * multiplier) >> (32 - Bits);
+}
+
+template <size_t Bits>
+struct Table {
+  uint32_t multiplier = 0;
+  size_t minLength = 0;
+  size_t maxLength = 0;
+  std::array<KeywordEntry, size_t(1) << Bits> slots{};
+
+  // the word's type if it is in the table, or notFound
+  [[nodiscard]] CTokenType find(const char *word, size_t length, CTokenType notFound) const {
+    if (length < minLength || length > maxLength) {
+      return notFound;
+    }
+    const KeywordEntry &entry = slots[slot<Bits>(key(word, length), multiplier)];
+    if (entry.spelling.size() == length && std::memcmp(entry.spelling.data(), word, length) == 0) {
+      return entry.type;
+    }
+    return notFound;
+  }
+};
+
+// Tries odd multipliers until every word lands in its own slot
+template <size_t Bits, size_t N>
+constexpr Table<Bits> build(const std::array<KeywordEntry, N> &words) {
+  Table<Bits> table;
+  table.minLength = words[0].spelling.size();
+  for (const auto &word : words) {
+    table.minLength = word.spelling.size() < table.minLength ? word.spelling.size() : table.minLength;
+    table.maxLength = word.spelling.size() > table.maxLength ? word.spelling.size() : table.maxLength;
+  }
+
+  for (uint32_t multiplier = 0x9E3779B1u;; multiplier += 2) {
+    std::array<bool, size_t(1) << Bits> used{};
+    bool collision = false;
+    for (const auto &word : words) {
+      size_t i = slot<Bits>(key(word.spelling.data(), word.spelling.size()), multiplier);
+      if (used[i]) {
+        collision = true;
+        break;
+      }
+      used[i] = true;
+    }
+
+    if (!collision) {
+      table.multiplier = multiplier;
+      for (const auto &word : words) {
+        table.slots[slot<Bits>(key(word.spelling.data(), word.spelling.size()), multiplier)] = word;
+      }
+      return table;
+    }
+  }
+}
+
+inline constexpr std::array<KeywordEntry, 37> keywords = {{
+  {"auto", CTokenType::CKeywordAuto},
+  {"break", CTokenType::CKeywordBreak},
+  {"case", CTokenType::CKeywordCase},
+  {"char", CTokenType::CKeywordChar},
+  {"const", CTokenType::CKeywordConst},
+  {"continue", CTokenType::CKeywordContinue},
+  {"default", CTokenType::CKeywordDefault},
+  {"do", CTokenType::CKeywordDo},
+  {"double", CTokenType::CKeywordDouble},
+  {"else", CTokenType::CKeywordElse},
+  {"enum", CTokenType::CKeywordEnum},
+  {"extern", CTokenType::CKeywordExtern},
+  {"float", CTokenType::CKeywordFloat},
+  {"for", CTokenType::CKeywordFor},
+  {"goto", CTokenType::CKeywordGoto},
+  {"if", CTokenType::CKeywordIf},
+  {"inline", CTokenType::CKeywordInline},
+  {"int", CTokenType::CKeywordInt},
+  {"long", CTokenType::CKeywordLong},
+  {"register", CTokenType::CKeywordRegister},
+  {"restrict", CTokenType::CKeywordRestrict},
+  {"return", CTokenType::CKeywordReturn},
+  {"short", CTokenType::CKeywordShort},
+  {"signed", CTokenType::CKeywordSigned},
+  {"sizeof", CTokenType::CKeywordSizeof},
+  {"static", CTokenType::CKeywordStatic},
+  {"struct", CTokenType::CKeywordStruct},
+  {"switch", CTokenType::CKeywordSwitch},
+  {"typedef", CTokenType::CKeywordTypedef},
+  {"union", CTokenType::CKeywordUnion},
+  {"unsigned", CTokenType::CKeywordUnsigned},
+  {"void", CTokenType::CKeywordVoid},
+  {"volatile", CTokenType::CKeywordVolatile},
+  {"while", CTokenType::CKeywordWhile},
+  {"_Bool", CTokenType::CKeyword_Bool},
+  {"_Complex", CTokenType::CKeyword_Complex},
+  {"_Imaginary", CTokenType::CKeyword_Imaginary},
+}};
+
+// spelled without the '#', as the lexer sees the name after skipping it and any blanks
+inline constexpr std::array<KeywordEntry, 12> directives = {{
+  {"include", CTokenType::CPreprocessorInclude},
+  {"define", CTokenType::CPreprocessorDefine},
+  {"undef", CTokenType::CPreprocessorUndef},
+  {"line", CTokenType::CPreprocessorLine},
+  {"error", CTokenType::CPreprocessorError},
+  {"pragma", CTokenType::CPreprocessorPragma},
+  {"if", CTokenType::CPreprocessorIf},
+  {"ifdef", CTokenType::CPreprocessorIfdef},
+  {"ifndef", CTokenType::CPreprocessorIfndef},
+  {"elif", CTokenType::CPreprocessorElif},
+  {"else", CTokenType::CPreprocessorElse},
+  {"endif", CTokenType::CPreprocessorEndif},
+}};
+
+inline constexpr Table<7> keyword_table = build<7>(keywords);
+inline constexpr Table<5> directive_table = build<5>(directives);
+
+} // namespace keyword_hash
+
+// The keyword type of word, or CIdentifier if it is not a keyword
+inline CTokenType lookup_keyword(const char *word, size_t length) {
+  return keyword_hash::keyword_table.find(word, length, CTokenType::CIdentifier);
+}
+
+// The directive type of a name following '#', or CUnknown if it is not a directive
+inline CTokenType lookup_directive(const char *name, size_t length) {
+  return keyword_hash::directive_table.find(name, length, CTokenType::CUnknown);
+}
@@ -2,48 +2,93 @@
 
 #include <memory>
 #include <token.h>
+#include <source_manager.h>
+#include <scan.h>
 #include <string>
 #include <fstream>
-#include <optional>
 
 
 using std::unique_ptr, std::shared_ptr, std::string;
 
 class Lexer {
 public:
-  explicit Lexer(std::istream &source, string filename = "");
+  // Reads the whole stream into a buffer owned by the lexer. Use this for stdin and pipes only; files should be
+  // loaded through a SourceManager so they are mapped rather than copied.
+  Lexer(std::istream &source, Interner &strings, string filename = "");
   
-  unique_ptr<CToken> next();
+  // Lexes a buffer owned by the caller, which must outlive the lexer.
+  // Identifier and constant spellings are interned into strings, which is shared by every lexer in a compilation.
+  // Tokens are located from start, the location SourceManager::start_of gave the buffer, or have no location.
+  Lexer(const SourceBuffer &buffer, Interner &strings, SourceLocation start = {});
+  
+  // Lexes text owned by the caller, which must be followed by at least SourceBuffer::padding NUL bytes
+  Lexer(std::string_view text, Interner &strings);
+  
+  // The next token, with its flags describing the whitespace before it
+  CToken next();
+  
+  // Skips the rest of an inactive conditional group without making tokens for it, and returns the #elif, #else or
+  // #endif that ends the group, or the end of file. Conditionals nested in the group are skipped along with it.
+  CToken skip_inactive();
+  
+  // Carries on from offset as if a token with the given flags started there. For re-lexing part of a file that
+  // was lexed before, starting from the offset and flags of a token.
+  void seek(uint32_t offset, uint8_t flags);
+  
+  // Offset from the start of the file of the first character of the token last returned by next()
+  [[nodiscard]] uint32_t token_offset() const { return tokenStart - begin; }
 
   string filename;
 private:
-  std::istream *source;
-
-  char buf1[4097]{};
-  char buf2[4097]{};
+  // only set when the lexer was constructed from a stream
+  unique_ptr<SourceBuffer> ownedBuffer;
 
-  char *c;
+  // The buffer is NUL terminated, so c can be advanced without bounds checks. A NUL before end is a stray NUL
+  // character in the source rather than the end of the file.
+  const char *c;
+  const char *begin;
+  const char *end;
+  const char *tokenStart;
+  
+  Interner &strings;
+  
+  // vector kernels for skipping whitespace, comments and identifiers, chosen for this CPU
+  const ScanKernels &scan;
   string lexerError;
 
-  unsigned int line;
-  unsigned int col;
+  // location of the first character of the buffer, or 0 for none
+  uint32_t start = 0;
+  
+
+  [[nodiscard]] bool at_end() const { return *c == '\0' && c >= end; }
+  
+  // whether a newline, or whitespace or a comment, was skipped since the last token
+  bool atLineStart = true;
+  bool sawSpace = false;
   
-  bool isBuffer1;
+  // The token being lexed, located where it starts and flagged with what came before it. Made whole in one go,
+  // as a token is returned in registers and patching a byte of it afterwards costs a trip through the stack.
+  [[nodiscard]] CToken make(CTokenType type, Symbol value = Interner::none, uint8_t flags = 0) const {
+    CToken token(type, value, {start ? start + static_cast<uint32_t>(tokenStart - begin) : 0});
+    token.flags = flags | (atLineStart ? CToken::start_of_line : 0) | (sawSpace ? CToken::leading_space : 0);
+    return token;
+  }
   
-  void refreshBuffer1();
-  void refreshBuffer2();
+  CToken lex();
 
   void advance();
   
-  unique_ptr<CToken> lex_num();
+  CToken lex_num();
   
-  unique_ptr<CToken> lex_char();
+  CToken lex_char();
   
-  unique_ptr<CToken> lex_string();
+  CToken lex_string();
   
-  std::optional<char> lex_escape_character();
+  // Skips the backslash c is at and the character after it, which may be a quote or the newline of a line splice,
+  // along with any line splices between the two. Returns false if the file ends instead.
+  bool skip_escape();
   
-  unique_ptr<CToken> lex_word();
+  CToken lex_word();
   
-  unique_ptr<CToken> lex_preprocessor();
+  CToken lex_preprocessor();
 };
\ No newline at end of file
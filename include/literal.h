@@ -0,0 +1,30 @@
+#pragma once
+
+#include "interner.h"
+#include "token.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using std::string;
+
+// String and char constants keep the spelling they had in the source, quotes and escape sequences included, and
+// are only decoded once the bytes they stand for are needed. Decoding throws std::runtime_error for an invalid
+// escape sequence.
+
+// Appends the bytes a string literal stands for, without its quotes. One without escapes, which the lexer flags
+// with CToken::has_escapes, is copied in one go.
+void decode_string(std::string_view spelling, bool hasEscapes, string &out);
+
+// The bytes of adjacent string literals joined into one, as translation phase 6 does, decoded into a buffer
+// sized for all of them before the first is copied
+string concatenate_strings(const CToken *first, const CToken *last, const Interner &strings);
+
+// The value of a char constant. A single character is a char, so it is sign extended, and several are packed
+// into an int with the first in the highest byte, as in GCC.
+int32_t decode_char(std::string_view spelling, bool hasEscapes);
+
+// Appends text to the body of a string literal, putting a backslash before each '"' and '\\', as # does to the
+// string and char constants it stringizes. Returns whether there were any.
+bool append_escaped(string &out, std::string_view text);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+using std::string;
+
+// Links the bitcode written with -flto or -flto=thin into one relocatable object at output, optimizing across
+// modules: regular LTO merges its modules into one and generates code for it in `threads` partitions, and ThinLTO
+// imports across modules from their summaries and runs a backend for each module, `threads` at once. Inputs that
+// are not bitcode are linked in as they are. Every symbol stays visible to whatever the object is linked into.
+// Throws if an input cannot be read or the modules cannot be linked.
+void link_lto(const std::vector<string> &inputs, const string &output, unsigned int threads);
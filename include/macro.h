@@ -0,0 +1,134 @@
+#pragma once
+
+#include "interner.h"
+#include "token.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A macro definition. The replacement list is kept pre-lexed in its table, with each use of a parameter turned
+// into a CMacroParameter token, so expanding a macro copies tokens and never looks at its text again.
+struct Macro {
+  // macros whose expansion is made up when they are used rather than stored
+  enum class Builtin : uint8_t { None, File, Line };
+
+  Symbol name = Interner::none;
+  bool functionLike = false;
+
+  // the last parameter is __VA_ARGS__, or a named one written `name...`
+  bool variadic = false;
+
+  // the replacement list uses '#' or '##', so it cannot simply be copied even when there are no arguments
+  bool hasOperators = false;
+
+  Builtin builtin = Builtin::None;
+
+  uint32_t paramCount = 0;
+  uint32_t tokenCount = 0;
+
+  // where the parameter names and the replacement list start in the table's arrays
+  uint32_t firstParam = 0;
+  uint32_t firstToken = 0;
+};
+
+// Every macro defined in a translation unit, in an open addressing table keyed by the interned name. Symbols are
+// small consecutive integers, so a multiplicative hash spreads them evenly and a lookup is usually one probe.
+// Replacement lists and parameter names of all the macros are stored back to back in two arrays.
+class MacroTable {
+public:
+  MacroTable();
+
+  // The definition of name, or nullptr if it is not defined. Valid until the next define().
+  [[nodiscard]] const Macro *find(Symbol name) const;
+
+  [[nodiscard]] bool defined(Symbol name) const { return find(name) != nullptr; }
+
+  // Defines macro.name, replacing any earlier definition. Fills in where the parameters and tokens are stored.
+  void define(Macro macro, const std::vector<Symbol> &params, const std::vector<CToken> &tokens);
+
+  void undefine(Symbol name);
+
+  [[nodiscard]] const CToken *tokens(const Macro &macro) const { return replacement.data() + macro.firstToken; }
+  [[nodiscard]] const Symbol *params(const Macro &macro) const { return parameters.data() + macro.firstParam; }
+
+  // Whether both tables define the same macros the same way, however they came to
+  [[nodiscard]] bool same_definitions(const MacroTable &other) const;
+  
+  // Calls f with each defined macro, in an order that only depends on the definitions made
+  template <typename F>
+  void for_each(F f) const {
+    for (const Slot &slot : slots) {
+      if (slot.name != Interner::none && slot.macro != undefined) {
+        f(macros[slot.macro]);
+      }
+    }
+  }
+
+private:
+  static constexpr uint32_t undefined = UINT32_MAX;
+
+  // An undefined macro keeps its slot, marked undefined, so there is never a need for tombstones
+  struct Slot {
+    Symbol name = Interner::none;
+    uint32_t macro = undefined;
+  };
+
+  std::vector<Slot> slots;
+  size_t used = 0;
+
+  std::vector<Macro> macros;
+  std::vector<CToken> replacement;
+  std::vector<Symbol> parameters;
+
+  [[nodiscard]] size_t slot_of(Symbol name) const;
+
+  void grow();
+};
+
+// The hide sets of Prosser's expansion algorithm: the macros a token came out of, which must not be expanded
+// again from it. Each distinct set is stored once and named by an id that travels in a CToken, and the results of
+// the set operations are remembered, as expansion asks for the same ones over and over.
+class HideSets {
+public:
+  using ID = uint32_t;
+
+  static constexpr ID empty = 0;
+
+  HideSets();
+
+  [[nodiscard]] bool contains(ID set, Symbol macro) const;
+
+  ID add(ID set, Symbol macro);
+
+  ID intersect(ID a, ID b);
+
+  // the union of a and b
+  ID merge(ID a, ID b);
+
+private:
+  enum class Operation { Add, Intersect, Merge };
+
+  // the members of every set, sorted, back to back
+  std::vector<Symbol> members;
+
+  // start of each set's members, with one more entry for the end of the last set
+  std::vector<uint32_t> starts;
+
+  // set ids by their members, so each set is stored once
+  std::unordered_map<std::string, ID> ids;
+
+  // results of each operation, by its operands
+  std::unordered_map<uint64_t, ID> results[3];
+
+  // Returns the id of the set with these members, storing it if it is new. Throws once the members of every set
+  // no longer fit 32 bit offsets.
+  ID intern(const std::vector<Symbol> &sorted);
+
+  // reused for building each new set
+  std::vector<Symbol> scratch;
+
+  template <typename Combine>
+  ID remember(Operation operation, uint32_t a, uint32_t b, Combine combine);
+};
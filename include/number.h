@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// The value of an integer or floating constant and the C type it has, decoded once from its spelling. Types are
+// those of an LP64 target, where long and long long are both 64 bits.
+struct Number {
+  enum class Type : uint8_t {
+    Int,
+    UnsignedInt,
+    Long,
+    UnsignedLong,
+    LongLong,
+    UnsignedLongLong,
+    Float,
+    Double,
+    LongDouble,
+  };
+
+  enum class Error : uint8_t {
+    None,
+    // Not a constant at all, such as 08, 1.2.3 or 10px. Also what a spelling that was never decoded reads as.
+    Invalid,
+    // An integer too large for unsigned long long
+    TooLarge,
+  };
+
+  // For an invalid constant, Int or Double by whether it was meant to be an integer or floating constant
+  Type type = Type::Int;
+  Error error = Error::Invalid;
+
+  // Written with a u or U suffix, rather than made unsigned by its size
+  bool unsignedSuffix = false;
+
+  // Floating constants keep the precision of a double, long double ones included
+  union {
+    uint64_t integer = 0;
+    double floating;
+  };
+
+  [[nodiscard]] bool valid() const { return error == Error::None; }
+
+  [[nodiscard]] bool is_floating() const { return type >= Type::Float; }
+
+  [[nodiscard]] bool is_unsigned() const {
+    return type == Type::UnsignedInt || type == Type::UnsignedLong || type == Type::UnsignedLongLong;
+  }
+};
+
+// Decodes a preprocessing number such as 42, 0x1fUL, 017, 1.5e-3f or 0x1p4
+Number decode_number(std::string_view spelling);
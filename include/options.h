@@ -9,6 +9,12 @@
 #include <vector>
 #include <memory>
 #include <filesystem>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+// Written into precompiled headers and cache keys, so state from another build of the compiler is never reused
+inline constexpr const char *compiler_version = "CLLVM 0.1.0";
 
 static const std::vector<std::string> system_includes = {
   "/usr/local/include",
@@ -20,12 +26,27 @@ class Options {
 public:
   std::vector<std::string> include_dirs = system_includes;
   
-  std::string output = "a.out";
+  // object file to write. Only allowed with a single input, and defaults to the input's name with ".o".
+  std::string output;
+  
+  std::vector<std::string> inputs;
   
-  std::string input;
+  // translation units compiled at once
+  unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
   
   bool debug = false;
   
+  // threads to split each translation unit's code generation across
+  unsigned int codegen_threads = 1;
+  static constexpr unsigned int max_codegen_threads = 256;
+  
+  // Write LLVM bitcode with a module summary instead of native code, for link-time optimization
+  enum class LTOMode : uint8_t { None, Full, Thin };
+  LTOMode lto = LTOMode::None;
+  
+  // Link the inputs, bitcode from -flto, into one object at output instead of compiling them
+  bool lto_link = false;
+  
   bool verbose = false;
   
   bool help = false;
@@ -33,6 +54,72 @@ public:
   bool version = false;
   
   bool emit_ast = false;
+  
+  // Stop after preprocessing and print the result
+  bool preprocess_only = false;
+  
+  // Lex each file into a compact token buffer up front and replay it, instead of lexing a token at a time
+  bool buffer_tokens = false;
+  
+  // Lex on a separate thread, ahead of the parser. Takes precedence over buffer_tokens.
+  bool pipeline_lexing = false;
+  
+  // Write the state after parsing the input to this precompiled header
+  std::string emit_pch;
+  
+  // Start from the state in this precompiled header instead of an empty one
+  std::string include_pch;
+  
+  // Print counters and phase timings for each input after compiling it
+  bool stats = false;
+  
+  // Write a Chrome trace of where compile time went to this file
+  std::string time_trace;
+  
+  // Keep object files in this directory, under the hash of the preprocessed tokens and the options, and reuse
+  // them instead of compiling again
+  std::string cache_dir;
+  
+  // bytes the cache directory may hold before the least recently used objects are removed
+  uint64_t cache_size = uint64_t(1) << 30;
+  
+  // Run as a compile server listening on this Unix socket, instead of compiling
+  std::string serve;
+  
+  // Take included files from HeaderCache::shared(), so they stay lexed for the next compilation in this process.
+  // Set by the compile server rather than on the command line.
+  bool reuse_headers = false;
+  
+  // The object file written for input: output if it was given, otherwise the input's name with ".o", in the
+  // working directory
+  [[nodiscard]] std::string object_path(const std::string &input) const;
+  
+  // Reads the command line. Throws if an option is unknown, is missing its argument or does not go with the inputs.
+  static std::shared_ptr<Options> parse(int argc, char **argv);
 };
 
+inline constexpr const char *usage = R"(Usage: CLLVM [options] file...
+
+Options:
+  -o <file>              Write the object file to <file>
+  -j <n>                 Compile <n> files at once (default: one per hardware thread)
+  -I <dir>               Add <dir> to the include search path
+  -g                     Emit debug information
+  -fcodegen-threads=<n>  Generate the code of each file on <n> threads (default: 1)
+  -flto[=full|thin]      Write bitcode for link-time optimization instead of native code
+  --lto-link             Link the -flto bitcode given as inputs into one object at -o, optimizing across files
+  -E                     Print the preprocessed source instead of compiling it
+  -v, --verbose          Print more about what is being done
+  --emit-ast             Print the AST
+  --emit-pch <file>      Write a precompiled header of the input to <file>
+  --include-pch <file>   Start from the precompiled header <file>
+  --stats                Print what was read, counted and timed while compiling each input
+  -ftime-trace[=<file>]  Write a Chrome trace of compile time to <file> (default: trace.json)
+  --cache-dir <dir>      Reuse object files compiled from the same preprocessed source, kept in <dir>
+  --cache-size <n>[KMG]  Keep at most <n> bytes in the cache directory (default: 1G)
+  --serve <socket>       Run as a compile server on the Unix socket <socket>, for CLLVM-client
+  -h, --help             Print this message
+  --version              Print the compiler version
+)";
+
 #endif //CLLVM_OPTIONS_H
@@ -8,9 +8,25 @@
 #include "token.h"
 #include "lexer.h"
 #include "options.h"
+#include "source_manager.h"
+#include "interner.h"
+#include "token_buffer.h"
+#include "include_cache.h"
+#include "header_cache.h"
+#include "include_guard.h"
+#include "token_pipe.h"
+#include "macro.h"
+#include "stats.h"
+#include "compile_cache.h"
+#include "trace.h"
 
+#include <array>
+#include <iostream>
 #include <stack>
 #include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <ast.h>
 
@@ -18,32 +34,330 @@ using std::unique_ptr, std::shared_ptr;
 
 class Parser {
 private:
+  // resumes parsing from saved states as the file it parses is edited
+  friend class IncrementalParser;
+  
   shared_ptr<Options> options;
-  // stack of lexers to handle nested includes
-  std::vector<unique_ptr<Lexer>> lexers;
   
-  Lexer *current_lexer;
+  // every file read during this compilation, and any precompiled header. Declared before strings and includes so
+  // the buffers outlive them
+  SourceManager sources;
+  
+  // headers taken from the shared cache with options->reuse_headers, with their tokens interned into strings. The
+  // strings are not copied, so these are declared before strings too.
+  struct CachedHeader {
+    shared_ptr<const HeaderCache::Header> header;
+    unique_ptr<TokenBuffer> tokens;
+  };
+  std::unordered_map<FileID, CachedHeader> cachedHeaders;
+  
+  // spellings of identifiers and constants from every file in this compilation
+  Interner strings;
+  
+  // lexes every file on a separate thread when options->pipeline_lexing is set. Declared after sources and strings
+  // so the producer thread is stopped before they are destroyed.
+  unique_ptr<TokenPipe> pipe;
+  
+  // A file being read. Tokens come straight from a lexer, from a token buffer lexed ahead of time when
+  // options->buffer_tokens is set, or from the pipe.
+  struct IncludeFrame {
+    string filename;
+    FileID id;
+    GuardDetector guard;
+    unique_ptr<Lexer> lexer;
+    std::optional<TokenReader> reader;
+    TokenPipe *pipe = nullptr;
+    
+    // the time spent in an included file, recorded when it is left
+    trace::Span span;
+    
+    // tokens read from this entry of the file, which the parser adds to its statistics when the file is left,
+    // and the parser's counts of tokens by type. Tokens are only counted with --stats.
+    uint64_t tokens = 0;
+    std::array<uint64_t, 256> *tokenTypes = nullptr;
+    size_t statsFile = 0;
+    
+    // tokens of this file read ahead before an include was entered, which come back once it ends. The next is at
+    // the back.
+    std::vector<CToken> stash;
+    
+    // the conditionals of this file that have not been closed yet
+    struct Conditional {
+      // one of its groups has been read, so the rest are skipped
+      bool taken = false;
+      bool sawElse = false;
+    };
+    std::vector<Conditional> conditionals;
+    
+    CToken next() {
+      if (!stash.empty()) {
+        CToken token = stash.back();
+        stash.pop_back();
+        return token;
+      }
+      CToken token = lexer ? lexer->next() : reader ? reader->next() : pipe->next();
+      guard.observe(token);
+      count(token);
+      return token;
+    }
+    
+    // Skips to the #elif, #else or #endif that ends the inactive group being read, or the end of the file
+    CToken skip_inactive() {
+      if (!stash.empty()) {
+        return next();
+      }
+      CToken token = lexer ? lexer->skip_inactive() : reader ? reader->skip_inactive() : pipe->skip_inactive();
+      guard.observe(token);
+      count(token);
+      return token;
+    }
+    
+    void count(const CToken &token) {
+      if (tokenTypes) {
+        tokens++;
+        (*tokenTypes)[static_cast<uint8_t>(token.type)]++;
+      }
+    }
+  };
+  
+  // stack of files to handle nested includes
+  std::vector<IncludeFrame> includes;
+  
+  // the files on the include stack, for detecting circular includes
+  std::unordered_set<FileID> activeFiles;
+  
+  MacroTable macros;
+  
+  // the names of keywords that have been defined as macros, by token type, or Interner::none
+  std::array<Symbol, 256> keywordMacros{};
+  
+  HideSets hideSets;
+  
+  // Tokens to read before going back to the files: macro expansions waiting to be rescanned, and tokens read
+  // ahead. The next token is at the back.
+  std::vector<CToken> pending;
+  
+  // While a macro argument is expanded on its own, the pending tokens below pendingFloor belong to the
+  // surrounding expansion, and running out of the argument's tokens reads as the end of file
+  size_t pendingFloor = 0;
+  bool isolated = false;
+  
+  // Working space for one level of nested macro expansion. Each level keeps its buffers between expansions, so
+  // expanding allocates nothing once they have grown.
+  struct ExpansionBuffers {
+    // the arguments as written, back to back. Argument i is [argBounds[i], argBounds[i + 1]).
+    std::vector<CToken> args;
+    std::vector<uint32_t> argBounds;
+    
+    // the fully expanded arguments, each expanded the first time it is used
+    std::vector<CToken> expanded;
+    std::vector<std::pair<uint32_t, uint32_t>> expandedRanges;
+    
+    std::vector<CToken> result;
+  };
+  std::vector<unique_ptr<ExpansionBuffers>> expansionBuffers;
+  size_t expansionDepth = 0;
+  
+  // the tokens after the name of the directive being parsed, up to the end of its line
+  std::vector<CToken> directiveLine;
+  
+  // the macro expanded condition of the #if or #elif being evaluated
+  std::vector<CToken> condition;
+  
+  // parameters and replacement list of the macro being defined
+  std::vector<Symbol> defineParams;
+  std::vector<CToken> defineBody;
+  
+  // text being lexed or built up by the preprocessor: two pasted tokens, or a stringized argument
+  string scratchText;
   
+  // the producer is waiting for an answer to the include being parsed
+  bool pipeWaiting = false;
+  
+  // guard macros of the files found to be wholly wrapped in #ifndef ... #endif
+  std::unordered_map<FileID, Symbol> includeGuards;
+  
+  // files marked with #pragma once
+  std::unordered_set<FileID> onceFiles;
+  
+  // includes skipped because the file was guarded or marked #pragma once
+  size_t skippedIncludes = 0;
+  
+  // __LINE__ has been expanded, so moving lines around can change what is parsed
+  bool expandedLine = false;
+  
+  // An operator of the expression being parsed that is waiting for its right operand (see expression.cpp)
+  struct PendingOperator {
+    CTokenType op;
+    ASTKind kind;
+    
+    // how tightly it holds the operand on its right
+    uint8_t right;
+    
+    // its left operand, if any, and the operand after it start at this mark of the tree
+    uint32_t start;
+    SourceLocation at;
+  };
+  std::vector<PendingOperator> operators;
+  
+  // directives read in the middle of an expression, which go into the tree after it
+  AST heldDirectives;
+  
+  // what parse() adds the tokens it is left with to, if anything
+  TokenHasher *tokenHasher = nullptr;
+  
+  // counters reported with --stats. Only the tokens go uncounted without it, as the rest are counted per file or
+  // per include.
+  CompileStats stats;
+  
+  // where each file is in stats.files
+  std::unordered_map<FileID, size_t> statsFiles;
+  
+  // the path each file was first read through, including files read to build a precompiled header
+  std::unordered_map<FileID, string> filePaths;
+  
+  // token buffers of the files read so far in buffered mode, replayed when a file is included again
+  std::unordered_map<const SourceBuffer *, unique_ptr<TokenBuffer>> tokenBuffers;
+  
+  // the working directory, which relative include directories are cached under. Taken on the first lookup.
+  string workingDir;
+  
+  // Starts reading buffer, replaying tokens if they are given
+  void push_file(const SourceBuffer &buffer, const TokenBuffer *tokens = nullptr);
+  
+  // The next token before macro expansion
+  CToken read_token();
+  
+  // Moves to the next token, expanding macros
   void next();
   
-  unique_ptr<CToken> token;
+  CToken token;
   
-public:
-  explicit Parser(std::istream &source, shared_ptr<Options> options) : options(std::move(options)){
-    lexers.push_back(std::make_unique<Lexer>(source));
-    current_lexer = lexers.back().get();
-    next();
+  // the macro a token would name: an identifier's spelling, or a keyword's if it has been defined as a macro
+  [[nodiscard]] Symbol macro_name(const CToken &t) const {
+    return t.type == CTokenType::CIdentifier ? t.value : keywordMacros[static_cast<uint8_t>(t.type)];
   }
   
+  // whether the current token starts a directive: a directive token at the start of a line in a file
+  [[nodiscard]] bool at_directive() const;
+  
+  // Expands the macro named by name onto the pending tokens. Returns false if it is not to be expanded: it is
+  // undefined, hidden, or a function-like macro without arguments.
+  bool expand(const CToken &name, Symbol macroName);
+  
+  // Reads the arguments of an invocation of macro up to the closing parenthesis, which it returns
+  CToken read_arguments(const Macro &macro, ExpansionBuffers &buffers);
+  
+  // Fills buffers.result with the replacement list of macro, with its arguments substituted
+  void substitute(const Macro &macro, const CToken &name, ExpansionBuffers &buffers);
+  
+  // Appends the complete expansion of [first, last) to out, as if it were all there was to read
+  void expand_argument(const CToken *first, const CToken *last, std::vector<CToken> &out);
+  
+  CToken stringize(const CToken *first, const CToken *last, const CToken &hash);
+  
+  CToken paste(const CToken &lhs, const CToken &rhs);
+  
+  // Lexes text into directiveLine, for defining macros from strings
+  void lex_text(std::string_view text);
+  
+  // Defines the standard predefined macros
+  void predefine();
+  
+  // Reads the rest of a directive's line into directiveLine, and returns the token after it
+  CToken read_line();
+  
+  // Moves past a directive, to the token that followed its line
+  void end_directive(const CToken &lineEnd);
+  
+  NodeID parse_define(AST &ast);
+  
+  // Parses #if, #ifdef, #ifndef, #elif, #else or #endif, skipping whatever groups of the conditional are inactive
+  NodeID parse_conditional(AST &ast);
+  
+  // Skips an inactive group, of which first is the first token, and returns the directive that ends it
+  CToken skip_group(CToken first);
+  
+  // Evaluates the expression of an #if or #elif, which has been read into directiveLine
+  bool evaluate_condition();
+  
+  // Moves past a token of an expression, hashing it as parse() would, and parses any directives after it
+  void advance();
+  
+  // Moves past the current token, which has to be of the given type
+  void expect_in_expression(CTokenType type);
+  
+  // Parses an expression of operators whose left binding power is at least minimum, leaving its node as the
+  // last one added. Only nested parentheses, brackets, call arguments and ?: recurse, each one level deeper.
+  void parse_operators(AST &ast, uint8_t minimum, unsigned depth);
+  
+  // A primary expression and the postfix operators after it
+  void parse_postfix(AST &ast, unsigned depth);
+  
+  // Sets up the predefined state without reading any file, for IncrementalParser
+  explicit Parser(shared_ptr<Options> options);
+  
+public:
+  // Reads the whole stream before parsing it. Use this for stdin and pipes.
+  Parser(std::istream &source, shared_ptr<Options> options);
+  
+  // Maps the file at filename and parses it. Throws if the file cannot be read.
+  Parser(const std::string &filename, shared_ptr<Options> options);
+  
   unique_ptr<AST> parse();
   
-  unique_ptr<AST> parse_preprocessor();
+  // Turns the locations of tokens and nodes into files, lines and columns
+  [[nodiscard]] const SourceManager &source_manager() const { return sources; }
+  
+  // Has parse() add every token outside of directives, once macros are expanded, to hasher
+  void hash_tokens(TokenHasher *hasher) { tokenHasher = hasher; }
+  
+  // Runs only the preprocessor, writing the tokens it produces to out as source text, one line of output for
+  // each line they started on
+  void preprocess(std::ostream &out);
+  
+  // Parses the directive at the current token, adding its node to ast
+  NodeID parse_preprocessor(AST &ast);
+  
+  // How deeply parentheses, brackets, call arguments and the middles of ?: can nest in an expression. Operators
+  // do not count however many there are, so a generated expression of thousands of operands parses in constant
+  // stack space.
+  static constexpr unsigned max_expression_depth = 256;
+  
+  // Parses the expression at the current token, comma operators included, adding its nodes to ast. Directives
+  // within it are added after it. Throws on a syntax error, or nesting deeper than max_expression_depth. Casts,
+  // sizeof a type and compound literals need type names, which are not parsed yet.
+  NodeID parse_expression(AST &ast);
+  
+  // Enters the file named by the directive at the current token, unless it is redundant. Returns the name as written.
+  Symbol parse_include();
+  
+  // Resolves the interned include name against the include directories. Returns nullptr if not found.
+  const IncludeCache::Entry *find_include(Symbol name);
+  
+  // Throws if the file is already on the include stack
+  void check_for_circular_include(FileID id, const string &filename);
+  
+  // Whether including the file again would add nothing, as its guard is defined or it is marked #pragma once
+  [[nodiscard]] bool is_include_redundant(FileID id) const;
+  
+  [[nodiscard]] size_t skipped_includes() const { return skippedIncludes; }
+  
+  // What was counted while reading the files so far, including the files still being read. Phases and AST nodes
+  // are left for the caller to fill in.
+  [[nodiscard]] CompileStats statistics() const;
+  
+  // spellings of the symbols in the tokens and the tree
+  [[nodiscard]] const Interner &interner() const { return strings; }
   
-  void parse_include();
+  [[nodiscard]] const MacroTable &macro_table() const { return macros; }
   
-  std::string find_include(const std::string &filename);
+  // Writes the macros, include guards and strings known so far to a precompiled header at path
+  void emit_pch(const string &path);
   
-  void check_for_circular_include(const string &filename);
+  // Loads the state written by emit_pch. Only valid before any file has been read, so the constructors do this
+  // when options->include_pch is set. Throws if the file is invalid or any header it was built from has changed.
+  void include_pch(const string &path);
 };
 
 #endif //CLLVM_PARSER_H
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "interner.h"
+#include "token.h"
+
+#include <cstdint>
+
+// On-disk layout of a precompiled header. The file is a Header followed by sections of fixed size records, each
+// starting on an 8 byte boundary, so a mapped file is read in place without a parsing step. All integers are in
+// the byte order of the machine that wrote the file, and the compiler version check rejects files from others.
+namespace pch {
+
+inline constexpr char magic[8] = {'C', 'L', 'L', 'V', 'M', 'P', 'C', 'H'};
+
+// Bump whenever the layout or meaning of any record changes
+inline constexpr uint32_t format_version = 3;
+
+struct Section {
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  char compiler[32];
+
+  Section strings;    // StringEntry. The string for symbol i is entry i - 1, as the empty string is not stored.
+  Section stringData; // the characters of every string, with count in bytes
+  Section macros;     // MacroEntry of each defined macro
+  Section macroParams; // Symbol of each parameter of the macros, in the order of the macros
+  Section macroTokens; // TokenEntry of each replacement list, in the order of the macros
+  Section files;      // FileEntry of every file read to build the header
+  Section guards;     // GuardEntry
+  Section once;       // uint32_t index into files of each file marked #pragma once
+};
+
+struct StringEntry {
+  uint64_t offset;
+  uint64_t length;
+};
+
+// A file the header depends on. The header is out of date once the file's size or modification time changes.
+struct FileEntry {
+  Symbol path;
+  uint32_t reserved;
+  uint64_t size;
+  int64_t mtime;
+};
+
+struct MacroEntry {
+  Symbol name;
+  uint8_t functionLike;
+  uint8_t variadic;
+  uint8_t hasOperators;
+  uint8_t builtin;
+  uint32_t paramCount;
+  uint32_t tokenCount;
+};
+
+// A token of a replacement list. Its location is not kept, as expansion gives it the location of the invocation.
+struct TokenEntry {
+  CTokenType type;
+  uint8_t flags;
+  uint16_t reserved;
+  Symbol value;
+};
+
+struct GuardEntry {
+  uint32_t file;
+  Symbol macro;
+};
+
+} // namespace pch
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+// Vectorised scanning loops for the lexer's hot paths. Every kernel reads whole vectors at a time, so it may only
+// be used on a SourceBuffer, whose NUL sentinel and zero padding make reading past the current character safe.
+// Each kernel stops at the NUL sentinel. A NUL before the end of the buffer stops them too, so callers have to
+// check whether they stopped at the real end of the file.
+struct ScanKernels {
+  // Returns the first character at or after p that is not ' ', '\t', '\r' or '\n', and sets newline if a '\n'
+  // was skipped. Lines are not counted, as locations are turned into lines only when asked for.
+  const char *(*skip_whitespace)(const char *p, bool &newline);
+
+  // Returns the first '\n' or NUL at or after p, for skipping the body of a line comment
+  const char *(*find_line_end)(const char *p);
+
+  // Returns the '*' of the first "*/" at or after p, or the first NUL
+  const char *(*find_comment_end)(const char *p);
+
+  // Returns the first character at or after p that cannot continue an identifier
+  const char *(*skip_identifier)(const char *p);
+
+  // Returns the first character at or after p that is not a decimal digit
+  const char *(*skip_digits)(const char *p);
+
+  // Returns the first '\n', '/', '"', '\'', '\\' or NUL at or after p: the only characters that matter when
+  // skipping the text of an inactive conditional group
+  const char *(*find_inactive_stop)(const char *p);
+
+  // Returns the first '"', '\\', '\n' or NUL at or after p, for skipping the body of a string literal
+  const char *(*find_string_stop)(const char *p);
+
+  const char *name;
+};
+
+// The widest kernels this CPU supports, chosen the first time this is called
+const ScanKernels &scan_kernels();
+
+// Every set of kernels this CPU can run, narrowest first, starting with the portable scalar loops
+std::vector<const ScanKernels *> available_scan_kernels();
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+// A place in the source read by one compilation, in 32 bits. Each file is given a range of locations of its own
+// when it is first entered (see SourceManager::start_of), so a location is the start of its file's range plus a
+// byte offset into the file. The file, line and column are only worked out when something needs them, such as a
+// diagnostic. The default location is none at all, for tokens that were not read from a file.
+struct SourceLocation {
+  uint32_t raw = 0;
+
+  [[nodiscard]] bool valid() const { return raw != 0; }
+
+  // The location offset bytes further into the same file
+  [[nodiscard]] SourceLocation operator+(uint32_t offset) const { return {raw + offset}; }
+
+  bool operator==(SourceLocation other) const { return raw == other.raw; }
+  bool operator!=(SourceLocation other) const { return raw != other.raw; }
+};
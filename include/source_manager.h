@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "source_location.h"
+
+using std::unique_ptr, std::string;
+
+// Identifies a file by its device and inode, so a header reached through different paths (symlinks, "dir/../")
+// is recognised as the same file
+struct FileID {
+  uint64_t device = 0;
+  uint64_t inode = 0;
+
+  // Returns the identity of the file at path, or an invalid id if it does not exist or is a directory
+  static FileID of(const string &path);
+
+  // buffers read from streams have no identity
+  [[nodiscard]] bool valid() const { return device != 0 || inode != 0; }
+
+  bool operator==(const FileID &other) const { return device == other.device && inode == other.inode; }
+  bool operator!=(const FileID &other) const { return !(*this == other); }
+};
+
+template <>
+struct std::hash<FileID> {
+  size_t operator()(const FileID &id) const noexcept { return std::hash<uint64_t>()(id.inode * 31 + id.device); }
+};
+
+// A whole source file held in one contiguous block of memory. The contents are always followed by at least
+// `padding` zero bytes, so the lexer can walk a plain pointer and stop on the NUL sentinel instead of checking
+// for the end of a buffer on every character.
+class SourceBuffer {
+public:
+  static constexpr size_t padding = 64;
+
+  // Files smaller than this are read into the heap, as mapping them costs more than copying them
+  static constexpr size_t map_threshold = 16 * 1024;
+
+  // Loads the file at path, mapping it into memory if it is large enough. Returns nullptr if it cannot be read.
+  // Files that cannot be mapped (fifos, character devices) are read through the stream fallback.
+  static unique_ptr<SourceBuffer> from_file(const string &path);
+
+  // Reads everything left in the stream. This is the fallback for stdin and pipes.
+  static unique_ptr<SourceBuffer> from_stream(std::istream &stream, string filename = "");
+
+  // Copies text, such as the contents of an editor's buffer
+  static unique_ptr<SourceBuffer> from_text(std::string_view text, string filename = "");
+
+  // A copy of original with removed bytes at offset replaced by text, keeping its name and identity
+  static unique_ptr<SourceBuffer> from_edit(const SourceBuffer &original, size_t offset, size_t removed,
+                                            std::string_view text);
+
+  SourceBuffer(const SourceBuffer &) = delete;
+  SourceBuffer &operator=(const SourceBuffer &) = delete;
+  ~SourceBuffer();
+
+  [[nodiscard]] const char *begin() const { return data; }
+  [[nodiscard]] const char *end() const { return data + length; }
+  [[nodiscard]] size_t size() const { return length; }
+  [[nodiscard]] bool is_mapped() const { return mappedLength != 0; }
+
+  // Offset of the first character of every line, found with the vector kernels the first time it is needed.
+  // Builds the table in place, so a buffer shared between threads has to have it built before it is shared.
+  const std::vector<uint32_t> &line_starts() const;
+
+  string filename;
+
+  // the file this was loaded from, or an invalid id for stream input
+  FileID id;
+
+private:
+  SourceBuffer(string filename, char *data, size_t length, size_t mappedLength);
+
+  char *data;
+  size_t length;
+
+  // size of the mapping to release, or 0 if data was allocated with new[]
+  size_t mappedLength;
+
+  mutable std::vector<uint32_t> lineStarts;
+};
+
+// Where a SourceLocation is: the buffer, and the line and column in it, counting from 1. The column counts bytes.
+struct SourcePosition {
+  const SourceBuffer *buffer = nullptr;
+  unsigned int line = 0;
+  unsigned int column = 0;
+};
+
+// Owns every source buffer loaded during a compilation, so each file is read or mapped once no matter how many
+// times, or through how many different paths, it is included.
+class SourceManager {
+public:
+  // Returns the buffer for path, loading it on first use. Returns nullptr if the file cannot be read.
+  const SourceBuffer *open(const string &path);
+
+  // Same as above for a file whose identity is already known, which saves a stat()
+  const SourceBuffer *open(const string &path, FileID id);
+
+  // Takes ownership of a buffer that was not loaded from a path, such as stdin
+  const SourceBuffer *add(unique_ptr<SourceBuffer> buffer);
+
+  // The location of the first byte of buffer, giving the buffer the next range of locations the first time it is
+  // asked for. The range covers the end of the buffer too. Buffers that belong to something else, such as a
+  // shared header cache, can be given one as long as they outlive the manager. Throws once a compilation has read
+  // more source than locations can address.
+  SourceLocation start_of(const SourceBuffer &buffer);
+
+  // Hands the range of old, which is about to be freed, to edited, which replaces it. Locations in old keep
+  // their offsets, so they are only still right before whatever was edited. The range moves to the end of the
+  // location space if edited is too large for it, and the new start is returned.
+  SourceLocation replace(const SourceBuffer &old, const SourceBuffer &edited);
+
+  // Works out where a location is, or returns an empty position for one that is not valid
+  [[nodiscard]] SourcePosition position(SourceLocation location) const;
+
+private:
+  std::unordered_map<FileID, unique_ptr<SourceBuffer>> buffers;
+  std::vector<unique_ptr<SourceBuffer>> anonymous;
+
+  // the buffers given locations, in the order their ranges start. A buffer that was replaced may have several.
+  struct Range {
+    uint32_t start;
+    const SourceBuffer *buffer;
+  };
+  std::vector<Range> ranges;
+  std::unordered_map<const SourceBuffer *, uint32_t> starts;
+
+  // location 0 is none
+  uint32_t nextStart = 1;
+};
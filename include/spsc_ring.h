@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// A bounded queue between exactly one producer thread and one consumer thread, with no locks. Each side owns one
+// index and only reads the other's when its cached copy says the ring looks full or empty, so in the steady state
+// neither side touches the other's cache line.
+template <typename T, size_t Capacity>
+class SPSCRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+  // Producer only. Returns false if the ring is full.
+  bool try_push(const T &value) {
+    size_t tail = tailIndex.load(std::memory_order_relaxed);
+    if (tail - cachedHead == Capacity) {
+      cachedHead = headIndex.load(std::memory_order_acquire);
+      if (tail - cachedHead == Capacity) {
+        return false;
+      }
+    }
+    slots[tail & (Capacity - 1)] = value;
+    tailIndex.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false if the ring is empty.
+  bool try_pop(T &value) {
+    size_t head = headIndex.load(std::memory_order_relaxed);
+    if (head == cachedTail) {
+      cachedTail = tailIndex.load(std::memory_order_acquire);
+      if (head == cachedTail) {
+        return false;
+      }
+    }
+    value = slots[head & (Capacity - 1)];
+    headIndex.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  // written by the consumer, and the producer's last look at it
+  alignas(64) std::atomic<size_t> headIndex = 0;
+  alignas(64) size_t cachedHead = 0;
+
+  // written by the producer, and the consumer's last look at it
+  alignas(64) std::atomic<size_t> tailIndex = 0;
+  alignas(64) size_t cachedTail = 0;
+
+  alignas(64) T slots[Capacity];
+};
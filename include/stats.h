@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+// Hardware counters of the calling thread, read through perf_event_open. Unavailable where the kernel does not
+// allow it, such as in a container or with kernel.perf_event_paranoid set too high.
+class PerfCounters {
+public:
+  struct Values {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheMisses = 0;
+  };
+
+  PerfCounters();
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  [[nodiscard]] bool available() const { return group >= 0; }
+
+  // The counts so far, or zeros if unavailable
+  [[nodiscard]] Values read() const;
+
+private:
+  // the cycles counter leads the group, so all three are read at once
+  int group = -1;
+  int members[2] = {-1, -1};
+};
+
+// Counters gathered while compiling one translation unit, printed with --stats
+struct CompileStats {
+  struct File {
+    string path;
+
+    // times the file was entered, the bytes lexed from it, and the tokens read from it altogether. A file that
+    // is replayed from a token buffer is only lexed once.
+    uint64_t entered = 0;
+    uint64_t bytes = 0;
+    uint64_t tokens = 0;
+  };
+
+  // in the order they were first entered
+  std::vector<File> files;
+
+  std::array<uint64_t, 256> tokensByType{};
+
+  // files entered at each include depth, the main file being at depth 0
+  std::vector<uint64_t> includeDepths;
+
+  // candidate paths tried while resolving includes, and those with no file
+  uint64_t includeLookups = 0;
+  uint64_t failedLookups = 0;
+
+  uint64_t astNodes = 0;
+
+  struct Phase {
+    const char *name;
+    double wallMs = 0;
+    double cpuMs = 0;
+    bool counted = false;
+    PerfCounters::Values counters;
+  };
+  std::vector<Phase> phases;
+
+  void print(std::ostream &out, const string &input) const;
+};
+
+// Adds the wall and CPU time of the rest of the enclosing scope, and the hardware counters if available, to
+// stats as a phase. Does nothing if stats is null. Only the calling thread is measured, so lexing on the pipeline
+// thread is not.
+class PhaseTimer {
+public:
+  PhaseTimer(CompileStats *stats, const PerfCounters *counters, const char *name);
+  ~PhaseTimer();
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+  CompileStats *stats;
+  const PerfCounters *counters;
+  const char *name;
+  std::chrono::steady_clock::time_point wallStart;
+  double cpuStart = 0;
+  PerfCounters::Values countersStart;
+};
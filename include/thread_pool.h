@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::unique_ptr;
+
+// A fixed set of worker threads, each with its own queue of tasks. Tasks submitted from outside the pool are
+// spread over the queues and run in the order they were submitted, so the first inputs are compiled first.
+// Tasks a worker submits itself go on its own queue and it runs the newest of them first, as they belong to the
+// task it is working on. Once its queue is empty a worker steals the oldest task of another's, so a worker
+// stuck on one long compilation does not hold up the tasks queued behind it. Tasks must not throw.
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned int threads);
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Waits for every task, then stops the workers
+  ~ThreadPool();
+
+  // Queues a task. Tasks submitted from a worker go on that worker's own queue.
+  void submit(std::function<void()> task);
+
+  // Blocks until every task submitted so far, and every task they submitted, has finished
+  void wait();
+
+  [[nodiscard]] size_t size() const { return threads.size(); }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    // submitted from outside the pool, and by the queue's own worker
+    std::deque<std::function<void()>> submitted;
+    std::deque<std::function<void()>> nested;
+  };
+
+  std::vector<unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+
+  // guards the counts below, and is what idle workers and wait() sleep on
+  std::mutex mutex;
+  std::condition_variable available;
+  std::condition_variable finished;
+
+  // tasks sitting in a queue, and tasks submitted but not finished
+  size_t queued = 0;
+  size_t pending = 0;
+  bool stopping = false;
+
+  // queue for the next task submitted from outside the pool, so they are spread round robin
+  size_t nextQueue = 0;
+
+  bool take(size_t self, std::function<void()> &task);
+
+  void run(size_t self);
+};
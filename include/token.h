@@ -1,12 +1,17 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <map>
+#include <interner.h>
+#include <source_location.h>
 
 using std::unique_ptr, std::string, std::map;
 
-enum class CTokenType {
+// Stored in a single byte so token buffers can keep types in a dense array
+enum class CTokenType : uint8_t {
   CKeywordAuto,
   CKeywordBreak,
   CKeywordCase,
@@ -59,6 +64,7 @@ enum class CTokenType {
   CPreprocessorElif,         // #elif
   CPreprocessorElse,         // #else
   CPreprocessorEndif,        // #endif
+  CPreprocessorHash,         // # not followed by a known directive name: stringizing, or an unknown directive
   CPreprocessorHashHash,     // ##
   
   CConstantInteger,
@@ -117,22 +123,50 @@ enum class CTokenType {
   
   CEndOfFile,
   CUnknown,
+  
+  // A use of a parameter in a macro's replacement list, with the parameter's index as its value. Never produced
+  // by the lexer.
+  CMacroParameter,
 };
 
+// The spelling of a token type that always has the same spelling, such as a keyword or operator. Empty for
+// identifiers, constants, end of file and unknown tokens.
+std::string_view fixed_spelling(CTokenType type);
+
 class CToken {
 private:
   
 public:
-  CTokenType type;
+  CTokenType type = CTokenType::CUnknown;
+  
+  // What came before the token in the source, which the preprocessor needs to find directives, tell function-like
+  // macro definitions from object-like ones and spell stringized arguments
+  static constexpr uint8_t start_of_line = 1;  // the first token on its line
+  static constexpr uint8_t leading_space = 2;  // preceded by whitespace or a comment
+  
+  // A string or char constant with a backslash in its spelling, which has to be decoded rather than copied
+  static constexpr uint8_t has_escapes = 4;
+  uint8_t flags = 0;
   
-  // All associated values are strings to avoid having to deal with the different integer sizes at this stage of compilation
-  unique_ptr<string> value;
-  unsigned int line;
-  unsigned int col;
+  // Hide set of a token produced by macro expansion (see HideSets), or 0 for a token read from a file
+  uint32_t hideset = 0;
   
-  CToken(CTokenType type, const char *value, unsigned int line, unsigned int col);
+  // Interned spelling of identifiers and constants, or Interner::none for tokens whose spelling is fixed by their
+  // type. String and char constants are spelled as in the source, quotes and escapes included (see literal.h),
+  // and numeric constants are decoded when interned (see Interner::number).
+  Symbol value = Interner::none;
+  
+  // Where the token starts, which for a token from a macro expansion is where the macro was invoked. The line
+  // and column are worked out from it by the SourceManager the file was read through.
+  SourceLocation location;
+  
+  CToken() = default;
+  
+  CToken(CTokenType type, Symbol value, SourceLocation location = {});
   
   [[nodiscard]] string getTypeAsString() const;
   
-  string toString() const;
+  [[nodiscard]] std::string_view getSpelling(const Interner &strings) const;
+  
+  [[nodiscard]] string toString(const Interner &strings) const;
 };
\ No newline at end of file
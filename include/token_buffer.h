@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <interner.h>
+#include <source_manager.h>
+#include <token.h>
+
+// Every token of one file, lexed ahead of time and stored as parallel arrays: a one byte type, its one byte flags,
+// the offset of the token in the file and its interned payload. That is 10 bytes a token with no allocation per
+// token, and the buffer for a header can be kept and replayed each time the header is included.
+class TokenBuffer {
+public:
+  explicit TokenBuffer(const SourceBuffer &source);
+
+  // Lexes the whole of source, ending with the end of file token
+  static unique_ptr<TokenBuffer> lex(const SourceBuffer &source, Interner &strings);
+
+  // A copy whose payloads are symbols of `to` rather than of `from`, the interner the tokens were lexed with.
+  // The strings are not copied, so from must outlive to.
+  [[nodiscard]] unique_ptr<TokenBuffer> reinterned(const Interner &from, Interner &to) const;
+
+  // The tokens relex() replaced: the old [first, first + removed) became [first, first + inserted)
+  struct Damage {
+    size_t first = 0;
+    size_t removed = 0;
+    size_t inserted = 0;
+    
+    // a token that could start a directive was among them, old or new
+    bool directives = false;
+  };
+
+  // Brings the tokens up to date with edited, the old source with `removed` bytes at offset replaced by `inserted`
+  // new ones, and makes edited the source. Lexing starts a little before the edit and stops at the first token
+  // past it that starts where an old token did and with the same flags, as everything after that is unchanged.
+  Damage relex(const SourceBuffer &edited, uint32_t offset, uint32_t removed, uint32_t inserted, Interner &strings);
+
+  void push_back(CTokenType type, uint8_t flags, uint32_t offset, Symbol payload) {
+    types.push_back(type);
+    tokenFlags.push_back(flags);
+    offsets.push_back(offset);
+    payloads.push_back(payload);
+  }
+
+  [[nodiscard]] size_t size() const { return types.size(); }
+  [[nodiscard]] CTokenType type(size_t i) const { return types[i]; }
+  [[nodiscard]] uint8_t flags(size_t i) const { return tokenFlags[i]; }
+  [[nodiscard]] uint32_t offset(size_t i) const { return offsets[i]; }
+  [[nodiscard]] Symbol payload(size_t i) const { return payloads[i]; }
+
+  // Whether the token is a directive name at the start of a line, as written in the file
+  [[nodiscard]] bool is_directive(size_t i) const {
+    return (tokenFlags[i] & CToken::start_of_line) && types[i] >= CTokenType::CPreprocessorInclude &&
+           types[i] <= CTokenType::CPreprocessorHash;
+  }
+
+  [[nodiscard]] const SourceBuffer &source() const { return *sourceBuffer; }
+
+  // Bytes held by the token arrays
+  [[nodiscard]] size_t memory_usage() const;
+
+private:
+  const SourceBuffer *sourceBuffer;
+
+  std::vector<CTokenType> types;
+  std::vector<uint8_t> tokenFlags;
+  std::vector<uint32_t> offsets;
+  std::vector<Symbol> payloads;
+};
+
+// Reads the tokens of a buffer back in order, located from start, the location of the first byte of the buffer's
+// source (see SourceManager::start_of). A token's location is start plus its offset, so replaying a buffer costs
+// no more per token than copying it out.
+class TokenReader {
+public:
+  explicit TokenReader(const TokenBuffer &buffer, SourceLocation start = {});
+
+  CToken next();
+
+  // Index of the token next() returns next
+  [[nodiscard]] size_t position() const { return index; }
+
+  // Makes the token at index the next one returned
+  void seek(size_t index);
+
+  // Moves past the rest of an inactive conditional group, like Lexer::skip_inactive, and returns the token that
+  // ends it. The group has already been lexed, so this only walks the token types.
+  CToken skip_inactive();
+
+private:
+  const TokenBuffer *buffer;
+  SourceLocation start;
+  size_t index = 0;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "interner.h"
+#include "lexer.h"
+#include "source_manager.h"
+#include "spsc_ring.h"
+#include "token.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Lexes on a separate thread, ahead of the parser, through a lock-free ring of tokens.
+//
+// Includes are resolved by the parser, so the producer cannot know on its own which file comes after an
+// #include. It passes on the #include and its operand (a string, or everything up to the closing '>') and then
+// waits until the parser answers with enter() or resume(). Each file entered ends with its own end of file
+// token, in-band, so the parser sees the same sequence of tokens as with one lexer per include frame.
+//
+// The parser may look up the strings of tokens it has received. Both threads intern while the producer runs, the
+// producer the spellings it lexes and the parser those the preprocessor makes up, such as pasted and stringized
+// tokens, so the interner is shared (see Interner::set_shared) from the start of the pipe to its end.
+class TokenPipe {
+public:
+  // Tokens of each file are located from the start the parser gave it (see SourceManager::start_of)
+  TokenPipe(const SourceBuffer &main, SourceLocation start, Interner &strings);
+
+  TokenPipe(const TokenPipe &) = delete;
+  TokenPipe &operator=(const TokenPipe &) = delete;
+
+  // Stops the producer, even if the parser gave up partway through
+  ~TokenPipe();
+
+  // Blocks until the next token is ready. Keeps returning the end of file once the main file has ended.
+  CToken next();
+
+  // Moves past the rest of an inactive conditional group and returns the token that ends it. The producer cannot
+  // tell which groups are inactive, so it lexes them anyway and their tokens are dropped here. Includes in them
+  // are answered with resume().
+  CToken skip_inactive();
+
+  // Answers the include the producer is waiting on: lex buffer, then carry on after the include
+  void enter(const SourceBuffer &buffer, SourceLocation start);
+
+  // Answers the include the producer is waiting on: carry on after it without entering anything
+  void resume();
+
+private:
+  enum class Command : uint8_t { None, Enter, Resume, Stop };
+
+  static constexpr size_t capacity = 4096;
+
+  SPSCRing<CToken, capacity> ring;
+
+  std::atomic<Command> command = Command::None;
+
+  // the buffer to enter and its start, published by the release store of command
+  const SourceBuffer *enterBuffer = nullptr;
+  SourceLocation enterStart;
+
+  std::atomic<bool> stopping = false;
+  std::atomic<bool> finished = false;
+
+  Interner &strings;
+  std::thread producer;
+
+  // Tracks, on the parser's side, the operand of an #include read through next(), mirroring the producer, so the
+  // pipe knows when the producer is waiting without the parser having to say
+  enum class Operand : uint8_t { None, Expected, Angled };
+  Operand operand = Operand::None;
+  bool answerDue = false;
+
+  void produce(const SourceBuffer *main, SourceLocation start);
+
+  // Waits for room in the ring. Returns false if the pipe is being stopped.
+  bool push(const CToken &token);
+
+  Command wait_for_command();
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+
+// Structured tracing of where compile time goes. Each thread records completed spans into a ring buffer of its
+// own, without locking or allocating, and once compilation is over everything recorded is written out as Chrome
+// trace JSON for chrome://tracing or Perfetto. Configuring with -DCLLVM_TRACING=OFF compiles every span to nothing.
+#ifndef CLLVM_TRACING
+#define CLLVM_TRACING 1
+#endif
+
+namespace trace {
+
+// Spans recorded by one thread past this many overwrite its oldest ones
+inline constexpr size_t ring_capacity = 1 << 16;
+
+// One completed span. Names are string literals; details are copied, keeping the end if they are too long, which
+// for a path is the file name.
+struct Event {
+  const char *name;
+  uint64_t start;     // nanoseconds since start()
+  uint64_t duration;  // nanoseconds
+  char detail[48];
+};
+
+namespace detail {
+extern std::atomic<bool> recording;
+}
+
+[[nodiscard]] inline bool enabled() {
+  return detail::recording.load(std::memory_order_relaxed);
+}
+
+// Nanoseconds since start()
+uint64_t now();
+
+// Appends a span to the calling thread's ring buffer
+void record(const char *name, std::string_view detail, uint64_t start, uint64_t end);
+
+// Starts recording on every thread, discarding whatever was recorded before, and starts LLVM's time profiler for
+// the calling thread so the passes LLVM runs can be traced too
+void start();
+
+// Stops recording and writes every span recorded on every thread, and every LLVM pass traced, as Chrome trace
+// JSON. Only call once the threads that recorded have finished or are idle.
+void write_chrome_json(std::ostream &out);
+
+// Traces LLVM's passes on the calling thread until destroyed, if tracing is on and the thread is not traced yet
+class LLVMPassScope {
+public:
+  LLVMPassScope();
+  ~LLVMPassScope();
+
+  LLVMPassScope(const LLVMPassScope &) = delete;
+  LLVMPassScope &operator=(const LLVMPassScope &) = delete;
+
+private:
+  bool started = false;
+};
+
+#if CLLVM_TRACING
+
+// Records the time from its construction to its destruction, if tracing was on when it was constructed. Movable,
+// so one can live as long as an object that is moved around, such as an include frame.
+class Span {
+public:
+  Span() = default;
+
+  explicit Span(const char *name, std::string_view detail = {}) {
+    if (enabled()) {
+      begin(name, detail);
+    }
+  }
+
+  Span(Span &&other) noexcept : name(other.name), start(other.start), length(other.length) {
+    std::memcpy(detail, other.detail, length);
+    other.name = nullptr;
+  }
+
+  // Ends the span being replaced, if any
+  Span &operator=(Span &&other) noexcept {
+    end();
+    name = other.name;
+    start = other.start;
+    length = other.length;
+    std::memcpy(detail, other.detail, length);
+    other.name = nullptr;
+    return *this;
+  }
+
+  ~Span() { end(); }
+
+private:
+  const char *name = nullptr;
+  uint64_t start = 0;
+  uint8_t length = 0;
+  char detail[sizeof(Event::detail)];
+
+  void begin(const char *spanName, std::string_view spanDetail);
+
+  void end() {
+    if (name) {
+      record(name, std::string_view(detail, length), start, now());
+      name = nullptr;
+    }
+  }
+};
+
+#define CLLVM_TRACE_CONCAT_(a, b) a##b
+#define CLLVM_TRACE_CONCAT(a, b) CLLVM_TRACE_CONCAT_(a, b)
+
+// Traces the rest of the enclosing scope as a span. detail is only evaluated when tracing is on.
+#define TRACE_SCOPE(name, detail)                                                                                  \
+  trace::Span CLLVM_TRACE_CONCAT(traceSpan, __LINE__) =                                                            \
+      trace::enabled() ? trace::Span(name, detail) : trace::Span()
+
+#else
+
+class Span {
+public:
+  Span() = default;
+  explicit Span(const char *, std::string_view = {}) {}
+};
+
+#define TRACE_SCOPE(name, detail) static_cast<void>(0)
+
+#endif
+
+} // namespace trace
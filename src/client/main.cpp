@@ -0,0 +1,17 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "compile_server.h"
+
+// Takes the same options as CLLVM, and has the compile server named by CLLVM_SERVER do the compiling
+int main(int argc, char **argv) {
+  const char *socketPath = std::getenv("CLLVM_SERVER");
+  if (!socketPath || !*socketPath) {
+    std::cerr << "error: CLLVM_SERVER is not set to the socket of a compile server (see CLLVM --serve)" << std::endl;
+    return 1;
+  }
+  
+  int status = run_client(socketPath, std::vector<string>(argv + 1, argv + argc), std::cout, std::cerr);
+  std::cout.flush();
+  return status;
+}
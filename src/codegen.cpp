@@ -0,0 +1,193 @@
+#include "codegen.h"
+#include "trace.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+CodeGen::CodeGen(const string &moduleName, shared_ptr<Options> options)
+    : options(std::move(options)), llvmModule(std::make_unique<llvm::Module>(moduleName, context)) {}
+
+void CodeGen::initialize_targets() {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+}
+
+string CodeGen::target_triple() {
+  return llvm::sys::getDefaultTargetTriple();
+}
+
+// A target machine for the host. Each thread running the backend needs one of its own.
+static unique_ptr<llvm::TargetMachine> host_machine() {
+  string triple = CodeGen::target_triple();
+  string error;
+  const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    throw std::runtime_error("No target for " + triple + ": " + error);
+  }
+  return unique_ptr<llvm::TargetMachine>(
+      target->createTargetMachine(triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_));
+}
+
+static void emit(llvm::Module &module, llvm::TargetMachine &machine, llvm::raw_pwrite_stream &out) {
+  llvm::legacy::PassManager passes;
+  if (machine.addPassesToEmitFile(passes, out, nullptr, llvm::CGFT_ObjectFile)) {
+    throw std::runtime_error("The target cannot emit object files");
+  }
+  trace::LLVMPassScope tracePasses;
+  passes.run(module);
+}
+
+void link_relocatable(const std::vector<string> &parts, const string &path) {
+  auto linker = llvm::sys::findProgramByName("ld");
+  if (!linker) {
+    throw std::runtime_error("Could not find ld to link the partitions of " + path);
+  }
+  std::vector<llvm::StringRef> args = {*linker, "-r", "-o", path};
+  args.insert(args.end(), parts.begin(), parts.end());
+  
+  string error;
+  int status = llvm::sys::ExecuteAndWait(*linker, args, llvm::None, {}, 0, 0, &error);
+  if (status != 0) {
+    throw std::runtime_error("Could not link the partitions of " + path + (error.empty() ? "" : ": " + error));
+  }
+}
+
+void CodeGen::emit_object(const string &path) {
+  TRACE_SCOPE("CodeGen", path);
+  unique_ptr<llvm::TargetMachine> machine = host_machine();
+  llvmModule->setTargetTriple(target_triple());
+  llvmModule->setDataLayout(machine->createDataLayout());
+
+  if (options->lto != Options::LTOMode::None) {
+    emit_bitcode(path);
+    return;
+  }
+  if (options->codegen_threads > 1) {
+    emit_split(path);
+    return;
+  }
+
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+  if (ec) {
+    throw std::runtime_error("Could not open " + path + ": " + ec.message());
+  }
+  emit(*llvmModule, *machine, out);
+  out.flush();
+}
+
+void CodeGen::emit_bitcode(const string &path) {
+  // a summary goes with either kind, but regular LTO modules are told apart by the flag, as with clang
+  if (options->lto == Options::LTOMode::Full) {
+    llvmModule->addModuleFlag(llvm::Module::Error, "ThinLTO", uint32_t(0));
+  }
+  llvm::ProfileSummaryInfo profile(*llvmModule);
+  llvm::ModuleSummaryIndex index = llvm::buildModuleSummaryIndex(*llvmModule, nullptr, &profile);
+
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+  if (ec) {
+    throw std::runtime_error("Could not open " + path + ": " + ec.message());
+  }
+  llvm::WriteBitcodeToFile(*llvmModule, out, false, &index);
+  out.flush();
+}
+
+void CodeGen::emit_split(const string &path) {
+  // The partitions are cloned into this module's context, which only one thread may use at a time, so each is
+  // handed to its thread as bitcode to be read into a context of the thread's own
+  std::vector<llvm::SmallVector<char, 0>> bitcode;
+  // a partition without a function definition would only cost a thread and an empty object
+  unsigned int definitions = 0;
+  for (const llvm::Function &function : *llvmModule) {
+    definitions += !function.isDeclaration();
+  }
+  unsigned int partitions = std::max(1u, std::min(options->codegen_threads, definitions));
+  llvm::SplitModule(*llvmModule, partitions, [&](unique_ptr<llvm::Module> partition) {
+    bitcode.emplace_back();
+    llvm::raw_svector_ostream stream(bitcode.back());
+    llvm::WriteBitcodeToFile(*partition, stream);
+  });
+
+  std::vector<string> parts(bitcode.size());
+  std::vector<std::exception_ptr> errors(bitcode.size());
+  std::vector<std::thread> threads;
+  std::exception_ptr error;
+  try {
+    for (size_t i = 0; i < bitcode.size(); i++) {
+      threads.emplace_back([&, i] {
+        try {
+          TRACE_SCOPE("CodeGenPartition", path);
+          llvm::LLVMContext partitionContext;
+          llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode[i].data(), bitcode[i].size()), "partition");
+          auto partition = llvm::parseBitcodeFile(buffer, partitionContext);
+          if (!partition) {
+            throw std::runtime_error("Could not read back a partition of " + path + ": " +
+                                     llvm::toString(partition.takeError()));
+          }
+
+          int fd = -1;
+          llvm::SmallString<128> partPath;
+          if (std::error_code ec = llvm::sys::fs::createTemporaryFile("cllvm-partition", "o", fd, partPath)) {
+            throw std::runtime_error("Could not create a partition of " + path + ": " + ec.message());
+          }
+          parts[i] = string(partPath.str());
+          llvm::raw_fd_ostream out(fd, true);
+          unique_ptr<llvm::TargetMachine> machine = host_machine();
+          emit(**partition, *machine, out);
+          out.flush();
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+  } catch (...) {
+    // the threads already started still have to be joined, and their partitions removed
+    error = std::current_exception();
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (const std::exception_ptr &partError : errors) {
+    if (partError && !error) {
+      error = partError;
+    }
+  }
+  if (!error) {
+    try {
+      link_relocatable(parts, path);
+    } catch (...) {
+      error = std::current_exception();
+    }
+  }
+  for (const string &part : parts) {
+    if (!part.empty()) {
+      llvm::sys::fs::remove(part);
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
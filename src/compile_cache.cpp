@@ -0,0 +1,160 @@
+#include "compile_cache.h"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/MD5.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+TokenHasher::TokenHasher(bool lines) : md5(std::make_unique<llvm::MD5>()), lines(lines) {}
+
+TokenHasher::~TokenHasher() = default;
+
+void TokenHasher::flush() {
+  md5->update(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(buffer), used));
+  used = 0;
+}
+
+void TokenHasher::add(const CToken &token, const Interner &strings, const SourceManager &sources) {
+  std::string_view spelling = strings.get(token.value);
+  auto length = static_cast<uint32_t>(spelling.size());
+  size_t lineSize = lines ? sizeof(uint32_t) : 0;
+  if (used + 1 + sizeof(length) + spelling.size() + lineSize > sizeof(buffer)) {
+    flush();
+  }
+
+  // the type, then the length and text of the spelling, so no two different streams hash the same bytes
+  buffer[used++] = static_cast<char>(token.type);
+  std::memcpy(buffer + used, &length, sizeof(length));
+  used += sizeof(length);
+  if (spelling.size() + lineSize > sizeof(buffer) - used) {
+    flush();
+    md5->update(llvm::StringRef(spelling.data(), spelling.size()));
+  } else {
+    std::memcpy(buffer + used, spelling.data(), spelling.size());
+    used += spelling.size();
+  }
+  if (lines) {
+    auto line = static_cast<uint32_t>(sources.position(token.location).line);
+    std::memcpy(buffer + used, &line, sizeof(line));
+    used += sizeof(line);
+  }
+}
+
+string TokenHasher::finish(std::string_view extra) {
+  flush();
+  md5->update(llvm::StringRef(extra.data(), extra.size()));
+  llvm::MD5::MD5Result result;
+  md5->final(result);
+  return string(result.digest().str());
+}
+
+CompileCache &CompileCache::at(const string &directory) {
+  static std::mutex mutex;
+  static std::unordered_map<string, unique_ptr<CompileCache>> caches;
+  std::lock_guard lock(mutex);
+  auto &cache = caches[directory];
+  if (!cache) {
+    cache = std::make_unique<CompileCache>(directory);
+  }
+  return *cache;
+}
+
+CompileCache::CompileCache(string directory) : directory(std::move(directory)) {}
+
+string CompileCache::object_path(const string &key) const {
+  return directory + "/" + key.substr(0, 2) + "/" + key.substr(2) + ".o";
+}
+
+bool CompileCache::fetch(const string &key, const string &path) {
+  string object = object_path(key);
+  std::error_code ec;
+  fs::copy_file(object, path, fs::copy_options::overwrite_existing, ec);
+  if (ec) {
+    return false;
+  }
+  fs::last_write_time(object, fs::file_time_type::clock::now(), ec);
+  return true;
+}
+
+void CompileCache::store(const string &key, const string &path, uint64_t maxBytes) {
+  string object = object_path(key);
+  std::error_code ec;
+  fs::create_directories(fs::path(object).parent_path(), ec);
+
+  // copied under a name of its own and renamed into place, so no other compilation sees half an object
+  static std::atomic<uint64_t> stores = 0;
+  string temporary = object + ".tmp." + std::to_string(getpid()) + "." + std::to_string(stores++);
+  fs::copy_file(path, temporary, fs::copy_options::overwrite_existing, ec);
+  uint64_t size = ec ? 0 : fs::file_size(temporary, ec);
+  if (ec) {
+    fs::remove(temporary, ec);
+    return;
+  }
+  fs::rename(temporary, object, ec);
+  if (ec) {
+    fs::remove(temporary, ec);
+    return;
+  }
+
+  std::lock_guard lock(mutex);
+  if (!counted) {
+    // counting includes the object just stored
+    evict(maxBytes);
+    return;
+  }
+  total += size;
+  if (total > maxBytes) {
+    evict(maxBytes);
+  }
+}
+
+void CompileCache::evict(uint64_t maxBytes) {
+  struct Object {
+    fs::path path;
+    fs::file_time_type used;
+    uint64_t size;
+  };
+  std::vector<Object> objects;
+  total = 0;
+
+  std::error_code ec;
+  for (auto it = fs::recursive_directory_iterator(directory, ec); !ec && it != fs::recursive_directory_iterator();
+       it.increment(ec)) {
+    // an object removed by another process meanwhile is skipped
+    std::error_code gone;
+    if (!it->is_regular_file(gone) || it->path().extension() != ".o") {
+      continue;
+    }
+    Object object{it->path(), it->last_write_time(gone), it->file_size(gone)};
+    if (!gone) {
+      total += object.size;
+      objects.push_back(std::move(object));
+    }
+  }
+  counted = true;
+  if (total <= maxBytes) {
+    return;
+  }
+
+  // leave room to grow, so the next few stores do not each have to go through the directory again
+  uint64_t target = maxBytes / 10 * 9;
+  std::sort(objects.begin(), objects.end(), [](const Object &a, const Object &b) { return a.used < b.used; });
+  for (const Object &object : objects) {
+    if (total <= target) {
+      break;
+    }
+    if (fs::remove(object.path, ec)) {
+      total -= object.size;
+    }
+  }
+}
@@ -0,0 +1,137 @@
+#include "compile_server.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static bool write_all(int fd, const void *data, size_t size) {
+  const char *at = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = send(fd, at, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    at += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static bool read_all(int fd, void *data, size_t size) {
+  char *at = static_cast<char *>(data);
+  while (size > 0) {
+    ssize_t n = recv(fd, at, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    at += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static bool write_u32(int fd, uint32_t value) {
+  return write_all(fd, &value, sizeof(value));
+}
+
+static bool read_u32(int fd, uint32_t &value) {
+  return read_all(fd, &value, sizeof(value));
+}
+
+static bool write_string(int fd, const string &str) {
+  return write_u32(fd, static_cast<uint32_t>(str.size())) && write_all(fd, str.data(), str.size());
+}
+
+static bool read_string(int fd, string &str, uint32_t maxSize = UINT32_MAX) {
+  uint32_t size = 0;
+  if (!read_u32(fd, size) || size > maxSize) {
+    return false;
+  }
+  str.resize(size);
+  return read_all(fd, str.data(), size);
+}
+
+bool send_request(int fd, const CompileRequest &request) {
+  if (!write_u32(fd, static_cast<uint32_t>(request.args.size())) || !write_string(fd, request.directory)) {
+    return false;
+  }
+  for (const string &arg : request.args) {
+    if (!write_string(fd, arg)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool receive_request(int fd, CompileRequest &request) {
+  uint32_t count = 0;
+  if (!read_u32(fd, count) || count > max_request_args || !read_string(fd, request.directory, max_request_string)) {
+    return false;
+  }
+  request.args.resize(count);
+  for (string &arg : request.args) {
+    if (!read_string(fd, arg, max_request_string)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool send_response(int fd, const CompileResponse &response) {
+  return write_u32(fd, static_cast<uint32_t>(response.status)) && write_string(fd, response.out) &&
+         write_string(fd, response.err);
+}
+
+bool receive_response(int fd, CompileResponse &response) {
+  uint32_t status = 0;
+  if (!read_u32(fd, status) || !read_string(fd, response.out) || !read_string(fd, response.err)) {
+    return false;
+  }
+  response.status = static_cast<int>(status);
+  return true;
+}
+
+int run_client(const string &socketPath, const std::vector<string> &args, std::ostream &out, std::ostream &err) {
+  sockaddr_un address{};
+  if (socketPath.size() >= sizeof(address.sun_path)) {
+    err << "error: Socket path too long: " << socketPath << "\n";
+    return 1;
+  }
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+    err << "error: Could not connect to the compile server at " << socketPath << ": " << std::strerror(errno)
+        << "\n";
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 1;
+  }
+
+  std::error_code ec;
+  CompileRequest request{std::filesystem::current_path(ec).string(), args};
+  CompileResponse response;
+  bool answered = send_request(fd, request) && receive_response(fd, response);
+  close(fd);
+  if (!answered) {
+    err << "error: The compile server at " << socketPath << " closed the connection\n";
+    return 1;
+  }
+
+  out << response.out;
+  err << response.err;
+  return response.status;
+}
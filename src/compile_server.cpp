@@ -0,0 +1,182 @@
+#include "compile_server.h"
+#include "codegen.h"
+#include "driver.h"
+#include "header_cache.h"
+#include "include_cache.h"
+#include "options.h"
+#include "trace.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static sockaddr_un socket_address(const string &path) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + path);
+  }
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+CompileServer::CompileServer(string path) : socketPath(std::move(path)) {
+  sockaddr_un address = socket_address(socketPath);
+  auto *generic = reinterpret_cast<sockaddr *>(&address);
+
+  // a socket nobody answers on was left by a server that did not get to remove it
+  struct stat st{};
+  if (lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool running = probe >= 0 && connect(probe, generic, sizeof(address)) == 0;
+    if (probe >= 0) {
+      close(probe);
+    }
+    if (running) {
+      throw std::runtime_error("A compile server is already running at " + socketPath);
+    }
+    unlink(socketPath.c_str());
+  }
+
+  listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0 || bind(listener, generic, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+    string error = std::strerror(errno);
+    if (listener >= 0) {
+      close(listener);
+    }
+    throw std::runtime_error("Could not listen on " + socketPath + ": " + error);
+  }
+
+  CodeGen::initialize_targets();
+}
+
+CompileServer::~CompileServer() {
+  close(listener);
+  unlink(socketPath.c_str());
+}
+
+void CompileServer::run() {
+  while (!stopping) {
+    int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      // stop() shuts the listener down, which is how accept() is woken
+      break;
+    }
+
+    {
+      std::lock_guard lock(mutex);
+      active++;
+    }
+    std::thread([this, connection] {
+      answer(connection);
+      close(connection);
+      std::lock_guard lock(mutex);
+      if (--active == 0) {
+        idle.notify_all();
+      }
+    }).detach();
+  }
+
+  std::unique_lock lock(mutex);
+  idle.wait(lock, [&] { return active == 0; });
+}
+
+void CompileServer::stop() {
+  stopping = true;
+  shutdown(listener, SHUT_RDWR);
+}
+
+// Brings the caches up to date with the file system for a compilation, and keeps the include lookups it is
+// handed alive until it ends
+class CacheUse {
+public:
+  CacheUse() : started(IncludeCache::shared().begin_compilation()) {
+    IncludeCache::shared().revalidate();
+    HeaderCache::shared().revalidate();
+  }
+
+  CacheUse(const CacheUse &) = delete;
+  CacheUse &operator=(const CacheUse &) = delete;
+
+  ~CacheUse() { IncludeCache::shared().end_compilation(started); }
+
+private:
+  uint64_t started;
+};
+
+// Runs the command line of a request, in the calling thread's working directory
+static CompileResponse compile(const CompileRequest &request) {
+  CompileResponse response;
+  std::ostringstream out;
+  std::ostringstream err;
+
+  std::vector<char *> argv = {const_cast<char *>("CLLVM")};
+  std::vector<string> args = request.args;
+  for (string &arg : args) {
+    argv.push_back(arg.data());
+  }
+  argv.push_back(nullptr);
+
+  shared_ptr<Options> options;
+  try {
+    options = Options::parse(static_cast<int>(argv.size() - 1), argv.data());
+    if (!options->serve.empty()) {
+      throw std::runtime_error("--serve cannot be sent to a compile server");
+    }
+    // tracing is process-wide, so one client's trace would take in the spans of every request answered meanwhile
+    if (!options->time_trace.empty()) {
+      throw std::runtime_error("-ftime-trace cannot be sent to a compile server");
+    }
+  } catch (const std::runtime_error &e) {
+    response.status = 1;
+    response.err = "error: " + string(e.what()) + "\n";
+    return response;
+  }
+
+  options->reuse_headers = true;
+  CacheUse caches;
+
+  response.status = run(options, out, err);
+  response.out = out.str();
+  response.err = err.str();
+  return response;
+}
+
+void CompileServer::answer(int connection) {
+  // whatever goes wrong is sent back as an error, as an exception escaping the thread would end the server
+  CompileResponse response;
+  try {
+    CompileRequest request;
+    if (!receive_request(connection, request)) {
+      return;
+    }
+    TRACE_SCOPE("Request", request.directory);
+
+    // the thread takes a working directory of its own, which the threads it starts to compile on share, so
+    // relative paths in the request mean what they did to the client
+    if (unshare(CLONE_FS) != 0 || chdir(request.directory.c_str()) != 0) {
+      response.status = 1;
+      response.err = "error: Could not change to " + request.directory + ": " + std::strerror(errno) + "\n";
+    } else {
+      response = compile(request);
+    }
+  } catch (const std::exception &e) {
+    response = {1, "", "error: " + string(e.what()) + "\n"};
+  } catch (...) {
+    response = {1, "", "error: Unknown error in the compile server\n"};
+  }
+
+  send_response(connection, response);
+  answered++;
+}
@@ -0,0 +1,202 @@
+#include "driver.h"
+#include "codegen.h"
+#include "compile_cache.h"
+#include "lto.h"
+#include "parser.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <vector>
+
+// What besides its tokens decides the object compiled from input: the compiler, the target, whether it is bitcode
+// for LTO, and with debug information the names it records
+static string cache_key_extra(const string &input, const Options &options) {
+  string extra = string(compiler_version) + '\0' + CodeGen::target_triple() + '\0' + input;
+  extra += '\0';
+  extra += static_cast<char>('0' + static_cast<int>(options.lto));
+  if (options.debug) {
+    extra += '\0';
+    extra += "-g";
+    extra += '\0';
+    extra += std::filesystem::current_path().string();
+  }
+  return extra;
+}
+
+CompileResult compile_file(const string &input, const shared_ptr<Options> &options) {
+  CompileResult result;
+  std::ostringstream log;
+  TRACE_SCOPE("Compile", input);
+  
+  CompileStats stats;
+  unique_ptr<PerfCounters> counters;
+  CompileStats *measured = nullptr;
+  if (options->stats) {
+    counters = std::make_unique<PerfCounters>();
+    measured = &stats;
+  }
+  
+  // outside the try, so what was counted before a failure is still reported
+  std::optional<Parser> parser;
+  try {
+    // the front end's phase takes in the files read by the constructor
+    std::optional<PhaseTimer> frontEnd;
+    frontEnd.emplace(measured, counters.get(), options->preprocess_only ? "Preprocess" : "Parse");
+    parser.emplace(input, options);
+    
+    // the key to the compile cache is hashed from the tokens parsing is left with
+    std::optional<TokenHasher> hasher;
+    if (!options->cache_dir.empty() && !options->preprocess_only && options->emit_pch.empty()) {
+      hasher.emplace(options->debug);
+      parser->hash_tokens(&*hasher);
+    }
+    
+    if (options->preprocess_only) {
+      std::ostringstream text;
+      parser->preprocess(text);
+      result.output = text.str();
+      frontEnd.reset();
+    } else {
+      auto ast = parser->parse();
+      frontEnd.reset();
+      
+      if (options->emit_ast) {
+        std::ostringstream tree;
+        print_ast(*ast, parser->interner(), tree);
+        result.output = tree.str();
+      }
+      
+      if (!options->emit_pch.empty()) {
+        PhaseTimer timer(measured, counters.get(), "EmitPCH");
+        parser->emit_pch(options->emit_pch);
+      } else {
+        PhaseTimer timer(measured, counters.get(), "CodeGen");
+        string object = options->object_path(input);
+        string key = hasher ? hasher->finish(cache_key_extra(input, *options)) : string();
+        if (hasher && CompileCache::at(options->cache_dir).fetch(key, object)) {
+          result.cache = CompileResult::CacheUse::Hit;
+        } else {
+          CodeGen codegen(input, options);
+          codegen.emit_object(object);
+          if (hasher) {
+            CompileCache::at(options->cache_dir).store(key, object, options->cache_size);
+            result.cache = CompileResult::CacheUse::Miss;
+          }
+        }
+      }
+      stats.astNodes = ast->size();
+    }
+  } catch (const std::exception &e) {
+    result.failed = true;
+    if (!options->verbose) {
+      log.str("");
+    }
+    log << input << ": error: " << e.what() << "\n";
+  }
+  
+  if (measured) {
+    if (parser) {
+      CompileStats counted = parser->statistics();
+      counted.phases = std::move(stats.phases);
+      counted.astNodes = stats.astNodes;
+      stats = std::move(counted);
+    }
+    stats.print(log, input);
+  }
+  if (options->verbose || result.failed || measured) {
+    result.diagnostics = log.str();
+  }
+  return result;
+}
+
+size_t compile_all(const shared_ptr<Options> &options, std::ostream &diagnostics, std::ostream &output) {
+  CodeGen::initialize_targets();
+  
+  const auto &inputs = options->inputs;
+  std::vector<CompileResult> results(inputs.size());
+  std::vector<bool> done(inputs.size());
+  
+  // results are written out as soon as every earlier input has finished too, so the output is ordered but a
+  // failure in the first file is not held back until the last one is compiled
+  std::mutex outputMutex;
+  size_t nextOutput = 0;
+  size_t failures = 0;
+  size_t cacheHits = 0;
+  size_t cacheMisses = 0;
+  
+  if (!options->time_trace.empty()) {
+    trace::start();
+  }
+  
+  {
+    ThreadPool pool(std::min<size_t>(options->jobs, inputs.size()));
+    for (size_t i = 0; i < inputs.size(); i++) {
+      pool.submit([&, i] {
+        CompileResult result = compile_file(inputs[i], options);
+        
+        std::lock_guard lock(outputMutex);
+        results[i] = std::move(result);
+        done[i] = true;
+        for (; nextOutput < inputs.size() && done[nextOutput]; nextOutput++) {
+          diagnostics << results[nextOutput].diagnostics;
+          output << results[nextOutput].output;
+          failures += results[nextOutput].failed;
+          cacheHits += results[nextOutput].cache == CompileResult::CacheUse::Hit;
+          cacheMisses += results[nextOutput].cache == CompileResult::CacheUse::Miss;
+          results[nextOutput] = {};
+        }
+        diagnostics.flush();
+        output.flush();
+      });
+    }
+  }
+  
+  if (!options->cache_dir.empty() && (options->verbose || options->stats)) {
+    diagnostics << "Compile cache: " << cacheHits << " hits, " << cacheMisses << " misses\n";
+  }
+  
+  if (!options->time_trace.empty()) {
+    std::ofstream file(options->time_trace);
+    trace::write_chrome_json(file);
+    if (!file) {
+      diagnostics << "error: Could not write time trace to " << options->time_trace << "\n";
+      failures++;
+    }
+  }
+  
+  return failures;
+}
+
+int run(const shared_ptr<Options> &options, std::ostream &out, std::ostream &err) {
+  if (options->help) {
+    out << usage;
+    return 0;
+  }
+  if (options->version) {
+    out << compiler_version << std::endl;
+    return 0;
+  }
+  if (options->inputs.empty()) {
+    err << "error: no input files" << std::endl << usage;
+    return 1;
+  }
+  
+  if (options->lto_link) {
+    CodeGen::initialize_targets();
+    try {
+      link_lto(options->inputs, options->output, options->jobs);
+    } catch (const std::runtime_error &e) {
+      err << "error: " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+  
+  return compile_all(options, err, out) == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include "header_cache.h"
+
+#include <filesystem>
+
+#include <sys/stat.h>
+
+HeaderCache &HeaderCache::shared() {
+  static HeaderCache cache;
+  return cache;
+}
+
+namespace {
+
+// What a header is checked against: the file's ID, size and modification time
+struct FileState {
+  FileID id;
+  uint64_t size = 0;
+  int64_t mtime = 0;
+};
+
+// Returns false if path cannot be read as a file
+bool file_state(const string &path, FileState &state) {
+  struct stat st{};
+  if (stat(path.c_str(), &st) != 0 || S_ISDIR(st.st_mode)) {
+    return false;
+  }
+  state.id = {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+  state.size = static_cast<uint64_t>(st.st_size);
+  state.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  return true;
+}
+
+} // namespace
+
+shared_ptr<const HeaderCache::Header> HeaderCache::open(const string &path) {
+  FileState state;
+  if (!file_state(path, state)) {
+    return nullptr;
+  }
+  auto [id, size, mtime] = state;
+
+  {
+    std::lock_guard lock(mutex);
+    auto it = headers.find(id);
+    if (it != headers.end() && it->second->size == size && it->second->mtime == mtime) {
+      hitCount++;
+      return it->second;
+    }
+  }
+  missCount++;
+
+  // read and lex without holding the lock, so compilations needing other headers are not held up. The time was
+  // taken before reading, so a change made while reading shows up as a change the next time.
+  auto header = std::make_shared<Header>();
+  header->source = SourceBuffer::from_file(path);
+  if (!header->source) {
+    return nullptr;
+  }
+  header->size = size;
+  header->mtime = mtime;
+  std::error_code ec;
+  header->path = std::filesystem::absolute(path, ec).string();
+  header->tokens = TokenBuffer::lex(*header->source, header->strings);
+  // the line table is built on first use, which has to happen before other compilations can share the buffer
+  header->source->line_starts();
+
+  // a file that replaced the one looked at is used, but not kept, as what it was read at is unknown
+  if (header->source->id == id && !ec) {
+    std::lock_guard lock(mutex);
+    headers[id] = header;
+  }
+  return header;
+}
+
+void HeaderCache::revalidate() {
+  std::lock_guard lock(mutex);
+  for (auto it = headers.begin(); it != headers.end();) {
+    const Header &header = *it->second;
+    FileState now;
+    if (file_state(header.path, now) && now.id == it->first && now.size == header.size && now.mtime == header.mtime) {
+      ++it;
+    } else {
+      it = headers.erase(it);
+    }
+  }
+}
+
+void HeaderCache::clear() {
+  std::lock_guard lock(mutex);
+  headers.clear();
+}
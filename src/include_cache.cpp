@@ -0,0 +1,99 @@
+#include "include_cache.h"
+
+#include <algorithm>
+
+#include <sys/stat.h>
+
+IncludeCache &IncludeCache::shared() {
+  static IncludeCache cache;
+  return cache;
+}
+
+static IncludeCache::Directory directory_state(const string &path) {
+  IncludeCache::Directory directory;
+  struct stat st{};
+  if (stat(path.c_str(), &st) == 0) {
+    directory.exists = true;
+    directory.inode = static_cast<uint64_t>(st.st_ino);
+    directory.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  }
+  return directory;
+}
+
+const IncludeCache::Entry *IncludeCache::lookup(const string &dir, std::string_view name, const string &base) {
+  bool relative = !dir.empty() && dir[0] != '/';
+  string key;
+  key.reserve((relative ? base.size() + 1 : 0) + dir.size() + name.size() + 1);
+  if (relative) {
+    key += base;
+    key += '\0';
+  }
+  key += dir;
+  key += '\0';
+  key += name;
+
+  std::lock_guard lock(mutex);
+
+  auto [it, inserted] = entries.try_emplace(std::move(key));
+  unique_ptr<Entry> &entry = it->second;
+  if (!inserted && entry->version == entry->directory->version) {
+    hitCount++;
+    return entry->id.valid() ? entry.get() : nullptr;
+  }
+
+  missCount++;
+  if (entry) {
+    replaced.push_back({begun, std::move(entry)});
+  }
+  entry = std::make_unique<Entry>();
+  entry->path = dir.empty() ? string(name) : dir + "/" + string(name);
+  entry->id = FileID::of(entry->path);
+
+  // the directory holding the file, which is not dir itself if name has a directory part
+  string parent = entry->path.substr(0, entry->path.find_last_of('/') + 1);
+  if (relative) {
+    parent.insert(0, base + "/");
+  }
+  auto [known, added] = directories.try_emplace(std::move(parent));
+  if (added) {
+    known->second = directory_state(known->first);
+  }
+  entry->directory = &known->second;
+  entry->version = known->second.version;
+
+  return entry->id.valid() ? entry.get() : nullptr;
+}
+
+void IncludeCache::revalidate() {
+  std::lock_guard lock(mutex);
+  // an entry replaced before the oldest running compilation began was never handed to it
+  uint64_t oldest = running.empty() ? begun + 1 : *running.begin();
+  auto held = std::find_if(replaced.begin(), replaced.end(), [&](const Replaced &r) { return r.begun >= oldest; });
+  replaced.erase(replaced.begin(), held);
+
+  for (auto &[path, directory] : directories) {
+    Directory now = directory_state(path);
+    if (now.exists != directory.exists || now.inode != directory.inode || now.mtime != directory.mtime) {
+      now.version = directory.version + 1;
+      directory = now;
+    }
+  }
+}
+
+uint64_t IncludeCache::begin_compilation() {
+  std::lock_guard lock(mutex);
+  running.insert(++begun);
+  return begun;
+}
+
+void IncludeCache::end_compilation(uint64_t started) {
+  std::lock_guard lock(mutex);
+  running.erase(started);
+}
+
+void IncludeCache::clear() {
+  std::lock_guard lock(mutex);
+  entries.clear();
+  directories.clear();
+  replaced.clear();
+}
@@ -1,66 +1,133 @@
 //
 // Created by kiran on 2/28/24.
 //
-#include <fstream>
+#include <filesystem>
 #include <iostream>
 #include "parser.h"
 
-std::string Parser::find_include(const std::string &filename) {
-  if (filename[0] == '/')
-    return filename;
+const IncludeCache::Entry *Parser::find_include(Symbol name) {
+  std::string_view filename = strings.get(name);
+  if (filename.empty()) {
+    throw std::runtime_error("Empty include filename");
+  }
+  IncludeCache &cache = IncludeCache::shared();
+  if (workingDir.empty()) {
+    workingDir = std::filesystem::current_path().string();
+  }
+  if (filename[0] == '/') {
+    stats.includeLookups++;
+    const IncludeCache::Entry *entry = cache.lookup("", filename);
+    stats.failedLookups += entry == nullptr;
+    return entry;
+  }
   
-  string fname = "";
   for (const auto &include : this->options->include_dirs) {
-    fname = include + "/" + filename;
-    if (std::ifstream f(fname); f.good()) {
-      return fname;
-    } else if (std::ifstream(fname + ".h"); f.good()) {
-      return fname + ".h";
+    stats.includeLookups++;
+    if (auto entry = cache.lookup(include, filename, workingDir)) {
+      return entry;
     }
+    stats.failedLookups++;
   }
   
-  return "";
+  return nullptr;
 }
 
-void Parser::parse_include() {
-  next();
+Symbol Parser::parse_include() {
+  // the producer waits for an answer once it has passed on an operand that is written out
+  bool answer = includes.back().pipe != nullptr;
+  CToken operand = read_token();
   
-  string filename;
-  switch (token->type) {
-    case CTokenType::CConstantString:
-      // parse user include
-      filename = *token->value;
-      // remove quotes
-      filename = filename.substr(1, filename.size() - 2);
-      break;
-    case CTokenType::COperatorLess:
-      // parse system include
-      filename = "";
-      while (true) {
-        next();
-        if (token->type == CTokenType::COperatorGreater) {
-          break;
+  std::vector<CToken> operands;
+  if (macro_name(operand) != Interner::none && !(operand.flags & CToken::start_of_line)) {
+    // an operand made by macros is read to the end of the line and expanded
+    answer = false;
+    CToken lineEnd = read_line();
+    directiveLine.insert(directiveLine.begin(), operand);
+    expand_argument(directiveLine.data(), directiveLine.data() + directiveLine.size(), operands);
+    
+    // the start of the next line belongs after the include
+    pending.push_back(lineEnd);
+  } else {
+    operands.push_back(operand);
+    if (operand.type == CTokenType::COperatorLess) {
+      do {
+        operands.push_back(read_token());
+        if (operands.back().type == CTokenType::CEndOfFile || (operands.back().flags & CToken::start_of_line)) {
+          throw std::runtime_error("Unterminated include directive");
         }
-        filename += *token->value;
-      }
-      
-      break;
-    default:
-      throw std::runtime_error("Invalid include directive");
+      } while (operands.back().type != CTokenType::COperatorGreater);
+    }
+  }
+  
+  string filename;
+  if (operands.size() == 1 && operands[0].type == CTokenType::CConstantString) {
+    // parse user include, removing the quotes
+    std::string_view spelling = strings.get(operands[0].value);
+    filename = spelling.substr(1, spelling.size() - 2);
+  } else if (operands.size() >= 2 && operands.front().type == CTokenType::COperatorLess &&
+             operands.back().type == CTokenType::COperatorGreater) {
+    // parse system include
+    for (size_t i = 1; i + 1 < operands.size(); i++) {
+      filename += operands[i].getSpelling(strings);
+    }
+  } else {
+    throw std::runtime_error("Invalid include directive");
   }
   
-  filename = find_include(filename);
+  pipeWaiting = answer;
+  Symbol name = strings.intern(filename);
+  const IncludeCache::Entry *include = find_include(name);
   
-  if (filename.empty()) {
+  if (!include) {
     throw std::runtime_error("Could not find include file: " + filename);
   }
   
-  check_for_circular_include(filename);
+  if (is_include_redundant(include->id)) {
+    skippedIncludes++;
+    if (pipeWaiting) {
+      pipe->resume();
+      pipeWaiting = false;
+    }
+    next();
+    return name;
+  }
+  
+  check_for_circular_include(include->id, include->path);
+  
+  const SourceBuffer *buffer = nullptr;
+  const TokenBuffer *tokens = nullptr;
+  if (options->reuse_headers) {
+    CachedHeader &cached = cachedHeaders[include->id];
+    if (!cached.header) {
+      cached.header = HeaderCache::shared().open(include->path);
+      if (cached.header) {
+        cached.tokens = cached.header->tokens->reinterned(cached.header->strings, strings);
+      }
+    }
+    if (cached.header) {
+      buffer = cached.header->source.get();
+      tokens = cached.tokens.get();
+    }
+  } else {
+    buffer = sources.open(include->path, include->id);
+  }
+  if (!buffer) {
+    throw std::runtime_error("Could not read include file: " + include->path);
+  }
   
-  std::cout << "Decending to depth " << lexers.size()  << " with " << filename << std::endl;
+  // the header's tokens are already there, so the producer goes on with this file
+  if (tokens && pipeWaiting) {
+    pipe->resume();
+    pipeWaiting = false;
+  }
   
-  std::ifstream stream(filename);
+  // tokens of this file that were already read come back after the include
+  std::vector<CToken> &stash = includes.back().stash;
+  stash.insert(stash.end(), pending.begin(), pending.end());
+  pending.clear();
   
-  lexers.push_back(std::make_unique<Lexer>((std::istream &) stream, filename));
+  push_file(*buffer, tokens);
   next();
-}
\ No newline at end of file
+  
+  return name;
+}
@@ -0,0 +1,133 @@
+#include "interner.h"
+
+#include <algorithm>
+#include <cstring>
+
+static uint32_t hash_string(std::string_view str) {
+  // FNV-1a, which is cheap for the short strings that make up most identifiers
+  uint32_t hash = 2166136261u;
+  for (char ch : str) {
+    hash ^= static_cast<unsigned char>(ch);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+const Number Interner::undecoded;
+
+Interner::Interner() : slots(1024, none) {
+  append("", hash_string(""));
+}
+
+void Interner::append(std::string_view str, uint32_t hash) {
+  size_t index = count + first_segment_size;
+  unsigned int segment = 63 - __builtin_clzll(index) - first_segment_bits;
+  if (!segments[segment]) {
+    segments[segment] = std::make_unique<std::string_view[]>(first_segment_size << segment);
+  }
+  segments[segment][index - (first_segment_size << segment)] = str;
+  hashes.push_back(hash);
+  count++;
+}
+
+const char *Interner::store(std::string_view str) {
+  if (str.size() > chunkLeft) {
+    size_t size = std::max(chunk_size, str.size());
+    chunks.push_back(std::make_unique<char[]>(size));
+    chunkPos = chunks.back().get();
+    chunkLeft = size;
+  }
+
+  char *dest = chunkPos;
+  std::memcpy(dest, str.data(), str.size());
+  chunkPos += str.size();
+  chunkLeft -= str.size();
+  return dest;
+}
+
+void Interner::grow() {
+  std::vector<Symbol> bigger(slots.size() * 2, none);
+  size_t mask = bigger.size() - 1;
+
+  for (Symbol symbol = 1; symbol < count; symbol++) {
+    size_t i = hashes[symbol] & mask;
+    while (bigger[i] != none) {
+      i = (i + 1) & mask;
+    }
+    bigger[i] = symbol;
+  }
+
+  slots = std::move(bigger);
+}
+
+template <typename Store>
+Symbol Interner::find_or_add(std::string_view str, Store store) {
+  if (str.empty()) {
+    return none;
+  }
+
+  uint32_t hash = hash_string(str);
+  size_t mask = slots.size() - 1;
+  size_t i = hash & mask;
+
+  while (slots[i] != none) {
+    Symbol symbol = slots[i];
+    if (hashes[symbol] == hash && get(symbol) == str) {
+      return symbol;
+    }
+    i = (i + 1) & mask;
+  }
+
+  auto symbol = static_cast<Symbol>(count);
+  append({store(str), str.size()}, hash);
+  slots[i] = symbol;
+
+  // keep the load factor under a half so probe sequences stay short
+  if (count * 2 > slots.size()) {
+    grow();
+  }
+
+  return symbol;
+}
+
+Symbol Interner::intern(std::string_view str) {
+  auto lock = lock_if_shared();
+  return find_or_add(str, [this](std::string_view s) { return store(s); });
+}
+
+Symbol Interner::intern_stored(std::string_view str) {
+  auto lock = lock_if_shared();
+  return find_or_add(str, [](std::string_view s) { return s.data(); });
+}
+
+void Interner::decode(Symbol symbol) {
+  size_t index = symbol + first_segment_size;
+  unsigned int segment = 63 - __builtin_clzll(index) - first_segment_bits;
+  if (!numbers[segment]) {
+    numbers[segment] = std::make_unique<Number[]>(first_segment_size << segment);
+  }
+
+  // what is already decoded is kept, and only spellings that are not constants are looked at again
+  Number &number = numbers[segment][index - (first_segment_size << segment)];
+  if (number.error == Number::Error::Invalid) {
+    number = decode_number(get(symbol));
+  }
+}
+
+Symbol Interner::intern_number(std::string_view spelling) {
+  auto lock = lock_if_shared();
+  Symbol symbol = find_or_add(spelling, [this](std::string_view s) { return store(s); });
+  if (symbol != none) {
+    decode(symbol);
+  }
+  return symbol;
+}
+
+Symbol Interner::intern_number_stored(std::string_view spelling) {
+  auto lock = lock_if_shared();
+  Symbol symbol = find_or_add(spelling, [](std::string_view s) { return s.data(); });
+  if (symbol != none) {
+    decode(symbol);
+  }
+  return symbol;
+}
@@ -1,4 +1,5 @@
 #include "lexer.h"
+#include "keywords.h"
 #include <iostream>
 #include <istream>
 #include <algorithm>
@@ -6,483 +7,306 @@
 
 using std::unique_ptr, std::shared_ptr, std::string;
 
-#define isIdChar(c) isalnum(*c) || *c == '_' || isdigit(*c)
-
-void Lexer::refreshBuffer1() {
-  source->read(buf1, 4096);
-  if (source->eof()) {
-    buf1[source->gcount()] = EOF;
-  }
+void Lexer::advance() {
+  c++;
 }
 
-void Lexer::refreshBuffer2() {
-  source->read(buf2, 4096);
-  if (source->eof()) {
-    buf2[source->gcount()] = EOF;
-  }
+Lexer::Lexer(std::istream &source, Interner &strings, string filename)
+    : ownedBuffer(SourceBuffer::from_stream(source, std::move(filename))), strings(strings), scan(scan_kernels()) {
+  this->filename = ownedBuffer->filename;
+  begin = c = tokenStart = ownedBuffer->begin();
+  end = ownedBuffer->end();
 }
 
-void Lexer::advance() {
-  if (c == buf1 + 4095) {
-    refreshBuffer2();
-    c = buf2;
-    isBuffer1 = false;
-  } else if (c == buf2 + 4095) {
-    refreshBuffer1();
-    c = buf1;
-    isBuffer1 = true;
-  } else {
-    c++;
-  }
-  col++;
+Lexer::Lexer(const SourceBuffer &buffer, Interner &strings, SourceLocation start)
+    : filename(buffer.filename), strings(strings), scan(scan_kernels()), start(start.raw) {
+  begin = c = tokenStart = buffer.begin();
+  end = buffer.end();
 }
 
-Lexer::Lexer(std::istream &source, string filename) : filename(std::move(filename)), line(1), col(1), isBuffer1(true) {
-  // put eof at the end of buf1 and buf2
-  std::fill_n(buf1, 4096, EOF);
-  std::fill_n(buf2, 4096, EOF);
-
-  this->source = &source;
-  
-  buf1[4096] = EOF;
-  buf2[4096] = EOF;
-  refreshBuffer1();
-  
-  c = buf1;
+Lexer::Lexer(std::string_view text, Interner &strings) : strings(strings), scan(scan_kernels()) {
+  begin = c = tokenStart = text.data();
+  end = text.data() + text.size();
 }
 
-std::optional<char> Lexer::lex_escape_character() {
-  int val = 0;
-  int i = 0; // counter for octal escape sequences
+bool Lexer::skip_escape() {
   advance();
-  switch (*c) {
-    case 'a':
-      advance();
-      return '\a';
-    case 'b':
-      advance();
-      return '\b';
-    case 'f':
-      advance();
-      return '\f';
-    case 'n':
-      advance();
-      return '\n';
-    case 'r':
-      advance();
-      return '\r';
-    case 't':
-      advance();
-      return '\t';
-    case 'v':
-      advance();
-      return '\v';
-    case '\\':
-      advance();
-      return '\\';
-    case '\'':
-      advance();
-      return '\'';
-    case '"':
-      advance();
-      return '"';
-    case '?':
-      advance();
-      return '?';
-    case '0':
-      advance();
-      if (!isdigit(*c)) {
-        return '\0';
-      } else {
-        val = 0;
-        i = 0;
-        while (isdigit(*c) && *c < '8') {
-          val *= 8;
-          val += *c - '0';
-          advance();
-          i++;
-          
-          if (i > 2) {
-            lexerError = "Invalid octal escape sequence";
-            return std::nullopt;
-          }
-        }
-        
-        if (val > 255) {
-          lexerError = "Invalid octal escape sequence";
-          return std::nullopt;
-        }
-        
-        return static_cast<char>(val);
-      }
-      return '\0';
-    
-    case 'x':
-      advance();
-      if (!isxdigit(*c)) {
-        lexerError = "Invalid hexadecimal escape sequence";
-        return -1;
-      }
-      while (isxdigit(*c)) {
-        val *= 16;
-        if (isdigit(*c)) {
-          val += *c - '0';
-        } else {
-          val += tolower(*c) - 'a' + 10;
-        }
-        advance();
-        
-        if (val > 255) {
-          lexerError = "Invalid hexadecimal escape sequence";
-          return std::nullopt;
-        }
-      }
-      return static_cast<char>(val);
-    
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-      val = 0;
-      i = 0;
-      while (isdigit(*c) && *c < '8') {
-        val *= 8;
-        val += *c - '0';
-        advance();
-        i++;
-        
-        if (val > 255 || i > 3) {
-          lexerError = "Invalid octal escape sequence";
-          return std::nullopt;
-        }
-      }
-      return static_cast<char>(val);
-    
-    default:
-      lexerError = "Invalid escape sequence";
-      return std::nullopt;
+  // splices are removed before escapes are read, so one may come between the backslash and its character
+  while (*c == '\\' && c + 1 < end && c[1] == '\n') {
+    c += 2;
+  }
+  if (at_end()) {
+    return false;
   }
+  advance();
+  return true;
 }
 
-unique_ptr<CToken> Lexer::lex_char() {
+CToken Lexer::lex_char() {
+  const char *start = c;
+  bool escapes = false;
   advance();
-  string str;
   
-  if (*c == '\\') {
-    auto chr = lex_escape_character();
-    if (!chr.has_value()) {
-      return std::make_unique<CToken>(CTokenType::CUnknown, "", line, col);
+  while (*c != '\'') {
+    if (*c == '\\') {
+      escapes = true;
+      if (skip_escape()) {
+        continue;
+      }
+    } else if (*c != '\n' && !at_end()) {
+      advance();
+      continue;
     }
-    str += chr.value();
-  } else {
-    str += *c;
-    advance();
-  }
-  
-  if (*c != '\'') {
     lexerError = "Expected closing single quote";
-    return std::make_unique<CToken>(CTokenType::CUnknown, "", line, col);
+    return make(CTokenType::CUnknown);
   }
-  
   advance();
-  return std::make_unique<CToken>(CTokenType::CConstantChar, str.c_str(), line, col);
+  
+  if (c - start == 2) {
+    lexerError = "Empty character constant";
+    return make(CTokenType::CUnknown);
+  }
+  return make(CTokenType::CConstantChar, strings.intern(std::string_view(start, c - start)),
+              escapes ? CToken::has_escapes : 0);
 }
 
-unique_ptr<CToken> Lexer::lex_string() {
-  advance();
-  string str;
+CToken Lexer::lex_string() {
+  const char *start = c;
+  bool escapes = false;
+  c = scan.find_string_stop(c + 1);
   
-  while (true) {
+  while (*c != '"') {
     if (*c == '\\') {
-      auto chr = lex_escape_character();
-      if (!chr.has_value()) {
-        return std::make_unique<CToken>(CTokenType::CUnknown, "", line, col);
+      escapes = true;
+      if (!skip_escape()) {
+        lexerError = "Unterminated string";
+        return make(CTokenType::CUnknown);
       }
-      str += chr.value();
-    } else if (*c == '"') {
+    } else if (*c == '\0' && !at_end()) {
+      // a stray NUL is part of the string
       advance();
-      str = '"' + str + '"'; // add quotes to string
-      return std::make_unique<CToken>(CTokenType::CConstantString, str.c_str(), line, col);
     } else {
-      str += *c;
-      advance();
+      lexerError = "Unterminated string";
+      return make(CTokenType::CUnknown);
     }
+    c = scan.find_string_stop(c);
   }
-}
-
-unique_ptr<CToken> Lexer::lex_word() {
-//  auto break case char const continue default do double else
-//  enum extern float for goto if inline int long register
-//  restrict return short signed sizeof static struct switch typedef union
-//  unsigned void volatile while _Bool _Complex _Imaginary
-  
-  string id;
-  id += *c;
   advance();
   
-  while (isIdChar(c)) {
-    id += *c;
-    advance();
-  }
+  // the spelling is kept as it is, and escapes are only decoded if the bytes are needed
+  return make(CTokenType::CConstantString, strings.intern(std::string_view(start, c - start)),
+              escapes ? CToken::has_escapes : 0);
+}
+
+CToken Lexer::lex_word() {
+  const char *start = c;
+  c = scan.skip_identifier(c + 1);
   
-  switch (id[0]) {
-    case 'a':
-      if (id == "auto") {
-        return std::make_unique<CToken>(CTokenType::CKeywordAuto, id.c_str(), line, col);
-      }
-      break;
-    case 'b':
-      if (id == "break") {
-        return std::make_unique<CToken>(CTokenType::CKeywordBreak, id.c_str(), line, col);
-      }
-      break;
-    case 'c':
-      if (id == "case") {
-        return std::make_unique<CToken>(CTokenType::CKeywordCase, id.c_str(), line, col);
-      } else if (id == "char") {
-        return std::make_unique<CToken>(CTokenType::CKeywordChar, id.c_str(), line, col);
-      } else if (id == "const") {
-        return std::make_unique<CToken>(CTokenType::CKeywordConst, id.c_str(), line, col);
-      } else if (id == "continue") {
-        return std::make_unique<CToken>(CTokenType::CKeywordContinue, id.c_str(), line, col);
-      }
-      break;
-    case 'd':
-      if (id == "default") {
-        return std::make_unique<CToken>(CTokenType::CKeywordDefault, id.c_str(), line, col);
-      } else if (id == "do") {
-        return std::make_unique<CToken>(CTokenType::CKeywordDo, id.c_str(), line, col);
-      } else if (id == "double") {
-        return std::make_unique<CToken>(CTokenType::CKeywordDouble, id.c_str(), line, col);
-      }
-      break;
-    case 'e':
-      if (id == "else") {
-        return std::make_unique<CToken>(CTokenType::CKeywordElse, id.c_str(), line, col);
-      } else if (id == "enum") {
-        return std::make_unique<CToken>(CTokenType::CKeywordEnum, id.c_str(), line, col);
-      } else if (id == "extern") {
-        return std::make_unique<CToken>(CTokenType::CKeywordExtern, id.c_str(), line, col);
-      }
-      break;
-    case 'f':
-      if (id == "float") {
-        return std::make_unique<CToken>(CTokenType::CKeywordFloat, id.c_str(), line, col);
-      } else if (id == "for") {
-        return std::make_unique<CToken>(CTokenType::CKeywordFor, id.c_str(), line, col);
-      }
-      break;
-    case 'g':
-      if (id == "goto") {
-        return std::make_unique<CToken>(CTokenType::CKeywordGoto, id.c_str(), line, col);
-      }
-      break;
-    case 'i':
-      if (id == "if") {
-        return std::make_unique<CToken>(CTokenType::CKeywordIf, id.c_str(), line, col);
-      } else if (id == "inline") {
-        return std::make_unique<CToken>(CTokenType::CKeywordInline, id.c_str(), line, col);
-      } else if (id == "int") {
-        return std::make_unique<CToken>(CTokenType::CKeywordInt, id.c_str(), line, col);
-      }
-      break;
-    case 'l':
-      if (id == "long") {
-        return std::make_unique<CToken>(CTokenType::CKeywordLong, id.c_str(), line, col);
-      }
-      break;
-    case 'r':
-      if (id == "register") {
-        return std::make_unique<CToken>(CTokenType::CKeywordRegister, id.c_str(), line, col);
-      } else if (id == "restrict") {
-        return std::make_unique<CToken>(CTokenType::CKeywordRestrict, id.c_str(), line, col);
-      } else if (id == "return") {
-        return std::make_unique<CToken>(CTokenType::CKeywordReturn, id.c_str(), line, col);
-      }
-      break;
-    case 's':
-      if (id == "short") {
-        return std::make_unique<CToken>(CTokenType::CKeywordShort, id.c_str(), line, col);
-      } else if (id == "signed") {
-        return std::make_unique<CToken>(CTokenType::CKeywordSigned, id.c_str(), line, col);
-      } else if (id == "sizeof") {
-        return std::make_unique<CToken>(CTokenType::CKeywordSizeof, id.c_str(), line, col);
-      } else if (id == "static") {
-        return std::make_unique<CToken>(CTokenType::CKeywordStatic, id.c_str(), line, col);
-      } else if (id == "struct") {
-        return std::make_unique<CToken>(CTokenType::CKeywordStruct, id.c_str(), line, col);
-      } else if (id == "switch") {
-        return std::make_unique<CToken>(CTokenType::CKeywordSwitch, id.c_str(), line, col);
-      }
-      break;
-    case 't':
-      if (id == "typedef") {
-        return std::make_unique<CToken>(CTokenType::CKeywordTypedef, id.c_str(), line, col);
-      }
-      break;
-    case 'u':
-      if (id == "union") {
-        return std::make_unique<CToken>(CTokenType::CKeywordUnion, id.c_str(), line, col);
-      } else if (id == "unsigned") {
-        return std::make_unique<CToken>(CTokenType::CKeywordUnsigned, id.c_str(), line, col);
-      }
-      break;
-    case 'v':
-      if (id == "void") {
-        return std::make_unique<CToken>(CTokenType::CKeywordVoid, id.c_str(), line, col);
-      } else if (id == "volatile") {
-        return std::make_unique<CToken>(CTokenType::CKeywordVolatile, id.c_str(), line, col);
-      }
-      break;
-    case 'w':
-      if (id == "while") {
-        return std::make_unique<CToken>(CTokenType::CKeywordWhile, id.c_str(), line, col);
-      }
-      break;
-    case '_':
-      if (id == "_Bool") {
-        return std::make_unique<CToken>(CTokenType::CKeyword_Bool, id.c_str(), line, col);
-      } else if (id == "_Complex") {
-        return std::make_unique<CToken>(CTokenType::CKeyword_Complex, id.c_str(), line, col);
-      } else if (id == "_Imaginary") {
-        return std::make_unique<CToken>(CTokenType::CKeyword_Imaginary, id.c_str(), line, col);
-      }
-      break;
-    default:
-      break;
+  CTokenType type = lookup_keyword(start, c - start);
+  if (type != CTokenType::CIdentifier) {
+    return make(type);
   }
   
-  return std::make_unique<CToken>(CTokenType::CIdentifier, id.c_str(), line, col);
+  return make(CTokenType::CIdentifier, strings.intern(std::string_view(start, c - start)));
 }
 
-unique_ptr<CToken> Lexer::lex_num() {
-  bool isFloat = false;
-  string str;
+CToken Lexer::lex_num() {
+  const char *start = c;
+  c = scan.skip_digits(c);
   
-  while (true) {
-    switch (*c) {
-      case '0':
-      case '1':
-      case '2':
-      case '3':
-      case '4':
-      case '5':
-      case '6':
-      case '7':
-      case '8':
-      case '9':
-        str += *c;
-        break;
-      case '.':
-        if (isFloat) {
-          break;
-        }
-        isFloat = true;
-        str += *c;
-        break;
-      default:
-        if (isFloat) {
-          return std::make_unique<CToken>(CTokenType::CConstantFloat, str.c_str(), line, col);
-        } else {
-          return std::make_unique<CToken>(CTokenType::CConstantInteger, str.c_str(), line, col);
-        }
-    }
-    
+  // the rest of a preprocessing number, which takes in letters, digits, '.' and the sign of an exponent, so
+  // 0x1fUL, 1.5e-3f and even 1..2 are each one token
+  while (isalnum(static_cast<unsigned char>(*c)) || *c == '_' || *c == '.') {
+    bool exponent = *c == 'e' || *c == 'E' || *c == 'p' || *c == 'P';
     advance();
+    if (exponent && (*c == '+' || *c == '-')) {
+      advance();
+    }
   }
+  
+  Symbol value = strings.intern_number(std::string_view(start, c - start));
+  CTokenType type = strings.number(value).is_floating() ? CTokenType::CConstantFloat : CTokenType::CConstantInteger;
+  return make(type, value);
 }
 
-unique_ptr<CToken> Lexer::lex_preprocessor() {
-  string str;
-  str += *c;
+CToken Lexer::lex_preprocessor() {
   advance();
   
   if (*c == '#') {
     advance();
-    return std::make_unique<CToken>(CTokenType::CPreprocessorHashHash, "##", line, col);
+    return make(CTokenType::CPreprocessorHashHash);
   }
   
   while (*c == ' ' || *c == '\t') {
     advance();
   }
   
-  while (isIdChar(c)) {
-    str += *c;
-    advance();
+  const char *name = c;
+  c = scan.skip_identifier(c);
+  
+  CTokenType type = lookup_directive(name, c - name);
+  if (type != CTokenType::CUnknown) {
+    return make(type);
   }
   
-  switch (str[1]) {
-    case 'i':
-      if (str == "#include") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorInclude, str.c_str(), line, col);
-      } else if (str == "#if") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorIf, str.c_str(), line, col);
-      } else if (str == "#ifdef") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorIfdef, str.c_str(), line, col);
-      } else if (str == "#ifndef") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorIfndef, str.c_str(), line, col);
-      }
-      break;
-    case 'd':
-      if (str == "#define") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorDefine, str.c_str(), line, col);
-      }
-      break;
-    case 'u':
-      if (str == "#undef") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorUndef, str.c_str(), line, col);
-      }
-      break;
-    case 'l':
-      if (str == "#line") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorLine, str.c_str(), line, col);
+  // a stringizing operator, a null directive or one the parser handles by name, so the name is lexed on its own
+  c = tokenStart + 1;
+  return make(CTokenType::CPreprocessorHash);
+}
+
+CToken Lexer::next() {
+  CToken token = lex();
+  atLineStart = false;
+  sawSpace = false;
+  return token;
+}
+
+void Lexer::seek(uint32_t offset, uint8_t flags) {
+  c = tokenStart = begin + offset;
+  atLineStart = flags & CToken::start_of_line;
+  sawSpace = flags & CToken::leading_space;
+}
+
+CToken Lexer::skip_inactive() {
+  unsigned int depth = 0;
+  
+  // the lexer always stops after a token, so the first line is already underway
+  bool startOfLine = false;
+  const char *p = c;
+  
+  // p is just past a "/*". Returns the character after the "*/", or the end of the file.
+  auto skip_comment = [&](const char *p) {
+    while (true) {
+      p = scan.find_comment_end(p);
+      if (*p == '*') {
+        return p + 2;
+      } else if (p >= end) {
+        return p;
       }
-      break;
-    case 'e':
-      if (str == "#error") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorError, str.c_str(), line, col);
-      } else if (str == "#elif") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorElif, str.c_str(), line, col);
-      } else if (str == "#else") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorElse, str.c_str(), line, col);
-      } else if (str == "#endif") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorEndif, str.c_str(), line, col);
+      p++;
+    }
+  };
+  
+  while (true) {
+    if (startOfLine) {
+      // a directive may be preceded by blanks and comments
+      while (true) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f' || *p == '\v') {
+          p++;
+        }
+        if (p[0] != '/' || p[1] != '*') {
+          break;
+        }
+        p = skip_comment(p + 2);
       }
-      break;
-    case 'p':
-      if (str == "#pragma") {
-        return std::make_unique<CToken>(CTokenType::CPreprocessorPragma, str.c_str(), line, col);
+      
+      if (*p == '#') {
+        const char *name = p + 1;
+        while (*name == ' ' || *name == '\t') {
+          name++;
+        }
+        const char *nameEnd = scan.skip_identifier(name);
+        
+        CTokenType directive = lookup_directive(name, nameEnd - name);
+        if (directive == CTokenType::CPreprocessorIf || directive == CTokenType::CPreprocessorIfdef ||
+            directive == CTokenType::CPreprocessorIfndef) {
+          depth++;
+        } else if (directive == CTokenType::CPreprocessorElif || directive == CTokenType::CPreprocessorElse ||
+                   directive == CTokenType::CPreprocessorEndif) {
+          if (depth == 0) {
+            c = p;
+            atLineStart = true;
+            return next();
+          }
+          depth -= directive == CTokenType::CPreprocessorEndif;
+        }
+        p = nameEnd;
       }
-      break;
-    case '#' :
-      return std::make_unique<CToken>(CTokenType::CPreprocessorHashHash, str.c_str(), line, col);
+      startOfLine = false;
+    }
     
-    default:
-      break;
+    p = scan.find_inactive_stop(p);
+    switch (*p) {
+      case '\n':
+        p++;
+        startOfLine = true;
+        break;
+      
+      case '\\':
+        // a continued line carries on the one before, so it cannot start a directive
+        p++;
+        if (*p == '\n') {
+          p++;
+        }
+        break;
+      
+      case '/':
+        if (p[1] == '*') {
+          p = skip_comment(p + 2);
+        } else if (p[1] == '/') {
+          p++;
+          do {
+            p = scan.find_line_end(p + 1);
+          } while (*p == '\0' && p < end);
+        } else {
+          p++;
+        }
+        break;
+      
+      case '"':
+      case '\'': {
+        // Skipped text need not be made of valid tokens, and apostrophes in prose left in an #if 0 are common, so
+        // a quote that is never closed ends with its line
+        char quote = *p++;
+        while (*p != quote && *p != '\n' && p < end) {
+          if (*p == '\\' && p + 1 < end) {
+            p += 2;
+          } else {
+            p++;
+          }
+        }
+        if (*p == quote) {
+          p++;
+        }
+        break;
+      }
+      
+      default:
+        if (p >= end) {
+          c = p;
+          return next();
+        }
+        // a stray NUL
+        p++;
+        break;
+    }
   }
-  
-  lexerError = "Unknown preprocessor directive";
-  return std::make_unique<CToken>(CTokenType::CUnknown, "", line, col);
 }
 
-unique_ptr<CToken> Lexer::next() {
-  string str;
-  
+CToken Lexer::lex() {
   while (true) {
+    tokenStart = c;
     switch (*c) {
       
-      case EOF:
-        return std::make_unique<CToken>(CTokenType::CEndOfFile, "", line, col);
-      case '\n':
-        line++;
-        col = 1;
+      case '\0':
+        if (at_end()) {
+          return make(CTokenType::CEndOfFile);
+        }
+        lexerError = "Stray null character";
+        advance();
+        return make(CTokenType::CUnknown);
       case ' ':
       case '\t':
       case '\r':
+      case '\n': {
+        c = scan.skip_whitespace(c, atLineStart);
+        sawSpace = true;
+        break;
+      }
+      case '\f':
+      case '\v':
         advance();
+        sawSpace = true;
         break;
         
         // Operators
@@ -490,205 +314,205 @@ unique_ptr<CToken> Lexer::next() {
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorPlusAssign, "+=", line, col);
+          return make(CTokenType::COperatorPlusAssign);
         } else if (*c == '+') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorIncrement, "++", line, col);
+          return make(CTokenType::COperatorIncrement);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorPlus, "+", line, col);
+        return make(CTokenType::COperatorPlus);
       
       case '-':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorMinusAssign, "-=", line, col);
+          return make(CTokenType::COperatorMinusAssign);
         } else if (*c == '-') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorDecrement, "--", line, col);
+          return make(CTokenType::COperatorDecrement);
         } else if (*c == '>') {
           advance();
-          return std::make_unique<CToken>(CTokenType::CPunctuationArrow, "->", line, col);
+          return make(CTokenType::CPunctuationArrow);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorMinus, "-", line, col);
+        return make(CTokenType::COperatorMinus);
       
       case '*':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorMultiplyAssign, "*=", line, col);
+          return make(CTokenType::COperatorMultiplyAssign);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorMultiply, "*", line, col);
+        return make(CTokenType::COperatorMultiply);
       
       case '/':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorDivideAssign, "/=", line, col);
+          return make(CTokenType::COperatorDivideAssign);
         } else if (*c == '/') {
-          advance();
-          while (*c != '\n' && *c != EOF) {
-            advance();
-          }
+          // a stray NUL in the comment stops the scan early, so keep going until the newline or the real end
+          do {
+            c = scan.find_line_end(c + 1);
+          } while (*c == '\0' && !at_end());
+          sawSpace = true;
           break;
         } else if (*c == '*') {
           advance();
           while (true) {
-            if (*c == EOF) {
+            c = scan.find_comment_end(c);
+            if (*c == '*') {
+              c += 2;
+              sawSpace = true;
+              break;
+            } else if (at_end()) {
               lexerError = "Unterminated comment";
-              return std::make_unique<CToken>(CTokenType::CUnknown, "", line, col);
-            } else if (*c == '*') {
-              advance();
-              if (*c == '/') {
-                advance();
-                break;
-              }
-            } else {
-              advance();
+              return make(CTokenType::CUnknown);
             }
+            advance();
           }
           break;
         }
-        return std::make_unique<CToken>(CTokenType::COperatorDivide, "/", line, col);
+        return make(CTokenType::COperatorDivide);
       
       case '%':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorModuloAssign, "%=", line, col);
+          return make(CTokenType::COperatorModuloAssign);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorModulo, "%", line, col);
+        return make(CTokenType::COperatorModulo);
       
       case '=':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorEqual, "==", line, col);
+          return make(CTokenType::COperatorEqual);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorAssignment, "=", line, col);
+        return make(CTokenType::COperatorAssignment);
       
       case '!':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorNotEqual, "!=", line, col);
+          return make(CTokenType::COperatorNotEqual);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorNot, "!", line, col);
+        return make(CTokenType::COperatorNot);
       
       case '&':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorAndAssign, "&=", line, col);
+          return make(CTokenType::COperatorAndAssign);
         } else if (*c == '&') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorAnd, "&&", line, col);
+          return make(CTokenType::COperatorAnd);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorBitwiseAnd, "&", line, col);
+        return make(CTokenType::COperatorBitwiseAnd);
       
       case '|':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorOrAssign, "|=", line, col);
+          return make(CTokenType::COperatorOrAssign);
         } else if (*c == '|') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorOr, "||", line, col);
+          return make(CTokenType::COperatorOr);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorBitwiseOr, "|", line, col);
+        return make(CTokenType::COperatorBitwiseOr);
       
       case '^':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorXorAssign, "^=", line, col);
+          return make(CTokenType::COperatorXorAssign);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorBitwiseXor, "^", line, col);
+        return make(CTokenType::COperatorBitwiseXor);
       
       case '~':
         advance();
-        return std::make_unique<CToken>(CTokenType::COperatorBitwiseNot, "~", line, col);
+        return make(CTokenType::COperatorBitwiseNot);
       
       case '>':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorGreaterEqual, ">=", line, col);
+          return make(CTokenType::COperatorGreaterEqual);
         } else if (*c == '>') {
           advance();
           if (*c == '=') {
             advance();
-            return std::make_unique<CToken>(CTokenType::COperatorRightShiftAssign, ">>=", line, col);
+            return make(CTokenType::COperatorRightShiftAssign);
           }
-          return std::make_unique<CToken>(CTokenType::COperatorRightShift, ">>", line, col);
+          return make(CTokenType::COperatorRightShift);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorGreater, ">", line, col);
+        return make(CTokenType::COperatorGreater);
       
       case '<':
         advance();
         if (*c == '=') {
           advance();
-          return std::make_unique<CToken>(CTokenType::COperatorLessEqual, "<=", line, col);
+          return make(CTokenType::COperatorLessEqual);
         } else if (*c == '<') {
           advance();
           if (*c == '=') {
             advance();
-            return std::make_unique<CToken>(CTokenType::COperatorLeftShiftAssign, "<<=", line, col);
+            return make(CTokenType::COperatorLeftShiftAssign);
           }
-          return std::make_unique<CToken>(CTokenType::COperatorLeftShift, "<<", line, col);
+          return make(CTokenType::COperatorLeftShift);
         }
-        return std::make_unique<CToken>(CTokenType::COperatorLess, "<", line, col);
+        return make(CTokenType::COperatorLess);
         
         // Punctuation
       case '(':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationOpenParen, "(", line, col);
+        return make(CTokenType::CPunctuationOpenParen);
       case ')':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationCloseParen, ")", line, col);
+        return make(CTokenType::CPunctuationCloseParen);
       case '{':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationOpenBrace, "{", line, col);
+        return make(CTokenType::CPunctuationOpenBrace);
       case '}':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationCloseBrace, "}", line, col);
+        return make(CTokenType::CPunctuationCloseBrace);
       case '[':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationOpenBracket, "[", line, col);
+        return make(CTokenType::CPunctuationOpenBracket);
       case ']':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationCloseBracket, "]", line, col);
+        return make(CTokenType::CPunctuationCloseBracket);
       case ',':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationComma, ",", line, col);
+        return make(CTokenType::CPunctuationComma);
       case ';':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationSemicolon, ";", line, col);
+        return make(CTokenType::CPunctuationSemicolon);
       case ':':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationColon, ":", line, col);
+        return make(CTokenType::CPunctuationColon);
       case '?':
         advance();
-        return std::make_unique<CToken>(CTokenType::CPunctuationQuestionMark, "?", line, col);
+        return make(CTokenType::CPunctuationQuestionMark);
       case '\\':
        advance();
         if (*c == '\n') {
-          line += 1;
-          col = 1;
           advance();
         } else {
-          return std::make_unique<CToken>(CTokenType::CPunctuationBackslash, "\\", line, col);
+          return make(CTokenType::CPunctuationBackslash);
         }
         break;
       case '.':
+        if (isdigit(static_cast<unsigned char>(c[1]))) {
+          return lex_num();
+        }
         advance();
         if (*c == '.') {
           advance();
           if (*c == '.') {
             advance();
-            return std::make_unique<CToken>(CTokenType::CPunctuationEllipsis, "...", line, col);
+            return make(CTokenType::CPunctuationEllipsis);
           }
         }
-        return std::make_unique<CToken>(CTokenType::CPunctuationDot, ".", line, col);
+        return make(CTokenType::CPunctuationDot);
       
       case '0':
       case '1':
@@ -718,7 +542,8 @@ unique_ptr<CToken> Lexer::next() {
       
       default:
         lexerError = "Cannot parse token";
-        return std::make_unique<CToken>(CTokenType::CUnknown, "", line, col);
+        advance();
+        return make(CTokenType::CUnknown);
     }
   }
 }
\ No newline at end of file
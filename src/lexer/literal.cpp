@@ -0,0 +1,145 @@
+#include "literal.h"
+
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+// Decodes the escape sequence p is at, moving p past it. A line splice stands for nothing.
+static void decode_escape(const char *&p, const char *end, string &out) {
+  p++;
+  // a splice may part the backslash from the character it escapes
+  while (end - p >= 2 && p[0] == '\\' && p[1] == '\n') {
+    p += 2;
+  }
+  if (p == end) {
+    throw std::runtime_error("Invalid escape sequence");
+  }
+
+  char ch = *p++;
+  switch (ch) {
+    case 'a':
+      out += '\a';
+      return;
+    case 'b':
+      out += '\b';
+      return;
+    case 'f':
+      out += '\f';
+      return;
+    case 'n':
+      out += '\n';
+      return;
+    case 'r':
+      out += '\r';
+      return;
+    case 't':
+      out += '\t';
+      return;
+    case 'v':
+      out += '\v';
+      return;
+    case '\\':
+    case '\'':
+    case '"':
+    case '?':
+      out += ch;
+      return;
+    case '\n':
+      return;
+
+    case 'x': {
+      if (p == end || !isxdigit(static_cast<unsigned char>(*p))) {
+        throw std::runtime_error("Invalid hexadecimal escape sequence");
+      }
+      int value = 0;
+      while (p != end && isxdigit(static_cast<unsigned char>(*p))) {
+        value = value * 16 + (isdigit(static_cast<unsigned char>(*p)) ? *p - '0' : tolower(*p) - 'a' + 10);
+        p++;
+        if (value > 255) {
+          throw std::runtime_error("Invalid hexadecimal escape sequence");
+        }
+      }
+      out += static_cast<char>(value);
+      return;
+    }
+
+    default: {
+      // up to three octal digits
+      if (ch < '0' || ch > '7') {
+        throw std::runtime_error("Invalid escape sequence");
+      }
+      int value = ch - '0';
+      for (int digits = 1; digits < 3 && p != end && *p >= '0' && *p <= '7'; digits++) {
+        value = value * 8 + (*p++ - '0');
+      }
+      if (value > 255) {
+        throw std::runtime_error("Invalid octal escape sequence");
+      }
+      out += static_cast<char>(value);
+      return;
+    }
+  }
+}
+
+void decode_string(std::string_view spelling, bool hasEscapes, string &out) {
+  std::string_view body = spelling.substr(1, spelling.size() - 2);
+  if (!hasEscapes) {
+    out.append(body);
+    return;
+  }
+
+  // runs of plain characters are copied whole, between the backslashes
+  const char *p = body.data();
+  const char *end = p + body.size();
+  while (p != end) {
+    const auto *backslash = static_cast<const char *>(std::memchr(p, '\\', end - p));
+    if (!backslash) {
+      out.append(p, end);
+      return;
+    }
+    out.append(p, backslash);
+    p = backslash;
+    decode_escape(p, end, out);
+  }
+}
+
+string concatenate_strings(const CToken *first, const CToken *last, const Interner &strings) {
+  // decoding never makes a literal longer, so its spelling less the quotes is room enough
+  size_t size = 0;
+  for (const CToken *token = first; token != last; token++) {
+    size += strings.get(token->value).size() - 2;
+  }
+
+  string out;
+  out.reserve(size);
+  for (const CToken *token = first; token != last; token++) {
+    decode_string(strings.get(token->value), token->flags & CToken::has_escapes, out);
+  }
+  return out;
+}
+
+int32_t decode_char(std::string_view spelling, bool hasEscapes) {
+  string bytes;
+  decode_string(spelling, hasEscapes, bytes);
+  if (bytes.size() == 1) {
+    return static_cast<signed char>(bytes[0]);
+  }
+
+  uint32_t value = 0;
+  for (char ch : bytes) {
+    value = value << 8 | static_cast<unsigned char>(ch);
+  }
+  return static_cast<int32_t>(value);
+}
+
+bool append_escaped(string &out, std::string_view text) {
+  bool escaped = false;
+  for (char ch : text) {
+    if (ch == '"' || ch == '\\') {
+      out += '\\';
+      escaped = true;
+    }
+    out += ch;
+  }
+  return escaped;
+}
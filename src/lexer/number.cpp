@@ -0,0 +1,155 @@
+#include "number.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+static Number invalid(Number::Type type) {
+  Number number;
+  number.type = type;
+  return number;
+}
+
+static bool fits(Number::Type type, uint64_t value) {
+  switch (type) {
+    case Number::Type::Int:
+      return value <= INT32_MAX;
+    case Number::Type::UnsignedInt:
+      return value <= UINT32_MAX;
+    case Number::Type::Long:
+    case Number::Type::LongLong:
+      return value <= INT64_MAX;
+    default:
+      return true;
+  }
+}
+
+static Number decode_integer(std::string_view spelling) {
+  const char *first = spelling.data();
+  const char *last = first + spelling.size();
+
+  int base = 10;
+  if (spelling.size() > 1 && spelling[0] == '0' && (spelling[1] == 'x' || spelling[1] == 'X')) {
+    base = 16;
+    first += 2;
+  } else if (spelling[0] == '0') {
+    // the leading 0 is read as an octal digit, so 0 on its own is octal too, as in C
+    base = 8;
+  }
+
+  Number number;
+  auto [digitsEnd, error] = std::from_chars(first, last, number.integer, base);
+  if (error == std::errc::invalid_argument) {
+    return invalid(Number::Type::Int);
+  }
+
+  // u, l and ll in either order and either case, though not lL
+  bool isUnsigned = false;
+  int longs = 0;
+  for (const char *s = digitsEnd; s != last; s++) {
+    if ((*s == 'u' || *s == 'U') && !isUnsigned) {
+      isUnsigned = true;
+    } else if ((*s == 'l' || *s == 'L') && longs == 0) {
+      longs = s + 1 != last && s[1] == *s ? 2 : 1;
+      s += longs - 1;
+    } else {
+      return invalid(Number::Type::Int);
+    }
+  }
+
+  if (error == std::errc::result_out_of_range) {
+    Number tooLarge = invalid(Number::Type::UnsignedLongLong);
+    tooLarge.error = Number::Error::TooLarge;
+    return tooLarge;
+  }
+  number.error = Number::Error::None;
+  number.unsignedSuffix = isUnsigned;
+
+  // the first type in C's list for the suffix and base that the value fits in, which goes through the types in the
+  // order they are declared in. A decimal constant is only given an unsigned type for a u suffix, except one too
+  // large for long long, which is unsigned long long, as in GCC.
+  number.type = Number::Type::UnsignedLongLong;
+  for (int i = 0; i <= static_cast<int>(Number::Type::UnsignedLongLong); i++) {
+    auto type = static_cast<Number::Type>(i);
+    bool unsignedType = i % 2 == 1;
+    if (i / 2 < longs || (isUnsigned && !unsignedType) || (base == 10 && !isUnsigned && unsignedType)) {
+      continue;
+    }
+    if (fits(type, number.integer)) {
+      number.type = type;
+      break;
+    }
+  }
+  return number;
+}
+
+// Parses [first, last) as T, falling back on strtod and friends for values out of range, which from_chars leaves
+// unset but C rounds to infinity or zero
+template <typename T, typename StrTo>
+static bool parse_floating(const char *first, const char *last, std::chars_format format, double &floating,
+                           StrTo strto) {
+  T value{};
+  auto [end, error] = std::from_chars(first, last, value, format);
+  if (end != last || error == std::errc::invalid_argument) {
+    return false;
+  }
+  if (error == std::errc::result_out_of_range) {
+    std::string text(format == std::chars_format::hex ? "0x" : "");
+    text.append(first, last);
+    value = strto(text.c_str(), nullptr);
+  }
+  floating = static_cast<double>(value);
+  return true;
+}
+
+static Number decode_floating(std::string_view spelling, bool hex) {
+  Number number;
+  number.type = Number::Type::Double;
+  if (char suffix = spelling.back(); suffix == 'f' || suffix == 'F') {
+    number.type = Number::Type::Float;
+    spelling.remove_suffix(1);
+  } else if (suffix == 'l' || suffix == 'L') {
+    number.type = Number::Type::LongDouble;
+    spelling.remove_suffix(1);
+  }
+
+  // a hexadecimal floating constant needs its binary exponent, which from_chars does not
+  std::chars_format format = std::chars_format::general;
+  if (hex) {
+    spelling.remove_prefix(2);
+    if (spelling.find_first_of("pP") == std::string_view::npos) {
+      return invalid(Number::Type::Double);
+    }
+    format = std::chars_format::hex;
+  }
+
+  // from_chars would take a leading sign, which a constant never has
+  const char *first = spelling.data();
+  const char *last = first + spelling.size();
+  if (first == last || *first == '-' || *first == '+') {
+    return invalid(Number::Type::Double);
+  }
+
+  // a float is rounded straight from the digits rather than through a double, which can round differently
+  bool parsed = number.type == Number::Type::Float
+                    ? parse_floating<float>(first, last, format, number.floating, std::strtof)
+                    : parse_floating<double>(first, last, format, number.floating, std::strtod);
+  if (!parsed) {
+    return invalid(Number::Type::Double);
+  }
+  number.error = Number::Error::None;
+  return number;
+}
+
+Number decode_number(std::string_view spelling) {
+  if (spelling.empty()) {
+    return {};
+  }
+
+  // e and E are digits in a hexadecimal constant, so only p and P make one floating
+  bool hex = spelling.size() > 1 && spelling[0] == '0' && (spelling[1] == 'x' || spelling[1] == 'X');
+  bool floating = spelling.find('.') != std::string_view::npos ||
+                  spelling.find_first_of(hex ? "pP" : "eE") != std::string_view::npos;
+  return floating ? decode_floating(spelling, hex) : decode_integer(spelling);
+}
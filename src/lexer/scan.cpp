@@ -0,0 +1,275 @@
+#include "scan.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLLVM_SCAN_X86 1
+#endif
+
+// Portable kernels, used where no vector kernels are available and as the reference for the others
+
+static const char *skip_whitespace_scalar(const char *p, bool &newline) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+    newline |= *p == '\n';
+    p++;
+  }
+  return p;
+}
+
+static const char *find_line_end_scalar(const char *p) {
+  while (*p != '\n' && *p != '\0') {
+    p++;
+  }
+  return p;
+}
+
+static const char *find_comment_end_scalar(const char *p) {
+  while (*p != '\0' && !(*p == '*' && p[1] == '/')) {
+    p++;
+  }
+  return p;
+}
+
+static bool is_id_char(char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+static const char *skip_identifier_scalar(const char *p) {
+  while (is_id_char(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static const char *skip_digits_scalar(const char *p) {
+  while (*p >= '0' && *p <= '9') {
+    p++;
+  }
+  return p;
+}
+
+static const char *find_inactive_stop_scalar(const char *p) {
+  while (*p != '\n' && *p != '/' && *p != '"' && *p != '\'' && *p != '\\' && *p != '\0') {
+    p++;
+  }
+  return p;
+}
+
+static const char *find_string_stop_scalar(const char *p) {
+  while (*p != '"' && *p != '\\' && *p != '\n' && *p != '\0') {
+    p++;
+  }
+  return p;
+}
+
+static const ScanKernels scalar_kernels = {
+  skip_whitespace_scalar,
+  find_line_end_scalar,
+  find_comment_end_scalar,
+  skip_identifier_scalar,
+  skip_digits_scalar,
+  find_inactive_stop_scalar,
+  find_string_stop_scalar,
+  "scalar",
+};
+
+#ifdef CLLVM_SCAN_X86
+
+// Masks of the lanes below index, for index in [0, 64]
+static inline uint64_t lanes_below(unsigned int index) {
+  return index >= 64 ? ~0ull : (1ull << index) - 1;
+}
+
+// Each width provides the same four helpers: load, eq (lanes equal to a byte), in_range (lanes in an inclusive
+// range of ASCII bytes) and the lane count, and the kernels below are written once per width in terms of them.
+// SSE2 is part of the x86-64 baseline, so the 16 byte kernels need no target attribute.
+
+#define SSE2_LANES 16
+
+static inline __m128i load_sse2(const char *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+static inline uint64_t eq_sse2(__m128i v, char ch) {
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(ch))));
+}
+
+static inline uint64_t in_range_sse2(__m128i v, char lo, char hi) {
+  // bytes of 0x80 and above compare as negative, so they are never in an ASCII range
+  __m128i above = _mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(lo - 1)));
+  __m128i below = _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(hi + 1)));
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(above, below)));
+}
+
+static inline uint64_t id_chars_sse2(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  return in_range_sse2(lower, 'a', 'z') | in_range_sse2(v, '0', '9') | eq_sse2(v, '_');
+}
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define AVX2_LANES 32
+
+AVX2_TARGET static inline __m256i load_avx2(const char *p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+AVX2_TARGET static inline uint64_t eq_avx2(__m256i v, char ch) {
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch))));
+}
+
+AVX2_TARGET static inline uint64_t in_range_avx2(__m256i v, char lo, char hi) {
+  __m256i above = _mm256_cmpgt_epi8(v, _mm256_set1_epi8(static_cast<char>(lo - 1)));
+  __m256i below = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), v);
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(above, below)));
+}
+
+AVX2_TARGET static inline uint64_t id_chars_avx2(__m256i v) {
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  return in_range_avx2(lower, 'a', 'z') | in_range_avx2(v, '0', '9') | eq_avx2(v, '_');
+}
+
+#define AVX512_TARGET __attribute__((target("avx512f,avx512bw")))
+#define AVX512_LANES 64
+
+AVX512_TARGET static inline __m512i load_avx512(const char *p) {
+  return _mm512_loadu_si512(p);
+}
+
+AVX512_TARGET static inline uint64_t eq_avx512(__m512i v, char ch) {
+  return _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(ch));
+}
+
+AVX512_TARGET static inline uint64_t in_range_avx512(__m512i v, char lo, char hi) {
+  __m512i offset = _mm512_sub_epi8(v, _mm512_set1_epi8(lo));
+  return _mm512_cmple_epu8_mask(offset, _mm512_set1_epi8(static_cast<char>(hi - lo)));
+}
+
+AVX512_TARGET static inline uint64_t id_chars_avx512(__m512i v) {
+  __m512i lower = _mm512_or_si512(v, _mm512_set1_epi8(0x20));
+  return in_range_avx512(lower, 'a', 'z') | in_range_avx512(v, '0', '9') | eq_avx512(v, '_');
+}
+
+// Every load starts at a character that is at or before the NUL sentinel, since all the characters before it
+// were scanned without stopping, so no load reaches past the buffer's padding.
+#define DEFINE_SCAN_KERNELS(isa, TARGET, LANES)                                                                   \
+  TARGET static const char *skip_whitespace_##isa(const char *p, bool &newline) {                                \
+    while (true) {                                                                                               \
+      auto v = load_##isa(p);                                                                                    \
+      uint64_t newlines = eq_##isa(v, '\n');                                                                     \
+      uint64_t space = eq_##isa(v, ' ') | eq_##isa(v, '\t') | eq_##isa(v, '\r') | newlines;                      \
+      uint64_t other = ~space & lanes_below(LANES);                                                              \
+      if (other) {                                                                                               \
+        unsigned int index = __builtin_ctzll(other);                                                             \
+        newline |= (newlines & lanes_below(index)) != 0;                                                         \
+        return p + index;                                                                                        \
+      }                                                                                                          \
+      newline |= newlines != 0;                                                                                  \
+      p += LANES;                                                                                                \
+    }                                                                                                            \
+  }                                                                                                              \
+                                                                                                                 \
+  TARGET static const char *find_line_end_##isa(const char *p) {                                                 \
+    while (true) {                                                                                               \
+      auto v = load_##isa(p);                                                                                    \
+      uint64_t stop = eq_##isa(v, '\n') | eq_##isa(v, '\0');                                                     \
+      if (stop) {                                                                                                \
+        return p + __builtin_ctzll(stop);                                                                        \
+      }                                                                                                          \
+      p += LANES;                                                                                                \
+    }                                                                                                            \
+  }                                                                                                              \
+                                                                                                                 \
+  TARGET static const char *find_comment_end_##isa(const char *p) {                                              \
+    while (true) {                                                                                               \
+      auto v = load_##isa(p);                                                                                    \
+      uint64_t star = eq_##isa(v, '*');                                                                          \
+      uint64_t nul = eq_##isa(v, '\0');                                                                          \
+      uint64_t stop = (star & (eq_##isa(v, '/') >> 1)) | nul;                                                    \
+      /* a "*" in the last lane pairs with the first character of the next vector, which is safe to read */   \
+      /* because there was no NUL in this one */                                                              \
+      if (!nul && (star >> (LANES - 1)) && p[LANES] == '/') {                                                    \
+        stop |= 1ull << (LANES - 1);                                                                             \
+      }                                                                                                          \
+      if (stop) {                                                                                                \
+        return p + __builtin_ctzll(stop);                                                                        \
+      }                                                                                                          \
+      p += LANES;                                                                                                \
+    }                                                                                                            \
+  }                                                                                                              \
+                                                                                                                 \
+  TARGET static const char *skip_identifier_##isa(const char *p) {                                               \
+    while (true) {                                                                                               \
+      uint64_t other = ~id_chars_##isa(load_##isa(p)) & lanes_below(LANES);                                      \
+      if (other) {                                                                                               \
+        return p + __builtin_ctzll(other);                                                                       \
+      }                                                                                                          \
+      p += LANES;                                                                                                \
+    }                                                                                                            \
+  }                                                                                                              \
+                                                                                                                 \
+  TARGET static const char *skip_digits_##isa(const char *p) {                                                   \
+    while (true) {                                                                                               \
+      uint64_t other = ~in_range_##isa(load_##isa(p), '0', '9') & lanes_below(LANES);                            \
+      if (other) {                                                                                               \
+        return p + __builtin_ctzll(other);                                                                       \
+      }                                                                                                          \
+      p += LANES;                                                                                                \
+    }                                                                                                            \
+  }                                                                                                              \
+                                                                                                                 \
+  TARGET static const char *find_inactive_stop_##isa(const char *p) {                                            \
+    while (true) {                                                                                               \
+      auto v = load_##isa(p);                                                                                    \
+      uint64_t stop = eq_##isa(v, '\n') | eq_##isa(v, '/') | eq_##isa(v, '"') | eq_##isa(v, '\'') |              \
+                      eq_##isa(v, '\\') | eq_##isa(v, '\0');                                                     \
+      if (stop) {                                                                                                \
+        return p + __builtin_ctzll(stop);                                                                        \
+      }                                                                                                          \
+      p += LANES;                                                                                                \
+    }                                                                                                            \
+  }                                                                                                              \
+                                                                                                                 \
+  TARGET static const char *find_string_stop_##isa(const char *p) {                                              \
+    while (true) {                                                                                               \
+      auto v = load_##isa(p);                                                                                    \
+      uint64_t stop = eq_##isa(v, '"') | eq_##isa(v, '\\') | eq_##isa(v, '\n') | eq_##isa(v, '\0');              \
+      if (stop) {                                                                                                \
+        return p + __builtin_ctzll(stop);                                                                        \
+      }                                                                                                          \
+      p += LANES;                                                                                                \
+    }                                                                                                            \
+  }                                                                                                              \
+                                                                                                                 \
+  static const ScanKernels isa##_kernels = {                                                                     \
+    skip_whitespace_##isa, find_line_end_##isa, find_comment_end_##isa,                                          \
+    skip_identifier_##isa, skip_digits_##isa, find_inactive_stop_##isa, find_string_stop_##isa, #isa,            \
+  };
+
+DEFINE_SCAN_KERNELS(sse2, , SSE2_LANES)
+DEFINE_SCAN_KERNELS(avx2, AVX2_TARGET, AVX2_LANES)
+DEFINE_SCAN_KERNELS(avx512, AVX512_TARGET, AVX512_LANES)
+
+#endif
+
+std::vector<const ScanKernels *> available_scan_kernels() {
+  std::vector<const ScanKernels *> kernels = {&scalar_kernels};
+
+#ifdef CLLVM_SCAN_X86
+  __builtin_cpu_init();
+  kernels.push_back(&sse2_kernels);
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back(&avx2_kernels);
+  }
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+    kernels.push_back(&avx512_kernels);
+  }
+#endif
+
+  return kernels;
+}
+
+const ScanKernels &scan_kernels() {
+  static const ScanKernels *selected = available_scan_kernels().back();
+  return *selected;
+}
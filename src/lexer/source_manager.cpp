@@ -0,0 +1,229 @@
+#include "source_manager.h"
+#include "scan.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileID FileID::of(const string &path) {
+  struct stat st{};
+  if (stat(path.c_str(), &st) != 0 || S_ISDIR(st.st_mode)) {
+    return {};
+  }
+  return {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+}
+
+SourceBuffer::SourceBuffer(string filename, char *data, size_t length, size_t mappedLength)
+    : filename(std::move(filename)), data(data), length(length), mappedLength(mappedLength) {}
+
+SourceBuffer::~SourceBuffer() {
+  if (mappedLength) {
+    munmap(data, mappedLength);
+  } else {
+    delete[] data;
+  }
+}
+
+unique_ptr<SourceBuffer> SourceBuffer::from_stream(std::istream &stream, string filename) {
+  string contents((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+  return from_text(contents, std::move(filename));
+}
+
+unique_ptr<SourceBuffer> SourceBuffer::from_text(std::string_view text, string filename) {
+  char *data = new char[text.size() + padding]();
+  std::memcpy(data, text.data(), text.size());
+  return unique_ptr<SourceBuffer>(new SourceBuffer(std::move(filename), data, text.size(), 0));
+}
+
+unique_ptr<SourceBuffer> SourceBuffer::from_edit(const SourceBuffer &original, size_t offset, size_t removed,
+                                                 std::string_view text) {
+  size_t length = original.size() - removed + text.size();
+  char *data = new char[length + padding]();
+  std::memcpy(data, original.begin(), offset);
+  std::memcpy(data + offset, text.data(), text.size());
+  std::memcpy(data + offset + text.size(), original.begin() + offset + removed, original.size() - offset - removed);
+
+  unique_ptr<SourceBuffer> buffer(new SourceBuffer(original.filename, data, length, 0));
+  buffer->id = original.id;
+  return buffer;
+}
+
+const std::vector<uint32_t> &SourceBuffer::line_starts() const {
+  if (lineStarts.empty()) {
+    lineStarts.push_back(0);
+
+    // a stray NUL stops the scan early, so carry on from just past it
+    const ScanKernels &scan = scan_kernels();
+    for (const char *p = begin(); (p = scan.find_line_end(p)) < end(); p++) {
+      if (*p == '\n') {
+        lineStarts.push_back(static_cast<uint32_t>(p + 1 - begin()));
+      }
+    }
+  }
+  return lineStarts;
+}
+
+static unique_ptr<SourceBuffer> with_id(unique_ptr<SourceBuffer> buffer, const struct stat &st) {
+  if (buffer) {
+    buffer->id = {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+  }
+  return buffer;
+}
+
+unique_ptr<SourceBuffer> SourceBuffer::from_file(const string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  // pipes and devices have no size to map, so read them like any other stream
+  if (!S_ISREG(st.st_mode)) {
+    close(fd);
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.good()) {
+      return nullptr;
+    }
+    return with_id(from_stream(stream, path), st);
+  }
+
+  auto size = static_cast<size_t>(st.st_size);
+
+  if (size < map_threshold) {
+    char *data = new char[size + padding]();
+    size_t done = 0;
+    while (done < size) {
+      ssize_t n = read(fd, data + done, size - done);
+      if (n <= 0) {
+        break;
+      }
+      done += n;
+    }
+    close(fd);
+    return with_id(unique_ptr<SourceBuffer>(new SourceBuffer(path, data, done, 0)), st);
+  }
+
+  // Reserve zeroed anonymous memory large enough for the file and its padding, then map the file over the start
+  // of it. The kernel zero-fills the rest of the file's last page and the anonymous pages after it provide the
+  // padding, so the sentinel is there even when the file ends exactly on a page boundary.
+  auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t reserved = (size + padding + page - 1) / page * page;
+
+  void *base = mmap(nullptr, reserved, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return nullptr;
+  }
+
+  if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(base, reserved);
+    close(fd);
+    return nullptr;
+  }
+  close(fd);
+
+  madvise(base, size, MADV_SEQUENTIAL);
+
+  return with_id(unique_ptr<SourceBuffer>(new SourceBuffer(path, static_cast<char *>(base), size, reserved)), st);
+}
+
+const SourceBuffer *SourceManager::open(const string &path) {
+  FileID id = FileID::of(path);
+  if (!id.valid()) {
+    return nullptr;
+  }
+  return open(path, id);
+}
+
+const SourceBuffer *SourceManager::open(const string &path, FileID id) {
+  if (auto it = buffers.find(id); it != buffers.end()) {
+    return it->second.get();
+  }
+
+  auto buffer = SourceBuffer::from_file(path);
+  if (!buffer) {
+    return nullptr;
+  }
+
+  // key by what was actually opened, in case the file was replaced since id was taken
+  FileID opened = buffer->id;
+  return buffers.emplace(opened, std::move(buffer)).first->second.get();
+}
+
+const SourceBuffer *SourceManager::add(unique_ptr<SourceBuffer> buffer) {
+  anonymous.push_back(std::move(buffer));
+  return anonymous.back().get();
+}
+
+// Gives buffer the locations from start on, or throws if they would run past the end of the location space
+static uint32_t range_end(uint32_t start, const SourceBuffer &buffer) {
+  if (buffer.size() >= UINT32_MAX - start) {
+    throw std::runtime_error("Too much source in one compilation to give locations to " + buffer.filename);
+  }
+  return start + static_cast<uint32_t>(buffer.size()) + 1;
+}
+
+SourceLocation SourceManager::start_of(const SourceBuffer &buffer) {
+  if (auto it = starts.find(&buffer); it != starts.end()) {
+    return {it->second};
+  }
+  uint32_t end = range_end(nextStart, buffer);
+  ranges.push_back({nextStart, &buffer});
+  starts.emplace(&buffer, nextStart);
+  nextStart = end;
+  return {ranges.back().start};
+}
+
+SourceLocation SourceManager::replace(const SourceBuffer &old, const SourceBuffer &edited) {
+  auto found = starts.find(&old);
+  if (found == starts.end()) {
+    return start_of(edited);
+  }
+  uint32_t start = found->second;
+  starts.erase(found);
+  for (Range &range : ranges) {
+    if (range.buffer == &old) {
+      range.buffer = &edited;
+    }
+  }
+
+  // the last range can grow in place, and the others keep edited as long as it fits
+  auto range = std::partition_point(ranges.begin(), ranges.end(), [&](const Range &r) { return r.start <= start; });
+  if (range == ranges.end()) {
+    nextStart = std::max(nextStart, range_end(start, edited));
+  } else if (range->start - start <= edited.size()) {
+    ranges.push_back({nextStart, &edited});
+    start = nextStart;
+    nextStart = range_end(start, edited);
+  }
+  starts.emplace(&edited, start);
+  return {start};
+}
+
+SourcePosition SourceManager::position(SourceLocation location) const {
+  if (!location.valid() || location.raw >= nextStart) {
+    return {};
+  }
+  auto range = std::partition_point(ranges.begin(), ranges.end(),
+                                    [&](const Range &r) { return r.start <= location.raw; }) - 1;
+
+  // a range that was handed on may be larger than the buffer that has it now
+  const SourceBuffer &buffer = *range->buffer;
+  auto offset = static_cast<uint32_t>(std::min<size_t>(location.raw - range->start, buffer.size()));
+  const std::vector<uint32_t> &lines = buffer.line_starts();
+  auto line = std::upper_bound(lines.begin(), lines.end(), offset) - lines.begin();
+  return {&buffer, static_cast<unsigned int>(line), offset - lines[line - 1] + 1};
+}
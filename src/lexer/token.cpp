@@ -1,6 +1,6 @@
 #include <token.h>
 
-string CToken::getTypeAsString() const {
+std::string_view fixed_spelling(CTokenType type) {
   switch (type) {
     case CTokenType::CKeywordAuto:
       return "auto";
@@ -77,9 +77,6 @@ string CToken::getTypeAsString() const {
     case CTokenType::CKeyword_Imaginary:
       return "_Imaginary";
       
-    case CTokenType::CIdentifier:
-      return "identifier";
-    
     case CTokenType::CPreprocessorInclude:
       return "#include";
     case CTokenType::CPreprocessorDefine:
@@ -104,15 +101,10 @@ string CToken::getTypeAsString() const {
       return "#else";
     case CTokenType::CPreprocessorEndif:
       return "#endif";
-    
-    case CTokenType::CConstantInteger:
-      return "integer constant";
-    case CTokenType::CConstantFloat:
-      return "float constant";
-    case CTokenType::CConstantChar:
-      return "char constant";
-    case CTokenType::CConstantString:
-      return "string constant";
+    case CTokenType::CPreprocessorHash:
+      return "#";
+    case CTokenType::CPreprocessorHashHash:
+      return "##";
     
     case CTokenType::COperatorPlus:
       return "+";
@@ -205,27 +197,57 @@ string CToken::getTypeAsString() const {
       return "\\";
     case CTokenType::CPunctuationDot:
       return ".";
+    case CTokenType::CPunctuationArrow:
+      return "->";
+    case CTokenType::CPunctuationEllipsis:
+      return "...";
     
+    default:
+      return "";
+  }
+}
+
+string CToken::getTypeAsString() const {
+  switch (type) {
+    case CTokenType::CIdentifier:
+      return "identifier";
+    case CTokenType::CConstantInteger:
+      return "integer constant";
+    case CTokenType::CConstantFloat:
+      return "float constant";
+    case CTokenType::CConstantChar:
+      return "char constant";
+    case CTokenType::CConstantString:
+      return "string constant";
     case CTokenType::CEndOfFile:
       return "end of file";
     case CTokenType::CUnknown:
       return "unknown";
+    case CTokenType::CMacroParameter:
+      return "macro parameter";
+    default:
+      return string(fixed_spelling(type));
+  }
+}
+
+std::string_view CToken::getSpelling(const Interner &strings) const {
+  if (value != Interner::none) {
+    return strings.get(value);
   }
+  return fixed_spelling(type);
 }
 
-string CToken::toString() const {
+string CToken::toString(const Interner &strings) const {
   string str = "<Token: " + getTypeAsString();
-  if (value) {
-    str += " value: " + *value;
+  if (value != Interner::none) {
+    str += " value: " + string(strings.get(value));
   }
-  str += " line: " + std::to_string(line);
-  str += " col: " + std::to_string(col);
+  str += " location: " + std::to_string(location.raw);
   return str + ">";
 }
 
-CToken::CToken(CTokenType type, const char *value, unsigned int line, unsigned int col) {
+CToken::CToken(CTokenType type, Symbol value, SourceLocation location) {
   this->type = type;
-  this->value = std::make_unique<string>(value);
-  this->line = line;
-  this->col = col;
+  this->value = value;
+  this->location = location;
 }
\ No newline at end of file
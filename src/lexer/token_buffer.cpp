@@ -0,0 +1,167 @@
+#include "token_buffer.h"
+#include "lexer.h"
+#include "trace.h"
+
+#include <algorithm>
+
+TokenBuffer::TokenBuffer(const SourceBuffer &source) : sourceBuffer(&source) {}
+
+unique_ptr<TokenBuffer> TokenBuffer::lex(const SourceBuffer &source, Interner &strings) {
+  TRACE_SCOPE("Lex", source.filename);
+  auto buffer = std::make_unique<TokenBuffer>(source);
+
+  // most C averages at least four bytes a token, so this avoids regrowing the arrays for typical files
+  size_t expected = source.size() / 4 + 1;
+  buffer->types.reserve(expected);
+  buffer->tokenFlags.reserve(expected);
+  buffer->offsets.reserve(expected);
+  buffer->payloads.reserve(expected);
+
+  Lexer lexer(source, strings);
+  while (true) {
+    CToken token = lexer.next();
+    buffer->push_back(token.type, token.flags, lexer.token_offset(), token.value);
+    if (token.type == CTokenType::CEndOfFile) {
+      break;
+    }
+  }
+
+  return buffer;
+}
+
+unique_ptr<TokenBuffer> TokenBuffer::reinterned(const Interner &from, Interner &to) const {
+  std::vector<Symbol> symbols(from.size(), Interner::none);
+  for (Symbol symbol = 1; symbol < from.size(); symbol++) {
+    // constants are decoded in the new table too
+    bool decoded = from.number(symbol).error != Number::Error::Invalid;
+    symbols[symbol] = decoded ? to.intern_number_stored(from.get(symbol)) : to.intern_stored(from.get(symbol));
+  }
+
+  auto copy = std::make_unique<TokenBuffer>(*sourceBuffer);
+  copy->types = types;
+  copy->tokenFlags = tokenFlags;
+  copy->offsets = offsets;
+  copy->payloads.resize(payloads.size());
+  std::transform(payloads.begin(), payloads.end(), copy->payloads.begin(),
+                 [&](Symbol payload) { return symbols[payload]; });
+  return copy;
+}
+
+// Replaces values[first, first + count) with [with, withEnd)
+template <typename T, typename Iterator>
+static void replace(std::vector<T> &values, size_t first, size_t count, Iterator with, Iterator withEnd) {
+  auto at = values.begin() + static_cast<std::ptrdiff_t>(first);
+  auto size = static_cast<size_t>(withEnd - with);
+  size_t common = std::min(count, size);
+  std::copy_n(with, common, at);
+  if (size > count) {
+    values.insert(at + static_cast<std::ptrdiff_t>(count), with + static_cast<std::ptrdiff_t>(count), withEnd);
+  } else {
+    values.erase(at + static_cast<std::ptrdiff_t>(size), at + static_cast<std::ptrdiff_t>(count));
+  }
+}
+
+TokenBuffer::Damage TokenBuffer::relex(const SourceBuffer &edited, uint32_t offset, uint32_t removed,
+                                       uint32_t inserted, Interner &strings) {
+  TRACE_SCOPE("Relex", edited.filename);
+  auto delta = static_cast<int64_t>(inserted) - static_cast<int64_t>(removed);
+  
+  sourceBuffer = &edited;
+  
+  // the token before the one the edit starts in may run into it, so lexing starts at the one before that
+  size_t first = std::lower_bound(offsets.begin(), offsets.end(), offset) - offsets.begin();
+  first = first >= 2 ? first - 2 : 0;
+  
+  Lexer lexer(edited, strings);
+  if (first > 0) {
+    lexer.seek(offsets[first], tokenFlags[first]);
+  }
+  
+  TokenBuffer fresh(edited);
+  size_t resume = first;
+  while (true) {
+    CToken token = lexer.next();
+    uint32_t at = lexer.token_offset();
+    if (at >= offset + inserted) {
+      auto old = static_cast<uint32_t>(at - delta);
+      while (resume < size() && offsets[resume] < old) {
+        resume++;
+      }
+      if (resume < size() && offsets[resume] == old && types[resume] == token.type &&
+          tokenFlags[resume] == token.flags) {
+        break;
+      }
+    }
+    fresh.push_back(token.type, token.flags, at, token.value);
+    if (token.type == CTokenType::CEndOfFile) {
+      resume = size();
+      break;
+    }
+  }
+  
+  // the tokens lexed again before the edit usually come out as they were, and are left out of the damage
+  size_t same = 0;
+  while (same < fresh.size() && first + same < resume && fresh.types[same] == types[first + same] &&
+         fresh.tokenFlags[same] == tokenFlags[first + same] && fresh.offsets[same] == offsets[first + same] &&
+         fresh.payloads[same] == payloads[first + same]) {
+    same++;
+  }
+  
+  Damage damage{first + same, resume - first - same, fresh.size() - same};
+  for (size_t i = damage.first; i < resume && !damage.directives; i++) {
+    damage.directives = is_directive(i);
+  }
+  for (size_t i = same; i < fresh.size() && !damage.directives; i++) {
+    damage.directives = fresh.is_directive(i);
+  }
+  auto from = static_cast<std::ptrdiff_t>(same);
+  replace(types, damage.first, damage.removed, fresh.types.begin() + from, fresh.types.end());
+  replace(tokenFlags, damage.first, damage.removed, fresh.tokenFlags.begin() + from, fresh.tokenFlags.end());
+  replace(offsets, damage.first, damage.removed, fresh.offsets.begin() + from, fresh.offsets.end());
+  replace(payloads, damage.first, damage.removed, fresh.payloads.begin() + from, fresh.payloads.end());
+  for (size_t i = damage.first + damage.inserted; i < offsets.size(); i++) {
+    offsets[i] = static_cast<uint32_t>(offsets[i] + delta);
+  }
+  return damage;
+}
+
+size_t TokenBuffer::memory_usage() const {
+  return types.capacity() * sizeof(CTokenType) + tokenFlags.capacity() + offsets.capacity() * sizeof(uint32_t) +
+         payloads.capacity() * sizeof(Symbol);
+}
+
+TokenReader::TokenReader(const TokenBuffer &buffer, SourceLocation start) : buffer(&buffer), start(start) {}
+
+CToken TokenReader::next() {
+  // the last token is always the end of file, so keep returning it
+  size_t i = index < buffer->size() - 1 ? index++ : buffer->size() - 1;
+
+  CToken token(buffer->type(i), buffer->payload(i), start.valid() ? start + buffer->offset(i) : SourceLocation());
+  token.flags = buffer->flags(i);
+  return token;
+}
+
+void TokenReader::seek(size_t i) {
+  index = i;
+}
+
+CToken TokenReader::skip_inactive() {
+  unsigned int depth = 0;
+  for (size_t last = buffer->size() - 1; index < last; index++) {
+    if (!(buffer->flags(index) & CToken::start_of_line)) {
+      continue;
+    }
+    CTokenType type = buffer->type(index);
+    if (type == CTokenType::CPreprocessorIf || type == CTokenType::CPreprocessorIfdef ||
+        type == CTokenType::CPreprocessorIfndef) {
+      depth++;
+    } else if (type == CTokenType::CPreprocessorElif || type == CTokenType::CPreprocessorElse ||
+               type == CTokenType::CPreprocessorEndif) {
+      if (depth == 0) {
+        break;
+      }
+      depth -= type == CTokenType::CPreprocessorEndif;
+    }
+  }
+  return next();
+}
@@ -0,0 +1,176 @@
+#include "token_pipe.h"
+#include "trace.h"
+
+TokenPipe::TokenPipe(const SourceBuffer &main, SourceLocation start, Interner &strings)
+    : strings(strings) {
+  strings.set_shared(true);
+  producer = std::thread(&TokenPipe::produce, this, &main, start);
+}
+
+TokenPipe::~TokenPipe() {
+  stopping.store(true, std::memory_order_release);
+  command.store(Command::Stop, std::memory_order_release);
+  producer.join();
+  strings.set_shared(false);
+}
+
+bool TokenPipe::push(const CToken &token) {
+  while (!ring.try_push(token)) {
+    if (stopping.load(std::memory_order_acquire)) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+TokenPipe::Command TokenPipe::wait_for_command() {
+  while (true) {
+    Command answer = command.load(std::memory_order_acquire);
+    if (answer == Command::Stop || stopping.load(std::memory_order_acquire)) {
+      return Command::Stop;
+    }
+    // taken with a compare and swap so a Stop that arrives meanwhile is not overwritten
+    if (answer != Command::None && command.compare_exchange_strong(answer, Command::None)) {
+      return answer;
+    }
+    std::this_thread::yield();
+  }
+}
+
+void TokenPipe::produce(const SourceBuffer *main, SourceLocation start) {
+  std::vector<std::unique_ptr<Lexer>> lexers;
+  lexers.push_back(std::make_unique<Lexer>(*main, strings, start));
+  // one for each file being lexed, including the time spent waiting for the parser to make room
+  std::vector<trace::Span> spans;
+  spans.emplace_back("Lex", main->filename);
+
+  while (!lexers.empty()) {
+    CToken token = lexers.back()->next();
+    if (!push(token)) {
+      return;
+    }
+
+    if (token.type == CTokenType::CEndOfFile) {
+      lexers.pop_back();
+      spans.pop_back();
+      continue;
+    }
+    // an #include that does not start a line is not a directive, so the parser will not answer it
+    if (token.type != CTokenType::CPreprocessorInclude || !(token.flags & CToken::start_of_line)) {
+      continue;
+    }
+
+    // pass on the operand, stopping early at anything the parser will reject without answering
+    bool complete = false;
+    token = lexers.back()->next();
+    if (token.type == CTokenType::CConstantString) {
+      complete = true;
+    } else if (token.type == CTokenType::COperatorLess) {
+      while (token.type != CTokenType::COperatorGreater && token.type != CTokenType::CEndOfFile) {
+        if (!push(token)) {
+          return;
+        }
+        token = lexers.back()->next();
+      }
+      complete = token.type == CTokenType::COperatorGreater;
+    }
+    if (!push(token)) {
+      return;
+    }
+    if (token.type == CTokenType::CEndOfFile) {
+      lexers.pop_back();
+      spans.pop_back();
+      continue;
+    }
+    if (!complete) {
+      continue;
+    }
+
+    switch (wait_for_command()) {
+      case Command::Enter:
+        lexers.push_back(std::make_unique<Lexer>(*enterBuffer, strings, enterStart));
+        spans.emplace_back("Lex", enterBuffer->filename);
+        break;
+      case Command::Stop:
+        return;
+      default:
+        break;
+    }
+  }
+
+  finished.store(true, std::memory_order_release);
+}
+
+CToken TokenPipe::next() {
+  CToken token;
+  while (!ring.try_pop(token)) {
+    if (finished.load(std::memory_order_acquire)) {
+      // every token was pushed before finished was set, so one more look settles whether any are left. If not,
+      // the last one was the end of the main file, so keep returning that.
+      if (ring.try_pop(token)) {
+        break;
+      }
+      return {CTokenType::CEndOfFile, Interner::none};
+    }
+    std::this_thread::yield();
+  }
+
+  switch (operand) {
+    case Operand::None:
+      if (token.type == CTokenType::CPreprocessorInclude && (token.flags & CToken::start_of_line)) {
+        operand = Operand::Expected;
+      }
+      break;
+    case Operand::Expected:
+      answerDue = token.type == CTokenType::CConstantString;
+      operand = token.type == CTokenType::COperatorLess ? Operand::Angled : Operand::None;
+      break;
+    case Operand::Angled:
+      answerDue = token.type == CTokenType::COperatorGreater;
+      if (token.type == CTokenType::COperatorGreater || token.type == CTokenType::CEndOfFile) {
+        operand = Operand::None;
+      }
+      break;
+  }
+  return token;
+}
+
+CToken TokenPipe::skip_inactive() {
+  unsigned int depth = 0;
+  while (true) {
+    if (answerDue) {
+      resume();
+    }
+    CToken token = next();
+    if (token.type == CTokenType::CEndOfFile) {
+      return token;
+    }
+    if (!(token.flags & CToken::start_of_line)) {
+      continue;
+    }
+    
+    if (token.type == CTokenType::CPreprocessorIf || token.type == CTokenType::CPreprocessorIfdef ||
+        token.type == CTokenType::CPreprocessorIfndef) {
+      depth++;
+    } else if (token.type == CTokenType::CPreprocessorElif || token.type == CTokenType::CPreprocessorElse ||
+               token.type == CTokenType::CPreprocessorEndif) {
+      if (depth == 0) {
+        return token;
+      }
+      depth -= token.type == CTokenType::CPreprocessorEndif;
+    }
+  }
+}
+
+void TokenPipe::enter(const SourceBuffer &buffer, SourceLocation start) {
+  answerDue = false;
+  enterBuffer = &buffer;
+  enterStart = start;
+  command.store(Command::Enter, std::memory_order_release);
+}
+
+void TokenPipe::resume() {
+  answerDue = false;
+  command.store(Command::Resume, std::memory_order_release);
+}
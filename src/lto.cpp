@@ -0,0 +1,102 @@
+#include "lto.h"
+#include "codegen.h"
+#include "trace.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/BinaryFormat/Magic.h>
+#include <llvm/LTO/LTO.h>
+#include <llvm/Support/Caching.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+
+void link_lto(const std::vector<string> &inputs, const string &output, unsigned int threads) {
+  TRACE_SCOPE("LinkLTO", output);
+  llvm::lto::Config config;
+  config.DefaultTriple = CodeGen::target_triple();
+  config.RelocModel = llvm::Reloc::PIC_;
+
+  llvm::lto::ThinBackend backend =
+      llvm::lto::createInProcessThinBackend(llvm::heavyweight_hardware_concurrency(threads));
+  llvm::lto::LTO lto(std::move(config), std::move(backend), threads);
+
+  // the bitcode has to stay in memory until the link is done, and the objects that are not bitcode go straight
+  // to the final link
+  std::vector<unique_ptr<llvm::MemoryBuffer>> buffers;
+  std::vector<string> objects;
+  std::unordered_set<string> defined;
+
+  for (const string &input : inputs) {
+    auto buffer = llvm::MemoryBuffer::getFile(input);
+    if (!buffer) {
+      throw std::runtime_error("Could not read " + input + ": " + buffer.getError().message());
+    }
+    if (llvm::identify_magic((*buffer)->getBuffer()) != llvm::file_magic::bitcode) {
+      objects.push_back(input);
+      continue;
+    }
+
+    auto file = llvm::lto::InputFile::create((*buffer)->getMemBufferRef());
+    if (!file) {
+      throw std::runtime_error("Could not read bitcode from " + input + ": " + llvm::toString(file.takeError()));
+    }
+
+    // the first definition of a name is the one kept, and the object this makes may be linked into anything
+    std::vector<llvm::lto::SymbolResolution> resolutions;
+    for (const llvm::lto::InputFile::Symbol &symbol : (*file)->symbols()) {
+      llvm::lto::SymbolResolution resolution;
+      resolution.Prevailing = !symbol.isUndefined() && defined.insert(symbol.getName().str()).second;
+      resolution.VisibleToRegularObj = true;
+      resolutions.push_back(resolution);
+    }
+    if (llvm::Error error = lto.add(std::move(*file), resolutions)) {
+      throw std::runtime_error("Could not link " + input + ": " + llvm::toString(std::move(error)));
+    }
+    buffers.push_back(std::move(*buffer));
+  }
+
+  // each task writes a native object of its own, to be linked with the rest
+  std::vector<string> parts(lto.getMaxTasks());
+  std::mutex partsMutex;
+  auto addStream = [&](unsigned int task) -> llvm::Expected<unique_ptr<llvm::CachedFileStream>> {
+    int fd = -1;
+    llvm::SmallString<128> path;
+    if (std::error_code ec = llvm::sys::fs::createTemporaryFile("cllvm-lto", "o", fd, path)) {
+      return llvm::errorCodeToError(ec);
+    }
+    std::lock_guard lock(partsMutex);
+    parts[task] = string(path.str());
+    return std::make_unique<llvm::CachedFileStream>(std::make_unique<llvm::raw_fd_ostream>(fd, true));
+  };
+  llvm::Error error = lto.run(addStream);
+
+  for (const string &part : parts) {
+    if (!part.empty()) {
+      objects.push_back(part);
+    }
+  }
+  std::string message;
+  if (error) {
+    message = "Could not optimize " + output + ": " + llvm::toString(std::move(error));
+  } else {
+    try {
+      link_relocatable(objects, output);
+    } catch (const std::runtime_error &e) {
+      message = e.what();
+    }
+  }
+  for (const string &part : parts) {
+    if (!part.empty()) {
+      llvm::sys::fs::remove(part);
+    }
+  }
+  if (!message.empty()) {
+    throw std::runtime_error(message);
+  }
+}
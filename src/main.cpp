@@ -1,3 +1,38 @@
-int main(int argc, char** argv) {
+#include <csignal>
+#include <iostream>
+
+#include "compile_server.h"
+#include "driver.h"
+#include "options.h"
+
+static CompileServer *server = nullptr;
 
-}
\ No newline at end of file
+static void stop_server(int) {
+  server->stop();
+}
+
+int main(int argc, char** argv) {
+  shared_ptr<Options> options;
+  try {
+    options = Options::parse(argc, argv);
+  } catch (const std::runtime_error &e) {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+  
+  if (!options->serve.empty()) {
+    try {
+      CompileServer serving(options->serve);
+      server = &serving;
+      std::signal(SIGINT, stop_server);
+      std::signal(SIGTERM, stop_server);
+      serving.run();
+    } catch (const std::runtime_error &e) {
+      std::cerr << "error: " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+  
+  return run(options, std::cout, std::cerr);
+}
@@ -0,0 +1,163 @@
+#include "options.h"
+
+#include <cctype>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+using std::string;
+
+// A number of bytes, optionally followed by K, M or G
+static uint64_t parse_size(const string &text) {
+  // stoull would take a sign, and wrap a negative size around
+  if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+    throw std::runtime_error("Invalid size: " + text);
+  }
+  size_t end = 0;
+  uint64_t size = 0;
+  try {
+    size = std::stoull(text, &end);
+  } catch (const std::exception &) {
+    throw std::runtime_error("Invalid size: " + text);
+  }
+  
+  string suffix = text.substr(end);
+  unsigned int shift = 0;
+  if (suffix == "K" || suffix == "k") {
+    shift = 10;
+  } else if (suffix == "M" || suffix == "m") {
+    shift = 20;
+  } else if (suffix == "G" || suffix == "g") {
+    shift = 30;
+  } else if (!suffix.empty()) {
+    throw std::runtime_error("Invalid size: " + text);
+  }
+  if (size > UINT64_MAX >> shift) {
+    throw std::runtime_error("Invalid size: " + text);
+  }
+  return size << shift;
+}
+
+std::shared_ptr<Options> Options::parse(int argc, char **argv) {
+  auto options = std::make_shared<Options>();
+  
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    
+    // the argument of an option, either joined to it ("-Idir") or as the next argument ("-I dir")
+    auto value = [&](std::string_view name) -> string {
+      if (arg.size() > name.size()) {
+        return string(arg.substr(name.size()));
+      }
+      if (i + 1 >= argc) {
+        throw std::runtime_error("Missing argument to " + string(name));
+      }
+      return argv[++i];
+    };
+    
+    if (arg == "-h" || arg == "--help") {
+      options->help = true;
+    } else if (arg == "--version") {
+      options->version = true;
+    } else if (arg == "-v" || arg == "--verbose") {
+      options->verbose = true;
+    } else if (arg == "-g") {
+      options->debug = true;
+    } else if (arg == "-E") {
+      options->preprocess_only = true;
+    } else if (arg == "--emit-ast") {
+      options->emit_ast = true;
+    } else if (arg == "--emit-pch") {
+      options->emit_pch = value(arg);
+    } else if (arg == "--include-pch") {
+      options->include_pch = value(arg);
+    } else if (arg == "--stats") {
+      options->stats = true;
+    } else if (arg == "-ftime-trace") {
+      options->time_trace = "trace.json";
+    } else if (arg.substr(0, 13) == "-ftime-trace=") {
+      options->time_trace = arg.substr(13);
+      if (options->time_trace.empty()) {
+        throw std::runtime_error("Missing argument to -ftime-trace");
+      }
+    } else if (arg == "--cache-dir") {
+      options->cache_dir = value(arg);
+    } else if (arg == "--cache-size") {
+      options->cache_size = parse_size(value(arg));
+    } else if (arg == "--serve") {
+      options->serve = value(arg);
+    } else if (arg == "-flto" || arg == "-flto=full") {
+      options->lto = Options::LTOMode::Full;
+    } else if (arg == "-flto=thin") {
+      options->lto = Options::LTOMode::Thin;
+    } else if (arg == "--lto-link") {
+      options->lto_link = true;
+    } else if (arg.substr(0, 18) == "-fcodegen-threads=") {
+      string threads(arg.substr(18));
+      // stoul would take a sign, and wrap "-1" around to the largest count
+      unsigned long count = 0;
+      size_t end = 0;
+      try {
+        if (!threads.empty() && std::isdigit(static_cast<unsigned char>(threads[0]))) {
+          count = std::stoul(threads, &end);
+        }
+      } catch (const std::exception &) {
+        throw std::runtime_error("Invalid thread count: " + threads);
+      }
+      if (count == 0 || end != threads.size() || count > Options::max_codegen_threads) {
+        throw std::runtime_error("Invalid thread count: " + threads);
+      }
+      options->codegen_threads = static_cast<unsigned int>(count);
+    } else if (arg.substr(0, 2) == "-j") {
+      string jobs = value("-j");
+      try {
+        options->jobs = static_cast<unsigned int>(std::stoul(jobs));
+      } catch (const std::exception &) {
+        throw std::runtime_error("Invalid job count: " + jobs);
+      }
+      if (options->jobs == 0) {
+        throw std::runtime_error("Invalid job count: " + jobs);
+      }
+    } else if (arg.substr(0, 2) == "-o") {
+      options->output = value("-o");
+    } else if (arg.substr(0, 2) == "-I") {
+      options->include_dirs.insert(options->include_dirs.end() - system_includes.size(), value("-I"));
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      throw std::runtime_error("Unknown option: " + string(arg));
+    } else {
+      options->inputs.emplace_back(arg);
+    }
+  }
+  
+  if (options->inputs.size() > 1 && !options->output.empty() && !options->lto_link) {
+    throw std::runtime_error("-o cannot be used with more than one input file");
+  }
+  if (options->inputs.size() > 1 && !options->emit_pch.empty()) {
+    throw std::runtime_error("--emit-pch cannot be used with more than one input file");
+  }
+  
+  if (options->lto_link && options->output.empty()) {
+    throw std::runtime_error("--lto-link needs an output file, given with -o");
+  }
+  
+  // objects are named after their inputs, so inputs of the same name in different directories would be compiled
+  // to the same file, the last to finish writing over the others
+  if (options->output.empty() && !options->preprocess_only && options->emit_pch.empty() && !options->lto_link) {
+    std::unordered_map<string, string> objects;
+    for (const string &input : options->inputs) {
+      auto [other, added] = objects.try_emplace(options->object_path(input), input);
+      if (!added) {
+        throw std::runtime_error(other->second + " and " + input + " would both be compiled to " + other->first);
+      }
+    }
+  }
+  
+  return options;
+}
+
+string Options::object_path(const string &input) const {
+  if (!output.empty()) {
+    return output;
+  }
+  return std::filesystem::path(input).filename().replace_extension(".o").string();
+}
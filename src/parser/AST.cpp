@@ -2,3 +2,130 @@
 // Created by kiran on 2/24/24.
 //
 
+#include "ast.h"
+
+NodeID AST::add(ASTKind kind, Symbol value, SourceLocation location, size_t start) {
+  auto firstChild = static_cast<uint32_t>(childIDs.size());
+  auto childCount = static_cast<uint32_t>(pending.size() - start);
+  childIDs.insert(childIDs.end(), pending.begin() + static_cast<std::ptrdiff_t>(start), pending.end());
+  pending.resize(start);
+  
+  auto id = static_cast<NodeID>(nodes.size());
+  nodes.push_back({kind, CTokenType::CUnknown, 0, value, firstChild, childCount});
+  locations.push_back(location);
+  pending.push_back(id);
+  return id;
+}
+
+NodeID AST::add_directive(CTokenType directive, SourceLocation location) {
+  NodeID id = add(ASTKind::Directive, Interner::none, location);
+  nodes[id].token = directive;
+  return id;
+}
+
+NodeID AST::add(ASTKind kind, CTokenType token, Symbol value, SourceLocation location, size_t start) {
+  NodeID id = add(kind, value, location, start);
+  nodes[id].token = token;
+  return id;
+}
+
+void AST::move_locations(SourceLocation first, SourceLocation last, int64_t delta) {
+  for (SourceLocation &location : locations) {
+    if (location.raw >= first.raw && location.raw < last.raw) {
+      location.raw = static_cast<uint32_t>(location.raw + delta);
+    }
+  }
+}
+
+size_t AST::memory_usage() const {
+  return nodes.capacity() * sizeof(ASTNode) + locations.capacity() * sizeof(SourceLocation) +
+         childIDs.capacity() * sizeof(NodeID) + pending.capacity() * sizeof(NodeID);
+}
+
+AST::Position AST::position() const {
+  return {static_cast<uint32_t>(nodes.size()), static_cast<uint32_t>(childIDs.size()),
+          static_cast<uint32_t>(pending.size())};
+}
+
+void AST::reopen() {
+  const ASTNode &root = nodes.back();
+  pending.assign(childIDs.begin() + root.firstChild, childIDs.begin() + root.firstChild + root.childCount);
+  childIDs.resize(root.firstChild);
+  nodes.pop_back();
+  locations.pop_back();
+}
+
+AST AST::split(Position at) {
+  AST tail;
+  tail.append(*this, at);
+  nodes.resize(at.nodes);
+  locations.resize(at.nodes);
+  childIDs.resize(at.children);
+  pending.resize(at.pending);
+  return tail;
+}
+
+void AST::append(const AST &other, Position from) {
+  auto nodeShift = static_cast<uint32_t>(nodes.size()) - from.nodes;
+  auto childShift = static_cast<uint32_t>(childIDs.size()) - from.children;
+  for (auto node = other.nodes.begin() + from.nodes; node != other.nodes.end(); node++) {
+    nodes.push_back(*node);
+    nodes.back().firstChild += childShift;
+  }
+  locations.insert(locations.end(), other.locations.begin() + from.nodes, other.locations.end());
+  for (auto child = other.childIDs.begin() + from.children; child != other.childIDs.end(); child++) {
+    childIDs.push_back(*child + nodeShift);
+  }
+  for (auto id = other.pending.begin() + from.pending; id != other.pending.end(); id++) {
+    pending.push_back(*id + nodeShift);
+  }
+}
+
+class ASTPrinter : public ASTVisitor<ASTPrinter> {
+public:
+  ASTPrinter(const Interner &strings, std::ostream &out) : strings(strings), out(out) {}
+  
+  void visit_translation_unit(const AST &ast, NodeID id) { print(ast, id, "TranslationUnit", ""); }
+  void visit_include(const AST &ast, NodeID id) { print(ast, id, "Include", strings.get(ast[id].value)); }
+  void visit_define(const AST &ast, NodeID id) { print(ast, id, "Define", strings.get(ast[id].value)); }
+  void visit_undef(const AST &ast, NodeID id) { print(ast, id, "Undef", strings.get(ast[id].value)); }
+  void visit_pragma(const AST &ast, NodeID id) { print(ast, id, "Pragma", strings.get(ast[id].value)); }
+  void visit_directive(const AST &ast, NodeID id) { print(ast, id, "Directive", fixed_spelling(ast[id].token)); }
+  void visit_identifier(const AST &ast, NodeID id) { print(ast, id, "Identifier", strings.get(ast[id].value)); }
+  void visit_constant(const AST &ast, NodeID id) { print(ast, id, "Constant", strings.get(ast[id].value)); }
+  void visit_string(const AST &ast, NodeID id) { print(ast, id, "String", strings.get(ast[id].value)); }
+  void visit_unary(const AST &ast, NodeID id) { print(ast, id, "Unary", fixed_spelling(ast[id].token)); }
+  void visit_postfix(const AST &ast, NodeID id) { print(ast, id, "Postfix", fixed_spelling(ast[id].token)); }
+  void visit_binary(const AST &ast, NodeID id) { print(ast, id, "Binary", fixed_spelling(ast[id].token)); }
+  void visit_conditional(const AST &ast, NodeID id) { print(ast, id, "Conditional", ""); }
+  void visit_call(const AST &ast, NodeID id) { print(ast, id, "Call", ""); }
+  void visit_index(const AST &ast, NodeID id) { print(ast, id, "Index", ""); }
+  
+  void visit_member(const AST &ast, NodeID id) {
+    string detail(fixed_spelling(ast[id].token));
+    print(ast, id, "Member", detail + " " + string(strings.get(ast[id].value)));
+  }
+  
+private:
+  const Interner &strings;
+  std::ostream &out;
+  unsigned int depth = 0;
+  
+  void print(const AST &ast, NodeID id, std::string_view kind, std::string_view detail) {
+    out << string(depth * 2, ' ') << kind;
+    if (!detail.empty()) {
+      out << ' ' << detail;
+    }
+    out << '\n';
+    
+    depth++;
+    visit_children(ast, id);
+    depth--;
+  }
+};
+
+void print_ast(const AST &ast, const Interner &strings, std::ostream &out) {
+  if (ast.size()) {
+    ASTPrinter(strings, out).visit(ast, ast.root());
+  }
+}
@@ -0,0 +1,410 @@
+#include "literal.h"
+#include "parser.h"
+
+#include <cstdint>
+
+namespace {
+
+// An integer in an #if expression, which has the range of intmax_t or uintmax_t
+struct Value {
+  uint64_t bits = 0;
+  bool isUnsigned = false;
+
+  [[nodiscard]] int64_t as_signed() const { return static_cast<int64_t>(bits); }
+  [[nodiscard]] bool truth() const { return bits != 0; }
+};
+
+Value boolean(bool truth) {
+  return {truth ? 1u : 0u, false};
+}
+
+// Binding strength of the binary operators, or 0 for any other token
+int precedence(CTokenType type) {
+  switch (type) {
+    case CTokenType::COperatorOr:
+      return 1;
+    case CTokenType::COperatorAnd:
+      return 2;
+    case CTokenType::COperatorBitwiseOr:
+      return 3;
+    case CTokenType::COperatorBitwiseXor:
+      return 4;
+    case CTokenType::COperatorBitwiseAnd:
+      return 5;
+    case CTokenType::COperatorEqual:
+    case CTokenType::COperatorNotEqual:
+      return 6;
+    case CTokenType::COperatorLess:
+    case CTokenType::COperatorGreater:
+    case CTokenType::COperatorLessEqual:
+    case CTokenType::COperatorGreaterEqual:
+      return 7;
+    case CTokenType::COperatorLeftShift:
+    case CTokenType::COperatorRightShift:
+      return 8;
+    case CTokenType::COperatorPlus:
+    case CTokenType::COperatorMinus:
+      return 9;
+    case CTokenType::COperatorMultiply:
+    case CTokenType::COperatorDivide:
+    case CTokenType::COperatorModulo:
+      return 10;
+    default:
+      return 0;
+  }
+}
+
+// Evaluates a macro expanded #if expression. Operands that are not evaluated, such as the right of a false &&,
+// are still parsed, but dividing by zero in them is not an error.
+class ConditionEvaluator {
+public:
+  ConditionEvaluator(const std::vector<CToken> &tokens, const Interner &strings)
+      : p(tokens.data()), end(tokens.data() + tokens.size()), strings(strings) {}
+
+  bool evaluate() {
+    Value value = conditional();
+    if (p != end) {
+      throw std::runtime_error("Unexpected " + string(p->getSpelling(strings)) + " in preprocessor expression");
+    }
+    return value.truth();
+  }
+
+private:
+  const CToken *p;
+  const CToken *end;
+  const Interner &strings;
+
+  // whether the operand being parsed is evaluated
+  bool live = true;
+
+  [[nodiscard]] bool at(CTokenType type) const { return p != end && p->type == type; }
+
+  void expect(CTokenType type) {
+    if (!at(type)) {
+      throw std::runtime_error("Expected " + string(fixed_spelling(type)) + " in preprocessor expression");
+    }
+    p++;
+  }
+
+  Value conditional() {
+    Value condition = binary(1);
+    if (!at(CTokenType::CPunctuationQuestionMark)) {
+      return condition;
+    }
+    p++;
+
+    bool outer = live;
+    live = outer && condition.truth();
+    Value then = conditional();
+    expect(CTokenType::CPunctuationColon);
+    live = outer && !condition.truth();
+    Value otherwise = conditional();
+    live = outer;
+
+    Value result = condition.truth() ? then : otherwise;
+    result.isUnsigned = then.isUnsigned || otherwise.isUnsigned;
+    return result;
+  }
+
+  // Parses operators binding at least as tightly as minimum, left to right
+  Value binary(int minimum) {
+    Value lhs = unary();
+    while (p != end) {
+      CTokenType op = p->type;
+      int level = precedence(op);
+      if (level < minimum || level == 0) {
+        return lhs;
+      }
+      p++;
+
+      if (op == CTokenType::COperatorAnd || op == CTokenType::COperatorOr) {
+        bool decided = op == CTokenType::COperatorAnd ? !lhs.truth() : lhs.truth();
+        bool outer = live;
+        live = outer && !decided;
+        Value rhs = binary(level + 1);
+        live = outer;
+        lhs = boolean(decided ? lhs.truth() : rhs.truth());
+      } else {
+        lhs = apply(op, lhs, binary(level + 1));
+      }
+    }
+    return lhs;
+  }
+
+  Value apply(CTokenType op, Value a, Value b) const {
+    // the usual arithmetic conversions, except for shifts, whose result has the type of the left operand
+    bool isUnsigned = a.isUnsigned || b.isUnsigned;
+    uint64_t x = a.bits;
+    uint64_t y = b.bits;
+
+    switch (op) {
+      case CTokenType::COperatorMultiply:
+        return {x * y, isUnsigned};
+      case CTokenType::COperatorDivide:
+      case CTokenType::COperatorModulo: {
+        bool divide = op == CTokenType::COperatorDivide;
+        if (y == 0) {
+          if (live) {
+            throw std::runtime_error("Division by zero in preprocessor expression");
+          }
+          return {0, isUnsigned};
+        }
+        if (isUnsigned) {
+          return {divide ? x / y : x % y, true};
+        }
+        if (a.as_signed() == INT64_MIN && b.as_signed() == -1) {
+          return {divide ? x : 0, false};
+        }
+        int64_t result = divide ? a.as_signed() / b.as_signed() : a.as_signed() % b.as_signed();
+        return {static_cast<uint64_t>(result), false};
+      }
+      case CTokenType::COperatorPlus:
+        return {x + y, isUnsigned};
+      case CTokenType::COperatorMinus:
+        return {x - y, isUnsigned};
+      case CTokenType::COperatorLeftShift:
+        return {y >= 64 ? 0 : x << y, a.isUnsigned};
+      case CTokenType::COperatorRightShift:
+        if (a.isUnsigned) {
+          return {y >= 64 ? 0 : x >> y, true};
+        }
+        return {static_cast<uint64_t>(a.as_signed() >> (y >= 64 ? 63 : y)), false};
+      case CTokenType::COperatorLess:
+        return boolean(isUnsigned ? x < y : a.as_signed() < b.as_signed());
+      case CTokenType::COperatorGreater:
+        return boolean(isUnsigned ? x > y : a.as_signed() > b.as_signed());
+      case CTokenType::COperatorLessEqual:
+        return boolean(isUnsigned ? x <= y : a.as_signed() <= b.as_signed());
+      case CTokenType::COperatorGreaterEqual:
+        return boolean(isUnsigned ? x >= y : a.as_signed() >= b.as_signed());
+      case CTokenType::COperatorEqual:
+        return boolean(x == y);
+      case CTokenType::COperatorNotEqual:
+        return boolean(x != y);
+      case CTokenType::COperatorBitwiseAnd:
+        return {x & y, isUnsigned};
+      case CTokenType::COperatorBitwiseXor:
+        return {x ^ y, isUnsigned};
+      case CTokenType::COperatorBitwiseOr:
+        return {x | y, isUnsigned};
+      default:  // should never happen
+        throw std::runtime_error("Invalid operator in preprocessor expression");
+    }
+  }
+
+  Value unary() {
+    if (p == end) {
+      throw std::runtime_error("Missing operand in preprocessor expression");
+    }
+    switch (p->type) {
+      case CTokenType::COperatorPlus:
+        p++;
+        return unary();
+      case CTokenType::COperatorMinus: {
+        p++;
+        Value value = unary();
+        return {0 - value.bits, value.isUnsigned};
+      }
+      case CTokenType::COperatorBitwiseNot: {
+        p++;
+        Value value = unary();
+        return {~value.bits, value.isUnsigned};
+      }
+      case CTokenType::COperatorNot:
+        p++;
+        return boolean(!unary().truth());
+      default:
+        return primary();
+    }
+  }
+
+  Value primary() {
+    const CToken &token = *p++;
+    switch (token.type) {
+      case CTokenType::CPunctuationOpenParen: {
+        Value value = conditional();
+        expect(CTokenType::CPunctuationCloseParen);
+        return value;
+      }
+      case CTokenType::CConstantInteger:
+        return integer(token);
+      case CTokenType::CConstantChar: {
+        int32_t value = decode_char(strings.get(token.value), token.flags & CToken::has_escapes);
+        return {static_cast<uint64_t>(static_cast<int64_t>(value)), false};
+      }
+      default:
+        // identifiers and keywords left over once macros are expanded are 0
+        if (token.type <= CTokenType::CIdentifier) {
+          return {};
+        }
+        throw std::runtime_error("Unexpected " + string(token.getSpelling(strings)) + " in preprocessor expression");
+    }
+  }
+
+  // The constant's value was decoded when it was lexed. Whatever its C type, it has the range of intmax_t here,
+  // so only a u suffix or a value too large for intmax_t makes it unsigned.
+  Value integer(const CToken &token) const {
+    const Number &number = strings.number(token.value);
+    if (number.error == Number::Error::TooLarge) {
+      throw std::runtime_error("Integer constant too large in preprocessor expression: " +
+                               string(strings.get(token.value)));
+    } else if (!number.valid()) {
+      throw std::runtime_error("Invalid integer constant in preprocessor expression: " +
+                               string(strings.get(token.value)));
+    }
+    return {number.integer, number.unsignedSuffix || number.integer > INT64_MAX};
+  }
+};
+
+} // namespace
+
+bool Parser::evaluate_condition() {
+  // `defined X` and `defined ( X )` are answered before the line is expanded, so X itself is never expanded
+  Symbol definedName = strings.intern("defined");
+  size_t kept = 0;
+  for (size_t i = 0; i < directiveLine.size(); i++) {
+    CToken word = directiveLine[i];
+    if (word.type == CTokenType::CIdentifier && word.value == definedName) {
+      bool parenthesized = i + 1 < directiveLine.size() &&
+                           directiveLine[i + 1].type == CTokenType::CPunctuationOpenParen;
+      size_t nameIndex = i + 1 + parenthesized;
+      if (nameIndex >= directiveLine.size() || directiveLine[nameIndex].type > CTokenType::CIdentifier) {
+        throw std::runtime_error("Macro name missing after defined");
+      }
+      if (parenthesized && (nameIndex + 1 >= directiveLine.size() ||
+                            directiveLine[nameIndex + 1].type != CTokenType::CPunctuationCloseParen)) {
+        throw std::runtime_error("Missing ')' after defined");
+      }
+
+      Symbol name = macro_name(directiveLine[nameIndex]);
+      bool isDefined = name != Interner::none && macros.defined(name);
+      word = CToken(CTokenType::CConstantInteger, strings.intern_number(isDefined ? "1" : "0"), word.location);
+      i = nameIndex + parenthesized;
+    }
+    directiveLine[kept++] = word;
+  }
+  directiveLine.resize(kept);
+
+  condition.clear();
+  expand_argument(directiveLine.data(), directiveLine.data() + directiveLine.size(), condition);
+  if (condition.empty()) {
+    throw std::runtime_error("Missing expression in conditional directive");
+  }
+  return ConditionEvaluator(condition, strings).evaluate();
+}
+
+CToken Parser::skip_group(CToken first) {
+  unsigned int depth = 0;
+  CToken skipped = first;
+  while (true) {
+    if (skipped.type == CTokenType::CEndOfFile) {
+      return skipped;
+    }
+
+    // tokens already read are looked at one by one, and the rest of the group is left to the file's lexer
+    if ((skipped.flags & CToken::start_of_line) && skipped.hideset == HideSets::empty) {
+      switch (skipped.type) {
+        case CTokenType::CPreprocessorIf:
+        case CTokenType::CPreprocessorIfdef:
+        case CTokenType::CPreprocessorIfndef:
+          depth++;
+          break;
+        case CTokenType::CPreprocessorElif:
+        case CTokenType::CPreprocessorElse:
+          if (depth == 0) {
+            return skipped;
+          }
+          break;
+        case CTokenType::CPreprocessorEndif:
+          if (depth == 0) {
+            return skipped;
+          }
+          depth--;
+          break;
+        default:
+          break;
+      }
+    }
+
+    if (pending.size() > pendingFloor) {
+      skipped = pending.back();
+      pending.pop_back();
+    } else {
+      skipped = includes.back().skip_inactive();
+    }
+  }
+}
+
+NodeID Parser::parse_conditional(AST &ast) {
+  NodeID id = ast.add_directive(token.type, token.location);
+  CTokenType directive = token.type;
+  string spelling(fixed_spelling(directive));
+
+  // the conditional is opened or closed before its line is read, which may run into the end of the file
+  std::vector<IncludeFrame::Conditional> &conditionals = includes.back().conditionals;
+  if (directive == CTokenType::CPreprocessorIf || directive == CTokenType::CPreprocessorIfdef ||
+      directive == CTokenType::CPreprocessorIfndef) {
+    conditionals.emplace_back();
+  } else if (conditionals.empty()) {
+    throw std::runtime_error(spelling + " without #if");
+  } else if (directive == CTokenType::CPreprocessorEndif) {
+    conditionals.pop_back();
+    end_directive(read_line());
+    return id;
+  } else if (conditionals.back().sawElse) {
+    throw std::runtime_error(spelling + " after #else");
+  } else {
+    conditionals.back().sawElse = directive == CTokenType::CPreprocessorElse;
+  }
+
+  CToken lineEnd = read_line();
+  bool taken = false;
+  switch (directive) {
+    case CTokenType::CPreprocessorIf:
+      taken = evaluate_condition();
+      break;
+    case CTokenType::CPreprocessorIfdef:
+    case CTokenType::CPreprocessorIfndef: {
+      if (directiveLine.empty() || directiveLine[0].type > CTokenType::CIdentifier) {
+        throw std::runtime_error("Macro name missing in " + spelling);
+      }
+      Symbol name = macro_name(directiveLine[0]);
+      bool isDefined = name != Interner::none && macros.defined(name);
+      taken = isDefined == (directive == CTokenType::CPreprocessorIfdef);
+      break;
+    }
+    default:
+      // reached at the end of a group that was read, so the rest of the conditional is skipped
+      break;
+  }
+
+  while (!taken) {
+    CToken end = skip_group(lineEnd);
+    if (end.type == CTokenType::CEndOfFile) {
+      throw std::runtime_error("Unterminated conditional directive in " + includes.back().filename);
+    }
+    ast.add_directive(end.type, end.location);
+
+    IncludeFrame::Conditional &open = includes.back().conditionals.back();
+    if (end.type == CTokenType::CPreprocessorEndif) {
+      includes.back().conditionals.pop_back();
+      lineEnd = read_line();
+      break;
+    }
+    if (open.sawElse) {
+      throw std::runtime_error(string(fixed_spelling(end.type)) + " after #else");
+    }
+    open.sawElse = end.type == CTokenType::CPreprocessorElse;
+
+    // an #elif is only evaluated if no group before it was taken
+    bool wanted = !open.taken;
+    lineEnd = read_line();
+    taken = wanted && (end.type == CTokenType::CPreprocessorElse || evaluate_condition());
+  }
+
+  if (taken) {
+    includes.back().conditionals.back().taken = true;
+  }
+  end_directive(lineEnd);
+  return id;
+}
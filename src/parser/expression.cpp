@@ -0,0 +1,270 @@
+#include "parser.h"
+
+#include <array>
+
+// Expressions are parsed by precedence climbing, with a table of binding powers by token type in place of a
+// function for each level of C's grammar. Operators waiting for their right operand are kept on a stack rather
+// than in nested calls, so a primary expression costs one call however many levels there are, and the depth of
+// the call stack only grows with parentheses and the like.
+
+namespace {
+
+// C's binary operators from loosest to tightest, then the prefix operators
+enum Level : uint8_t {
+  Comma = 1,
+  Assignment,
+  Conditional,
+  LogicalOr,
+  LogicalAnd,
+  BitwiseOr,
+  BitwiseXor,
+  BitwiseAnd,
+  Equality,
+  Relational,
+  Shift,
+  Additive,
+  Multiplicative,
+  Prefix,
+};
+
+// How tightly an operator holds the operand on each side. An operand between two operators goes to the one on
+// the left if its right power is greater than the left power of the one on the right, so an operator whose right
+// power is one more than its left groups left to right, and one whose powers are equal groups right to left.
+struct Binding {
+  uint8_t left = 0;
+  uint8_t right = 0;
+};
+
+constexpr Binding left_to_right(Level level) {
+  return {static_cast<uint8_t>(2 * level), static_cast<uint8_t>(2 * level + 1)};
+}
+
+constexpr Binding right_to_left(Level level) {
+  return {static_cast<uint8_t>(2 * level), static_cast<uint8_t>(2 * level)};
+}
+
+// The binding powers of the binary operators, ?: and the comma operator, and 0 for any other token
+constexpr std::array<Binding, 256> infix_bindings() {
+  std::array<Binding, 256> table{};
+  auto set = [&table](CTokenType type, Binding binding) { table[static_cast<uint8_t>(type)] = binding; };
+
+  set(CTokenType::CPunctuationComma, left_to_right(Comma));
+  for (auto type : {CTokenType::COperatorAssignment, CTokenType::COperatorPlusAssign,
+                    CTokenType::COperatorMinusAssign, CTokenType::COperatorMultiplyAssign,
+                    CTokenType::COperatorDivideAssign, CTokenType::COperatorModuloAssign,
+                    CTokenType::COperatorAndAssign, CTokenType::COperatorOrAssign, CTokenType::COperatorXorAssign,
+                    CTokenType::COperatorLeftShiftAssign, CTokenType::COperatorRightShiftAssign}) {
+    set(type, right_to_left(Assignment));
+  }
+  set(CTokenType::CPunctuationQuestionMark, right_to_left(Conditional));
+  set(CTokenType::COperatorOr, left_to_right(LogicalOr));
+  set(CTokenType::COperatorAnd, left_to_right(LogicalAnd));
+  set(CTokenType::COperatorBitwiseOr, left_to_right(BitwiseOr));
+  set(CTokenType::COperatorBitwiseXor, left_to_right(BitwiseXor));
+  set(CTokenType::COperatorBitwiseAnd, left_to_right(BitwiseAnd));
+  set(CTokenType::COperatorEqual, left_to_right(Equality));
+  set(CTokenType::COperatorNotEqual, left_to_right(Equality));
+  for (auto type : {CTokenType::COperatorLess, CTokenType::COperatorGreater, CTokenType::COperatorLessEqual,
+                    CTokenType::COperatorGreaterEqual}) {
+    set(type, left_to_right(Relational));
+  }
+  set(CTokenType::COperatorLeftShift, left_to_right(Shift));
+  set(CTokenType::COperatorRightShift, left_to_right(Shift));
+  set(CTokenType::COperatorPlus, left_to_right(Additive));
+  set(CTokenType::COperatorMinus, left_to_right(Additive));
+  set(CTokenType::COperatorMultiply, left_to_right(Multiplicative));
+  set(CTokenType::COperatorDivide, left_to_right(Multiplicative));
+  set(CTokenType::COperatorModulo, left_to_right(Multiplicative));
+  return table;
+}
+
+constexpr std::array<Binding, 256> infix = infix_bindings();
+
+// The least left power of the operators in a full expression, and in an assignment expression, which leaves out
+// the comma operator so commas can separate arguments
+constexpr uint8_t full_expression = left_to_right(Comma).left;
+constexpr uint8_t assignment_expression = right_to_left(Assignment).left;
+
+// Every prefix operator holds its operand more tightly than any binary operator. Postfix operators hold theirs
+// more tightly still, and are applied as soon as the operand is read.
+constexpr uint8_t prefix_power = 2 * Prefix;
+
+bool is_prefix(CTokenType type) {
+  switch (type) {
+    case CTokenType::COperatorPlus:
+    case CTokenType::COperatorMinus:
+    case CTokenType::COperatorNot:
+    case CTokenType::COperatorBitwiseNot:
+    case CTokenType::COperatorMultiply:
+    case CTokenType::COperatorBitwiseAnd:
+    case CTokenType::COperatorIncrement:
+    case CTokenType::COperatorDecrement:
+    case CTokenType::CKeywordSizeof:
+      return true;
+    default:
+      return false;
+  }
+}
+
+} // namespace
+
+NodeID Parser::parse_expression(AST &ast) {
+  while (at_directive()) {
+    parse_preprocessor(ast);
+  }
+
+  operators.clear();
+  heldDirectives = AST();
+  parse_operators(ast, full_expression, 0);
+  NodeID expression = ast.root();
+  if (heldDirectives.size()) {
+    ast.append(heldDirectives, {});
+  }
+  return expression;
+}
+
+void Parser::advance() {
+  if (tokenHasher) {
+    tokenHasher->add(token, strings, sources);
+  }
+  next();
+  while (at_directive()) {
+    parse_preprocessor(heldDirectives);
+  }
+}
+
+void Parser::expect_in_expression(CTokenType type) {
+  if (token.type != type) {
+    throw std::runtime_error("Expected " + string(fixed_spelling(type)) + " in expression");
+  }
+  advance();
+}
+
+void Parser::parse_operators(AST &ast, uint8_t minimum, unsigned depth) {
+  if (depth > max_expression_depth) {
+    throw std::runtime_error("Expression nested too deeply");
+  }
+
+  size_t base = operators.size();
+  while (true) {
+    // prefix operators each wait for the operand after them, so they all start where it does
+    auto start = static_cast<uint32_t>(ast.mark());
+    SourceLocation at = token.location;
+    while (is_prefix(token.type)) {
+      operators.push_back({token.type, ASTKind::Unary, prefix_power, start, token.location});
+      advance();
+    }
+    parse_postfix(ast, depth);
+
+    // operators holding the operand more tightly than the one after it take it, which makes them the operand
+    CTokenType op = token.type;
+    Binding binding = infix[static_cast<uint8_t>(op)];
+    uint8_t left = binding.left >= minimum ? binding.left : 0;
+    while (operators.size() > base && operators.back().right > left) {
+      const PendingOperator &pending = operators.back();
+      ast.add(pending.kind, pending.op, Interner::none, pending.at, pending.start);
+      at = pending.at;
+      operators.pop_back();
+    }
+    if (left == 0) {
+      return;
+    }
+
+    // the left operand is the last node waiting for a parent
+    start = static_cast<uint32_t>(ast.mark() - 1);
+    advance();
+    if (op == CTokenType::CPunctuationQuestionMark) {
+      parse_operators(ast, full_expression, depth + 1);
+      expect_in_expression(CTokenType::CPunctuationColon);
+      operators.push_back({op, ASTKind::Conditional, binding.right, start, at});
+    } else {
+      operators.push_back({op, ASTKind::Binary, binding.right, start, at});
+    }
+  }
+}
+
+void Parser::parse_postfix(AST &ast, unsigned depth) {
+  size_t start = ast.mark();
+  SourceLocation at = token.location;
+
+  switch (token.type) {
+    case CTokenType::CIdentifier:
+      ast.add(ASTKind::Identifier, token.value, at);
+      advance();
+      break;
+    case CTokenType::CConstantInteger:
+    case CTokenType::CConstantFloat:
+    case CTokenType::CConstantChar:
+      ast.add(ASTKind::Constant, token.type, token.value, at, start);
+      advance();
+      break;
+    case CTokenType::CConstantString: {
+      // adjacent literals are one string, which keeps each of them
+      ast.add(ASTKind::String, token.value, at);
+      advance();
+      if (token.type != CTokenType::CConstantString) {
+        break;
+      }
+      while (token.type == CTokenType::CConstantString) {
+        ast.add(ASTKind::String, token.value, token.location);
+        advance();
+      }
+      ast.add(ASTKind::String, Interner::none, at, start);
+      break;
+    }
+    case CTokenType::CPunctuationOpenParen:
+      advance();
+      parse_operators(ast, full_expression, depth + 1);
+      expect_in_expression(CTokenType::CPunctuationCloseParen);
+      break;
+    case CTokenType::CEndOfFile:
+      throw std::runtime_error("Unexpected end of file in expression");
+    default:
+      throw std::runtime_error("Unexpected " + string(token.getSpelling(strings)) + " in expression");
+  }
+
+  while (true) {
+    CTokenType op = token.type;
+    switch (op) {
+      case CTokenType::CPunctuationOpenBracket:
+        advance();
+        parse_operators(ast, full_expression, depth + 1);
+        expect_in_expression(CTokenType::CPunctuationCloseBracket);
+        ast.add(ASTKind::Index, op, Interner::none, at, start);
+        break;
+      case CTokenType::CPunctuationOpenParen:
+        // the arguments are assignment expressions, as commas separate them
+        advance();
+        if (token.type != CTokenType::CPunctuationCloseParen) {
+          while (true) {
+            parse_operators(ast, assignment_expression, depth + 1);
+            if (token.type != CTokenType::CPunctuationComma) {
+              break;
+            }
+            advance();
+          }
+        }
+        expect_in_expression(CTokenType::CPunctuationCloseParen);
+        ast.add(ASTKind::Call, op, Interner::none, at, start);
+        break;
+      case CTokenType::CPunctuationDot:
+      case CTokenType::CPunctuationArrow: {
+        advance();
+        if (token.type != CTokenType::CIdentifier) {
+          throw std::runtime_error("Expected member name after " + string(fixed_spelling(op)));
+        }
+        Symbol member = token.value;
+        advance();
+        ast.add(ASTKind::Member, op, member, at, start);
+        break;
+      }
+      case CTokenType::COperatorIncrement:
+      case CTokenType::COperatorDecrement:
+        advance();
+        ast.add(ASTKind::Postfix, op, Interner::none, at, start);
+        break;
+      default:
+        return;
+    }
+  }
+}
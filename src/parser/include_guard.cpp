@@ -0,0 +1,55 @@
+#include "include_guard.h"
+
+void GuardDetector::observe(const CToken &token) {
+  switch (state) {
+    case State::Start:
+      state = token.type == CTokenType::CPreprocessorIfndef ? State::Ifndef : State::NotGuarded;
+      break;
+
+    case State::Ifndef:
+      if (token.type == CTokenType::CIdentifier) {
+        macro = token.value;
+        depth = 1;
+        state = State::Inside;
+      } else {
+        state = State::NotGuarded;
+      }
+      break;
+
+    case State::Inside:
+      switch (token.type) {
+        case CTokenType::CPreprocessorIf:
+        case CTokenType::CPreprocessorIfdef:
+        case CTokenType::CPreprocessorIfndef:
+          depth++;
+          break;
+        case CTokenType::CPreprocessorElif:
+        case CTokenType::CPreprocessorElse:
+          // an #else of the guard itself means part of the file is read even when the guard is defined
+          if (depth == 1) {
+            state = State::NotGuarded;
+          }
+          break;
+        case CTokenType::CPreprocessorEndif:
+          if (--depth == 0) {
+            state = State::Closed;
+          }
+          break;
+        case CTokenType::CEndOfFile:
+          state = State::NotGuarded;
+          break;
+        default:
+          break;
+      }
+      break;
+
+    case State::Closed:
+      if (token.type != CTokenType::CEndOfFile) {
+        state = State::NotGuarded;
+      }
+      break;
+
+    case State::NotGuarded:
+      break;
+  }
+}
@@ -0,0 +1,229 @@
+#include "incremental.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+// Headers are replayed from token buffers when the file is parsed again, and there is no pipe to restart
+static shared_ptr<Options> incremental_options(const Options &options) {
+  auto copy = std::make_shared<Options>(options);
+  copy->buffer_tokens = true;
+  copy->pipeline_lexing = false;
+  return copy;
+}
+
+IncrementalParser::IncrementalParser(const string &filename, std::string_view text, shared_ptr<Options> options)
+    : parser(new Parser(incremental_options(*options))), source(SourceBuffer::from_text(text, filename)) {
+  buffer = TokenBuffer::lex(*source, parser->strings);
+  checkpoints.push_back(save(0));
+  reparse(0, buffer->size(), 0, false);
+  work.tokensLexed = buffer->size();
+}
+
+IncrementalParser::Checkpoint IncrementalParser::save(size_t token) const {
+  const Parser &p = *parser;
+  return {token,
+          ast.position(),
+          p.macros,
+          p.keywordMacros,
+          p.includeGuards,
+          p.onceFiles,
+          p.includes.empty() ? std::vector<Parser::IncludeFrame::Conditional>() : p.includes.back().conditionals};
+}
+
+void IncrementalParser::restore(const Checkpoint &checkpoint) {
+  Parser &p = *parser;
+  p.includes.clear();
+  p.activeFiles.clear();
+  p.pending.clear();
+  p.pendingFloor = 0;
+  p.isolated = false;
+  p.expansionDepth = 0;
+  p.pipeWaiting = false;
+  p.macros = checkpoint.macros;
+  p.keywordMacros = checkpoint.keywordMacros;
+  p.includeGuards = checkpoint.includeGuards;
+  p.onceFiles = checkpoint.onceFiles;
+
+  p.push_file(*source, buffer.get());
+  Parser::IncludeFrame &frame = p.includes.back();
+  frame.conditionals = checkpoint.conditionals;
+  frame.reader->seek(checkpoint.token);
+  if (checkpoint.token == 0) {
+    p.next();
+  } else {
+    // a directive is never expanded, and the frame has already seen it
+    p.token = frame.reader->next();
+  }
+}
+
+bool IncrementalParser::same_state(const Checkpoint &checkpoint) const {
+  const Parser &p = *parser;
+  const auto &conditionals = p.includes.back().conditionals;
+  return p.keywordMacros == checkpoint.keywordMacros && p.includeGuards == checkpoint.includeGuards &&
+         p.onceFiles == checkpoint.onceFiles &&
+         std::equal(conditionals.begin(), conditionals.end(), checkpoint.conditionals.begin(),
+                    checkpoint.conditionals.end(),
+                    [](const auto &a, const auto &b) { return a.taken == b.taken && a.sawElse == b.sawElse; }) &&
+         p.macros.same_definitions(checkpoint.macros);
+}
+
+void IncrementalParser::apply(const std::vector<TextEdit> &edits) {
+  TRACE_SCOPE("Reparse", source->filename);
+  work = {};
+
+  // the tokens the edits replaced, which were [first, end - shift) before them and are [first, end) now
+  size_t first = SIZE_MAX;
+  size_t end = 0;
+  std::ptrdiff_t shift = 0;
+  bool directives = false;
+  bool linesMoved = false;
+
+  for (const TextEdit &edit : edits) {
+    if (edit.offset > source->size() || edit.removed > source->size() - edit.offset) {
+      throw std::runtime_error("Edit outside of " + source->filename);
+    }
+    const char *removed = source->begin() + edit.offset;
+    linesMoved |=
+        std::count(removed, removed + edit.removed, '\n') != std::count(edit.text.begin(), edit.text.end(), '\n');
+
+    auto edited = SourceBuffer::from_edit(*source, edit.offset, edit.removed, edit.text);
+    TokenBuffer::Damage damage = buffer->relex(*edited, edit.offset, edit.removed,
+                                               static_cast<uint32_t>(edit.text.size()), parser->strings);
+
+    // nodes after the edit move with the text, and all of them with the file if it needs a larger range. Those
+    // in the text it replaced are parsed again.
+    SourceLocation was = parser->sources.start_of(*source);
+    SourceLocation now = parser->sources.replace(*source, *edited);
+    auto moved = static_cast<int64_t>(now.raw) - was.raw;
+    auto grown = static_cast<int64_t>(edit.text.size()) - edit.removed;
+    ast.move_locations(was + edit.offset + edit.removed, was + static_cast<uint32_t>(source->size() + 1),
+                       moved + grown);
+    if (moved) {
+      ast.move_locations(was, was + edit.offset, moved);
+    }
+    source = std::move(edited);
+    work.tokensLexed += damage.inserted;
+    directives |= damage.directives;
+
+    auto change = static_cast<std::ptrdiff_t>(damage.inserted) - static_cast<std::ptrdiff_t>(damage.removed);
+    if (first == SIZE_MAX) {
+      first = damage.first;
+      end = damage.first + damage.inserted;
+    } else {
+      // the tokens changed before move with this edit, unless it replaced them
+      if (end >= damage.first + damage.removed) {
+        end = static_cast<size_t>(static_cast<std::ptrdiff_t>(end) + change);
+      }
+      end = std::max(end, damage.first + damage.inserted);
+      first = std::min(first, damage.first);
+    }
+    shift += change;
+  }
+  if (first == SIZE_MAX) {
+    return;
+  }
+
+  // a directive's line runs to the start of the next, so a change anywhere on its line changes the directive
+  size_t lineStart = std::min(first, buffer->size() - 1);
+  while (lineStart > 0 && !(buffer->flags(lineStart) & CToken::start_of_line)) {
+    lineStart--;
+  }
+  directives |= buffer->is_directive(lineStart);
+
+  // __LINE__ gives a different answer once lines have moved, and where it was used is not tracked
+  bool lineDependent = linesMoved && parser->expandedLine;
+
+  if (complete && !directives && !lineDependent) {
+    // code between directives adds nothing to the tree and leaves the preprocessor as it was
+    for (Checkpoint &checkpoint : checkpoints) {
+      if (checkpoint.token != 0 && checkpoint.token >= first) {
+        checkpoint.token += shift;
+      }
+    }
+    return;
+  }
+
+  reparse(first, end, shift, complete && !lineDependent);
+}
+
+void IncrementalParser::reparse(size_t first, size_t end, std::ptrdiff_t shift, bool resync) {
+  // the last saved state from before the change, which the change cannot have affected
+  size_t resume = 0;
+  while (resume + 1 < checkpoints.size() && checkpoints[resume + 1].token < first) {
+    resume++;
+  }
+  size_t startToken = checkpoints[resume].token;
+
+  // the rest of the previous tree, and the states it was parsed from, to pick up from if the parser catches up
+  if (complete) {
+    ast.reopen();
+  }
+  AST::Position base = checkpoints[resume].tree;
+  AST tail = ast.split(base);
+  std::vector<Checkpoint> previous(std::make_move_iterator(checkpoints.begin() + resume + 1),
+                                   std::make_move_iterator(checkpoints.end()));
+  checkpoints.resize(resume + 1);
+  if (!resync) {
+    previous.clear();
+  }
+  auto next = previous.begin();
+
+  complete = false;
+  restore(checkpoints[resume]);
+  Parser &p = *parser;
+  size_t lastSaved = startToken;
+  bool entered = false;
+
+  while (true) {
+    if (p.token.type == CTokenType::CEndOfFile) {
+      work.tokensParsed = buffer->size() - startToken;
+      ast.add(ASTKind::TranslationUnit, Interner::none, SourceLocation(), 0);
+      complete = true;
+      return;
+    }
+
+    if (p.includes.size() == 1 && p.pending.empty() && p.at_directive()) {
+      size_t at = p.includes.back().reader->position() - 1;
+      if (at > startToken) {
+        // caught up with the previous parse, so the rest of its tree is still right
+        while (at >= end && next != previous.end() && next->token + shift < at) {
+          next++;
+        }
+        if (at >= end && next != previous.end() && next->token + shift == at && same_state(*next)) {
+          AST::Position from{next->tree.nodes - base.nodes, next->tree.children - base.children,
+                             next->tree.pending - base.pending};
+          AST::Position here = ast.position();
+          AST::Position was = next->tree;
+          ast.append(tail, from);
+          for (auto kept = next; kept != previous.end(); kept++) {
+            kept->token += shift;
+            kept->tree = {here.nodes + kept->tree.nodes - was.nodes, here.children + kept->tree.children - was.children,
+                          here.pending + kept->tree.pending - was.pending};
+          }
+          checkpoints.insert(checkpoints.end(), std::make_move_iterator(next),
+                             std::make_move_iterator(previous.end()));
+          work.tokensParsed = at - startToken;
+          work.reused = true;
+          ast.add(ASTKind::TranslationUnit, Interner::none, SourceLocation(), 0);
+          complete = true;
+          return;
+        }
+
+        // a header is costly to read again, so the state after one is worth saving
+        if (entered || at - lastSaved >= checkpoint_interval) {
+          checkpoints.push_back(save(at));
+          lastSaved = at;
+          entered = false;
+        }
+      }
+    }
+
+    if (p.at_directive()) {
+      p.parse_preprocessor(ast);
+    } else {
+      p.next();
+    }
+    entered |= p.includes.size() > 1;
+  }
+}
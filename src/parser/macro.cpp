@@ -0,0 +1,160 @@
+#include "macro.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+MacroTable::MacroTable() : slots(256) {}
+
+size_t MacroTable::slot_of(Symbol name) const {
+  size_t mask = slots.size() - 1;
+  size_t i = (name * 0x9E3779B1u) & mask;
+  while (slots[i].name != name && slots[i].name != Interner::none) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+const Macro *MacroTable::find(Symbol name) const {
+  const Slot &slot = slots[slot_of(name)];
+  return slot.name == name && slot.macro != undefined ? &macros[slot.macro] : nullptr;
+}
+
+void MacroTable::grow() {
+  std::vector<Slot> old(slots.size() * 2);
+  old.swap(slots);
+  for (const Slot &slot : old) {
+    if (slot.name != Interner::none) {
+      slots[slot_of(slot.name)] = slot;
+    }
+  }
+}
+
+void MacroTable::define(Macro macro, const std::vector<Symbol> &params, const std::vector<CToken> &tokens) {
+  // kept at most half full, so probe sequences stay short
+  if ((used + 1) * 2 > slots.size()) {
+    grow();
+  }
+  
+  macro.paramCount = static_cast<uint32_t>(params.size());
+  macro.firstParam = static_cast<uint32_t>(parameters.size());
+  parameters.insert(parameters.end(), params.begin(), params.end());
+  macro.tokenCount = static_cast<uint32_t>(tokens.size());
+  macro.firstToken = static_cast<uint32_t>(replacement.size());
+  replacement.insert(replacement.end(), tokens.begin(), tokens.end());
+  
+  Slot &slot = slots[slot_of(macro.name)];
+  if (slot.name == Interner::none) {
+    slot.name = macro.name;
+    used++;
+  }
+  slot.macro = static_cast<uint32_t>(macros.size());
+  macros.push_back(macro);
+}
+
+void MacroTable::undefine(Symbol name) {
+  Slot &slot = slots[slot_of(name)];
+  if (slot.name == name) {
+    slot.macro = undefined;
+  }
+}
+
+bool MacroTable::same_definitions(const MacroTable &other) const {
+  size_t count = 0;
+  bool same = true;
+  for_each([&](const Macro &macro) {
+    count++;
+    const Macro *theirs = other.find(macro.name);
+    if (!same || !theirs || theirs->functionLike != macro.functionLike || theirs->variadic != macro.variadic ||
+        theirs->builtin != macro.builtin || theirs->paramCount != macro.paramCount ||
+        theirs->tokenCount != macro.tokenCount) {
+      same = false;
+      return;
+    }
+    same = std::equal(params(macro), params(macro) + macro.paramCount, other.params(*theirs)) &&
+           std::equal(tokens(macro), tokens(macro) + macro.tokenCount, other.tokens(*theirs),
+                      [](const CToken &a, const CToken &b) {
+                        return a.type == b.type && a.flags == b.flags && a.value == b.value &&
+                               a.hideset == b.hideset;
+                      });
+  });
+  if (!same) {
+    return false;
+  }
+  other.for_each([&](const Macro &) { count--; });
+  return count == 0;
+}
+
+HideSets::HideSets() : starts{0, 0} {
+  ids.emplace(std::string(), empty);
+}
+
+bool HideSets::contains(ID set, Symbol macro) const {
+  if (set == empty) {
+    return false;
+  }
+  auto first = members.begin() + starts[set];
+  auto last = members.begin() + starts[set + 1];
+  return std::binary_search(first, last, macro);
+}
+
+HideSets::ID HideSets::intern(const std::vector<Symbol> &sorted) {
+  std::string key(reinterpret_cast<const char *>(sorted.data()), sorted.size() * sizeof(Symbol));
+  auto [it, inserted] = ids.try_emplace(std::move(key), static_cast<ID>(starts.size() - 1));
+  if (inserted) {
+    if (members.size() + sorted.size() > UINT32_MAX) {
+      ids.erase(it);
+      throw std::runtime_error("Too many distinct macro expansion contexts");
+    }
+    members.insert(members.end(), sorted.begin(), sorted.end());
+    starts.push_back(static_cast<uint32_t>(members.size()));
+  }
+  return it->second;
+}
+
+template <typename Combine>
+HideSets::ID HideSets::remember(Operation operation, uint32_t a, uint32_t b, Combine combine) {
+  std::unordered_map<uint64_t, ID> &operationResults = results[static_cast<int>(operation)];
+  uint64_t key = static_cast<uint64_t>(a) << 32 | b;
+  if (auto it = operationResults.find(key); it != operationResults.end()) {
+    return it->second;
+  }
+  scratch.clear();
+  combine();
+  ID id = intern(scratch);
+  operationResults.emplace(key, id);
+  return id;
+}
+
+HideSets::ID HideSets::add(ID set, Symbol macro) {
+  if (contains(set, macro)) {
+    return set;
+  }
+  return remember(Operation::Add, set, macro, [&] {
+    scratch.assign(members.begin() + starts[set], members.begin() + starts[set + 1]);
+    scratch.insert(std::upper_bound(scratch.begin(), scratch.end(), macro), macro);
+  });
+}
+
+HideSets::ID HideSets::intersect(ID a, ID b) {
+  if (a == b || a == empty || b == empty) {
+    return a == b ? a : empty;
+  }
+  return remember(Operation::Intersect, std::min(a, b), std::max(a, b), [&] {
+    std::set_intersection(members.begin() + starts[a], members.begin() + starts[a + 1],
+                          members.begin() + starts[b], members.begin() + starts[b + 1], std::back_inserter(scratch));
+  });
+}
+
+HideSets::ID HideSets::merge(ID a, ID b) {
+  if (a == b || b == empty) {
+    return a;
+  }
+  if (a == empty) {
+    return b;
+  }
+  return remember(Operation::Merge, std::min(a, b), std::max(a, b), [&] {
+    std::set_union(members.begin() + starts[a], members.begin() + starts[a + 1],
+                   members.begin() + starts[b], members.begin() + starts[b + 1], std::back_inserter(scratch));
+  });
+}
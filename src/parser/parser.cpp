@@ -5,115 +5,299 @@
 #include <iostream>
 #include "parser.h"
 
-void Parser::check_for_circular_include(const std::string &filename) {
-  for (const auto &include : lexers) {
-    if (include->filename == filename) {
-      throw std::runtime_error("Circular include detected: " + filename);
-    }
+Parser::Parser(std::istream &source, shared_ptr<Options> options) : options(std::move(options)) {
+  if (!this->options->include_pch.empty()) {
+    include_pch(this->options->include_pch);
   }
+  predefine();
+  
+  push_file(*sources.add(SourceBuffer::from_stream(source)));
+  next();
 }
 
-void Parser::next() {
-  auto newToken = lexers.back()->next();
+Parser::Parser(shared_ptr<Options> options) : options(std::move(options)) {
+  if (!this->options->include_pch.empty()) {
+    include_pch(this->options->include_pch);
+  }
+  predefine();
+}
+
+Parser::Parser(const std::string &filename, shared_ptr<Options> options) : options(std::move(options)) {
+  if (!this->options->include_pch.empty()) {
+    include_pch(this->options->include_pch);
+  }
+  predefine();
+  
+  const SourceBuffer *buffer = sources.open(filename);
+  if (!buffer) {
+    throw std::runtime_error("Could not open file: " + filename);
+  }
+  
+  push_file(*buffer);
+  next();
+}
 
-  if (newToken->type == CTokenType::CEndOfFile) {
-    lexers.pop_back();
-    if (lexers.empty()) {
-      token = std::move(newToken);
+void Parser::push_file(const SourceBuffer &buffer, const TokenBuffer *tokens) {
+  IncludeFrame frame;
+  if (!includes.empty()) {
+    frame.span = trace::Span("Source", buffer.filename);
+  }
+  frame.filename = buffer.filename;
+  frame.id = buffer.id;
+  
+  auto [statsFile, added] = statsFiles.try_emplace(buffer.id, stats.files.size());
+  if (added) {
+    stats.files.push_back({buffer.filename});
+  }
+  frame.statsFile = statsFile->second;
+  if (options->stats) {
+    frame.tokenTypes = &stats.tokensByType;
+  }
+  stats.files[frame.statsFile].entered++;
+  if (stats.includeDepths.size() <= includes.size()) {
+    stats.includeDepths.resize(includes.size() + 1);
+  }
+  stats.includeDepths[includes.size()]++;
+  
+  SourceLocation start = sources.start_of(buffer);
+  
+  // a buffered file that was lexed before is replayed rather than lexed again
+  bool lexed = true;
+  
+  if (tokens) {
+    frame.reader.emplace(*tokens, start);
+    lexed = false;
+  } else if (options->pipeline_lexing && (!pipe || pipeWaiting)) {
+    // the first file starts the producer, and later ones answer the include it is waiting on. An include named
+    // by a macro was not recognised by the producer, so it is lexed here instead.
+    if (!pipe) {
+      pipe = std::make_unique<TokenPipe>(buffer, start, strings);
     } else {
-      next();
+      pipe->enter(buffer, start);
+      pipeWaiting = false;
     }
-    
-    if (!lexers.empty()) {
-      current_lexer = lexers.back().get();
+    frame.pipe = pipe.get();
+  } else if (options->buffer_tokens) {
+    auto &tokens = tokenBuffers[&buffer];
+    if (!tokens) {
+      tokens = TokenBuffer::lex(buffer, strings);
+    } else {
+      lexed = false;
     }
-    std::cout << "Ascending to depth " << lexers.size() - 1 << ". Current lexer: " << current_lexer->filename << std::endl;
+    frame.reader.emplace(*tokens, start);
   } else {
-    token = std::move(newToken);
+    frame.lexer = std::make_unique<Lexer>(buffer, strings, start);
+  }
+  
+  if (lexed) {
+    stats.files[frame.statsFile].bytes += buffer.size();
   }
+  
+  if (buffer.id.valid()) {
+    activeFiles.insert(buffer.id);
+    filePaths.emplace(buffer.id, buffer.filename);
+  }
+  includes.push_back(std::move(frame));
+}
+
+void Parser::check_for_circular_include(FileID id, const std::string &filename) {
+  if (activeFiles.count(id)) {
+    throw std::runtime_error("Circular include detected: " + filename);
+  }
+}
+
+CompileStats Parser::statistics() const {
+  CompileStats counted = stats;
+  for (const IncludeFrame &frame : includes) {
+    counted.files[frame.statsFile].tokens += frame.tokens;
+  }
+  return counted;
+}
+
+bool Parser::is_include_redundant(FileID id) const {
+  if (onceFiles.count(id)) {
+    return true;
+  }
+  auto guard = includeGuards.find(id);
+  return guard != includeGuards.end() && macros.defined(guard->second);
 }
+
+CToken Parser::read_token() {
+  if (pending.size() > pendingFloor) {
+    CToken pendingToken = pending.back();
+    pending.pop_back();
+    return pendingToken;
+  }
+  if (isolated || includes.empty()) {
+    return {CTokenType::CEndOfFile, Interner::none};
+  }
   
-unique_ptr<AST> Parser::parse_preprocessor() {
-  switch (token->type) {
-    case CTokenType::CPreprocessorInclude:
-      parse_include();
-      break;
+  bool resumed = false;
+  while (true) {
+    IncludeFrame &frame = includes.back();
+    CToken newToken = frame.next();
+    if (newToken.type != CTokenType::CEndOfFile) {
+      // whatever follows an include starts afresh, even if the directive had more on its line
+      if (resumed) {
+        newToken.flags |= CToken::start_of_line;
+      }
+      return newToken;
+    }
+    
+    if (!frame.conditionals.empty()) {
+      throw std::runtime_error("Unterminated conditional directive in " + frame.filename);
+    }
+    if (Symbol guard = frame.guard.guard(); guard != Interner::none && frame.id.valid()) {
+      includeGuards[frame.id] = guard;
+    }
+    activeFiles.erase(frame.id);
+    stats.files[frame.statsFile].tokens += frame.tokens;
+    includes.pop_back();
+    if (includes.empty()) {
+      return newToken;
+    }
+    resumed = true;
+  }
+}
+
+void Parser::next() {
+  while (true) {
+    CToken newToken = read_token();
+    Symbol name = macro_name(newToken);
+    if (name == Interner::none || !expand(newToken, name)) {
+      token = newToken;
+      return;
+    }
+  }
+}
+
+bool Parser::at_directive() const {
+  return (token.flags & CToken::start_of_line) && token.hideset == HideSets::empty &&
+         token.type >= CTokenType::CPreprocessorInclude && token.type <= CTokenType::CPreprocessorHash;
+}
+
+CToken Parser::read_line() {
+  directiveLine.clear();
+  while (true) {
+    CToken lineToken = read_token();
+    if (lineToken.type == CTokenType::CEndOfFile || (lineToken.flags & CToken::start_of_line)) {
+      return lineToken;
+    }
+    directiveLine.push_back(lineToken);
+  }
+}
+
+void Parser::end_directive(const CToken &lineEnd) {
+  pending.push_back(lineEnd);
+  next();
+}
+
+NodeID Parser::parse_preprocessor(AST &ast) {
+  SourceLocation at = token.location;
+  switch (token.type) {
+    case CTokenType::CPreprocessorInclude: {
+      Symbol name = parse_include();
+      return ast.add(ASTKind::Include, name, at);
+    }
     case CTokenType::CPreprocessorDefine:
-      // handle define
-      next();
-      break;
-    case CTokenType::CPreprocessorUndef:
-      // handle undef
-      next();
-      break;
-    case CTokenType::CPreprocessorLine:
-      // handle line
-      next();
-      break;
-    case CTokenType::CPreprocessorError:
-      // handle error
-      next();
-      break;
-    case CTokenType::CPreprocessorPragma:
-      // handle pragma
-      next();
-      break;
+      return parse_define(ast);
+    case CTokenType::CPreprocessorUndef: {
+      CToken lineEnd = read_line();
+      Symbol name = directiveLine.empty() ? Interner::none : macro_name(directiveLine[0]);
+      if (name != Interner::none) {
+        macros.undefine(name);
+      }
+      NodeID id = ast.add(ASTKind::Undef, name, at);
+      end_directive(lineEnd);
+      return id;
+    }
+    case CTokenType::CPreprocessorPragma: {
+      FileID file = includes.back().id;
+      CToken lineEnd = read_line();
+      Symbol word = Interner::none;
+      if (!directiveLine.empty() && directiveLine[0].type == CTokenType::CIdentifier) {
+        word = directiveLine[0].value;
+        if (strings.get(word) == "once" && file.valid()) {
+          onceFiles.insert(file);
+        }
+      }
+      NodeID id = ast.add(ASTKind::Pragma, word, at);
+      end_directive(lineEnd);
+      return id;
+    }
     case CTokenType::CPreprocessorIf:
-      // handle if
-      next();
-      break;
     case CTokenType::CPreprocessorIfdef:
-      // handle ifdef
-      next();
-      break;
     case CTokenType::CPreprocessorIfndef:
-      // handle ifndef
-      next();
-      break;
     case CTokenType::CPreprocessorElif:
-      // handle elif
-      next();
-      break;
     case CTokenType::CPreprocessorElse:
-      // handle else
-      next();
-      break;
     case CTokenType::CPreprocessorEndif:
-      // handle endif
-      next();
-      break;
+      return parse_conditional(ast);
+    case CTokenType::CPreprocessorError: {
+      read_line();
+      string message = "#error";
+      for (const CToken &word : directiveLine) {
+        message += ' ';
+        message += word.getSpelling(strings);
+      }
+      throw std::runtime_error(message);
+    }
+    case CTokenType::CPreprocessorLine:
+    case CTokenType::CPreprocessorHash: {
+      NodeID id = ast.add_directive(token.type, at);
+      end_directive(read_line());
+      return id;
+    }
     default:  // should never happen
       throw std::runtime_error("Invalid preprocessor directive");
   }
 }
 
 unique_ptr<AST> Parser::parse() {
+  TRACE_SCOPE("Parse", includes.empty() ? string() : includes.front().filename);
   unique_ptr<AST> ast = std::make_unique<AST>();
+  size_t start = ast->mark();
   
   while (true) {
-    switch (token->type) {
-      case CTokenType::CEndOfFile:
-        return ast;
-      
-      case CTokenType::CPreprocessorInclude:
-      case CTokenType::CPreprocessorDefine:
-      case CTokenType::CPreprocessorUndef:
-      case CTokenType::CPreprocessorLine:
-      case CTokenType::CPreprocessorError:
-      case CTokenType::CPreprocessorPragma:
-      case CTokenType::CPreprocessorIf:
-      case CTokenType::CPreprocessorIfdef:
-      case CTokenType::CPreprocessorIfndef:
-      case CTokenType::CPreprocessorElif:
-      case CTokenType::CPreprocessorElse:
-      case CTokenType::CPreprocessorEndif:
-        ast->children.push_back(parse_preprocessor());
-        break;
-      default :
-        // handle code
-        next();
-        break;
-        
+    if (token.type == CTokenType::CEndOfFile) {
+      ast->add(ASTKind::TranslationUnit, Interner::none, SourceLocation(), start);
+      return ast;
     }
+    
+    if (at_directive()) {
+      parse_preprocessor(*ast);
+    } else {
+      // handle code
+      if (tokenHasher) {
+        tokenHasher->add(token, strings, sources);
+      }
+      next();
+    }
+  }
+}
+
+void Parser::preprocess(std::ostream &out) {
+  TRACE_SCOPE("Preprocess", includes.empty() ? string() : includes.front().filename);
+  // directives still add their nodes as they are parsed, to a tree that is thrown away
+  AST directives;
+  bool first = true;
+  
+  while (token.type != CTokenType::CEndOfFile) {
+    if (at_directive()) {
+      parse_preprocessor(directives);
+      continue;
+    }
+    
+    if (!first && (token.flags & CToken::start_of_line)) {
+      out << '\n';
+    } else if (!first && (token.flags & CToken::leading_space)) {
+      out << ' ';
+    }
+    out << token.getSpelling(strings);
+    first = false;
+    next();
+  }
+  
+  if (!first) {
+    out << '\n';
   }
 }
@@ -0,0 +1,517 @@
+#include "literal.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <ctime>
+#include <iterator>
+
+// Macros every translation unit starts with, other than the builtins whose expansion depends on where they are used
+static std::vector<std::pair<std::string_view, string>> predefined_macros() {
+  char date[32];
+  char time[32];
+  std::time_t now = std::time(nullptr);
+  std::tm local{};
+  localtime_r(&now, &local);
+  std::strftime(date, sizeof(date), "\"%b %e %Y\"", &local);
+  std::strftime(time, sizeof(time), "\"%H:%M:%S\"", &local);
+
+  return {
+    {"__STDC__", "1"},
+    {"__STDC_VERSION__", "199901L"},
+    {"__STDC_HOSTED__", "1"},
+    {"__DATE__", date},
+    {"__TIME__", time},
+    {"__CHAR_BIT__", "8"},
+#if defined(__x86_64__)
+    {"__x86_64__", "1"},
+#elif defined(__aarch64__)
+    {"__aarch64__", "1"},
+#endif
+#if defined(__LP64__)
+    {"__LP64__", "1"},
+#endif
+#if defined(__linux__)
+    {"__linux__", "1"},
+    {"__unix__", "1"},
+#endif
+  };
+}
+
+void Parser::lex_text(std::string_view text) {
+  scratchText.assign(text);
+  scratchText.append(SourceBuffer::padding, '\0');
+  Lexer lexer(std::string_view(scratchText.data(), text.size()), strings);
+
+  directiveLine.clear();
+  for (CToken lexed = lexer.next(); lexed.type != CTokenType::CEndOfFile; lexed = lexer.next()) {
+    directiveLine.push_back(lexed);
+  }
+}
+
+void Parser::predefine() {
+  for (const auto &[name, body] : predefined_macros()) {
+    lex_text(body);
+    Macro macro;
+    macro.name = strings.intern(name);
+    macros.define(macro, {}, directiveLine);
+  }
+
+  for (auto [name, builtin] : {std::pair{"__FILE__", Macro::Builtin::File}, {"__LINE__", Macro::Builtin::Line}}) {
+    Macro macro;
+    macro.name = strings.intern(name);
+    macro.builtin = builtin;
+    macros.define(macro, {}, {});
+  }
+}
+
+NodeID Parser::parse_define(AST &ast) {
+  SourceLocation at = token.location;
+  CToken lineEnd = read_line();
+  const std::vector<CToken> &line = directiveLine;
+
+  // keywords may be defined too, and are then looked up whenever they are read
+  Macro macro;
+  if (line.empty()) {
+    throw std::runtime_error("Macro name must be an identifier");
+  } else if (line[0].type == CTokenType::CIdentifier) {
+    macro.name = line[0].value;
+  } else if (line[0].type < CTokenType::CIdentifier) {
+    macro.name = strings.intern(fixed_spelling(line[0].type));
+    keywordMacros[static_cast<uint8_t>(line[0].type)] = macro.name;
+  } else {
+    throw std::runtime_error("Macro name must be an identifier");
+  }
+  string spelling(strings.get(macro.name));
+
+  // a function-like macro has its '(' straight after the name
+  size_t i = 1;
+  macro.functionLike = line.size() > 1 && line[1].type == CTokenType::CPunctuationOpenParen &&
+                       !(line[1].flags & CToken::leading_space);
+  defineParams.clear();
+  if (macro.functionLike) {
+    auto invalid = [&] { return std::runtime_error("Invalid parameter list in definition of macro " + spelling); };
+
+    i = 2;
+    if (i < line.size() && line[i].type == CTokenType::CPunctuationCloseParen) {
+      i++;
+    } else {
+      while (true) {
+        if (i < line.size() && line[i].type == CTokenType::CPunctuationEllipsis) {
+          defineParams.push_back(strings.intern("__VA_ARGS__"));
+          macro.variadic = true;
+        } else if (i < line.size() && line[i].type == CTokenType::CIdentifier) {
+          if (std::find(defineParams.begin(), defineParams.end(), line[i].value) != defineParams.end()) {
+            throw std::runtime_error("Duplicate parameter " + string(strings.get(line[i].value)) + " of macro " +
+                                     spelling);
+          }
+          defineParams.push_back(line[i].value);
+
+          // a named variadic parameter, written "name..."
+          if (i + 1 < line.size() && line[i + 1].type == CTokenType::CPunctuationEllipsis) {
+            macro.variadic = true;
+            i++;
+          }
+        } else {
+          throw invalid();
+        }
+
+        i++;
+        if (i < line.size() && line[i].type == CTokenType::CPunctuationCloseParen) {
+          i++;
+          break;
+        }
+        if (i >= line.size() || line[i].type != CTokenType::CPunctuationComma || macro.variadic) {
+          throw invalid();
+        }
+        i++;
+      }
+    }
+  }
+
+  auto param_index = [&](std::string_view name) -> std::optional<uint32_t> {
+    for (uint32_t p = 0; p < defineParams.size(); p++) {
+      if (strings.get(defineParams[p]) == name) {
+        return p;
+      }
+    }
+    return std::nullopt;
+  };
+
+  defineBody.clear();
+  for (; i < line.size(); i++) {
+    CToken bodyToken = line[i];
+    bool isDirective = bodyToken.type >= CTokenType::CPreprocessorInclude &&
+                       bodyToken.type <= CTokenType::CPreprocessorEndif;
+
+    if (macro.functionLike && isDirective) {
+      // the lexer read "#" and a parameter that happens to be named like a directive as one token
+      if (auto p = param_index(fixed_spelling(bodyToken.type).substr(1))) {
+        defineBody.push_back(bodyToken);
+        defineBody.back().type = CTokenType::CPreprocessorHash;
+        bodyToken.type = CTokenType::CMacroParameter;
+        bodyToken.value = *p;
+        bodyToken.flags = 0;
+      }
+    } else if (bodyToken.type == CTokenType::CIdentifier) {
+      auto param = std::find(defineParams.begin(), defineParams.end(), bodyToken.value);
+      if (param != defineParams.end()) {
+        bodyToken.type = CTokenType::CMacroParameter;
+        bodyToken.value = static_cast<Symbol>(param - defineParams.begin());
+      }
+    }
+    defineBody.push_back(bodyToken);
+  }
+
+  for (size_t t = 0; t < defineBody.size(); t++) {
+    if (defineBody[t].type == CTokenType::CPreprocessorHashHash) {
+      if (t == 0 || t + 1 == defineBody.size()) {
+        throw std::runtime_error("'##' cannot appear at either end of macro " + spelling);
+      }
+      macro.hasOperators = true;
+    } else if (defineBody[t].type == CTokenType::CPreprocessorHash && macro.functionLike) {
+      if (t + 1 == defineBody.size() || defineBody[t + 1].type != CTokenType::CMacroParameter) {
+        throw std::runtime_error("'#' is not followed by a macro parameter in macro " + spelling);
+      }
+      macro.hasOperators = true;
+    }
+  }
+
+  macros.define(macro, defineParams, defineBody);
+  NodeID id = ast.add(ASTKind::Define, macro.name, at);
+  end_directive(lineEnd);
+  return id;
+}
+
+// A token of a replacement list as it appears in the expansion of the invocation at name
+static CToken from_body(CToken bodyToken, const CToken &name) {
+  bodyToken.location = name.location;
+  return bodyToken;
+}
+
+bool Parser::expand(const CToken &name, Symbol macroName) {
+  const Macro *found = macros.find(macroName);
+  if (!found || hideSets.contains(name.hideset, macroName)) {
+    return false;
+  }
+  // copied, as expanding the arguments looks up other macros
+  const Macro macro = *found;
+
+  constexpr uint8_t spacing = CToken::start_of_line | CToken::leading_space;
+
+  if (macro.builtin != Macro::Builtin::None) {
+    CToken result = name;
+    if (macro.builtin == Macro::Builtin::Line) {
+      expandedLine = true;
+      result.type = CTokenType::CConstantInteger;
+      result.value = strings.intern_number(std::to_string(sources.position(name.location).line));
+    } else {
+      result.type = CTokenType::CConstantString;
+      scratchText.assign(1, '"');
+      bool escaped = append_escaped(scratchText, includes.empty() ? string() : includes.back().filename);
+      scratchText += '"';
+      result.value = strings.intern(scratchText);
+      result.flags = (result.flags & spacing) | (escaped ? CToken::has_escapes : 0);
+    }
+    result.hideset = hideSets.add(name.hideset, macroName);
+    pending.push_back(result);
+    return true;
+  }
+
+  const CToken *body = macros.tokens(macro);
+
+  // most macros are object-like constants, whose tokens are copied straight onto the pending tokens
+  if (!macro.functionLike && !macro.hasOperators) {
+    HideSets::ID hideset = hideSets.add(name.hideset, macroName);
+    for (uint32_t i = macro.tokenCount; i-- > 0;) {
+      pending.push_back(from_body(body[i], name));
+      pending.back().hideset = hideset;
+    }
+    if (macro.tokenCount > 0) {
+      CToken &first = pending.back();
+      first.flags = (first.flags & ~spacing) | (name.flags & spacing);
+    }
+    return true;
+  }
+
+  if (expansionDepth == expansionBuffers.size()) {
+    expansionBuffers.push_back(std::make_unique<ExpansionBuffers>());
+  }
+  ExpansionBuffers &buffers = *expansionBuffers[expansionDepth];
+
+  HideSets::ID hideset;
+  if (macro.functionLike) {
+    CToken paren = read_token();
+    if (paren.type != CTokenType::CPunctuationOpenParen) {
+      pending.push_back(paren);
+      return false;
+    }
+    CToken close = read_arguments(macro, buffers);
+    hideset = hideSets.add(hideSets.intersect(name.hideset, close.hideset), macroName);
+  } else {
+    buffers.args.clear();
+    buffers.argBounds.assign(1, 0);
+    hideset = hideSets.add(name.hideset, macroName);
+  }
+
+  expansionDepth++;
+  try {
+    substitute(macro, name, buffers);
+  } catch (...) {
+    expansionDepth--;
+    throw;
+  }
+  expansionDepth--;
+
+  std::vector<CToken> &result = buffers.result;
+  for (CToken &out : result) {
+    out.hideset = hideSets.merge(out.hideset, hideset);
+    out.flags &= ~CToken::start_of_line;
+  }
+  if (!result.empty()) {
+    result[0].flags = (result[0].flags & ~spacing) | (name.flags & spacing);
+  }
+  pending.insert(pending.end(), result.rbegin(), result.rend());
+  return true;
+}
+
+CToken Parser::read_arguments(const Macro &macro, ExpansionBuffers &buffers) {
+  buffers.args.clear();
+  buffers.argBounds.assign(1, 0);
+
+  auto describe = [&] { return "macro " + string(strings.get(macro.name)); };
+
+  unsigned int depth = 0;
+  while (true) {
+    CToken arg = read_token();
+    switch (arg.type) {
+      case CTokenType::CEndOfFile:
+        throw std::runtime_error("Unterminated argument list invoking " + describe());
+      case CTokenType::CPunctuationOpenParen:
+        depth++;
+        break;
+      case CTokenType::CPunctuationCloseParen:
+        if (depth == 0) {
+          buffers.argBounds.push_back(static_cast<uint32_t>(buffers.args.size()));
+          size_t count = buffers.argBounds.size() - 1;
+
+          if (macro.paramCount == 0 && count == 1 && buffers.args.empty()) {
+            // "f()" passes no arguments rather than one empty one
+            buffers.argBounds.pop_back();
+            count = 0;
+          } else if (macro.variadic && count + 1 == macro.paramCount) {
+            // the variadic arguments may be left out altogether
+            buffers.argBounds.push_back(static_cast<uint32_t>(buffers.args.size()));
+            count++;
+          }
+
+          if (count != macro.paramCount) {
+            throw std::runtime_error(describe() + " expects " + std::to_string(macro.paramCount) +
+                                     " arguments, but was given " + std::to_string(count));
+          }
+          return arg;
+        }
+        depth--;
+        break;
+      case CTokenType::CPunctuationComma:
+        // the variadic parameter takes every argument left, commas included
+        if (depth == 0 && !(macro.variadic && buffers.argBounds.size() == macro.paramCount)) {
+          buffers.argBounds.push_back(static_cast<uint32_t>(buffers.args.size()));
+          continue;
+        }
+        break;
+      case CTokenType::CPreprocessorInclude:
+        if ((arg.flags & CToken::start_of_line) && arg.hideset == HideSets::empty) {
+          throw std::runtime_error("#include inside the arguments of " + describe());
+        }
+        break;
+      default:
+        break;
+    }
+    buffers.args.push_back(arg);
+  }
+}
+
+void Parser::substitute(const Macro &macro, const CToken &name, ExpansionBuffers &buffers) {
+  std::vector<CToken> &result = buffers.result;
+  result.clear();
+  buffers.expanded.clear();
+
+  constexpr uint32_t unexpanded = UINT32_MAX;
+  buffers.expandedRanges.assign(macro.paramCount, {unexpanded, unexpanded});
+
+  const CToken *body = macros.tokens(macro);
+  const CToken *args = buffers.args.data();
+  const std::vector<uint32_t> &bounds = buffers.argBounds;
+
+  auto expanded = [&](uint32_t param) {
+    auto &range = buffers.expandedRanges[param];
+    if (range.first == unexpanded) {
+      range.first = static_cast<uint32_t>(buffers.expanded.size());
+      expand_argument(args + bounds[param], args + bounds[param + 1], buffers.expanded);
+      range.second = static_cast<uint32_t>(buffers.expanded.size());
+    }
+    return range;
+  };
+
+  // Appends [first, last) for a parameter, which takes the spacing of the parameter's own token
+  auto append = [&](const CToken *first, const CToken *last, const CToken &param) {
+    size_t start = result.size();
+    result.insert(result.end(), first, last);
+    if (start < result.size()) {
+      result[start].flags = (result[start].flags & ~CToken::leading_space) | (param.flags & CToken::leading_space);
+    }
+  };
+
+  // whether the operand on the left of a '##' produced no tokens, so there is nothing to paste onto
+  bool lhsEmpty = false;
+
+  for (uint32_t i = 0; i < macro.tokenCount; i++) {
+    const CToken &bodyToken = body[i];
+
+    if (bodyToken.type == CTokenType::CPreprocessorHash && macro.functionLike) {
+      uint32_t param = body[++i].value;
+      result.push_back(stringize(args + bounds[param], args + bounds[param + 1], from_body(bodyToken, name)));
+      lhsEmpty = false;
+      continue;
+    }
+
+    if (bodyToken.type == CTokenType::CPreprocessorHashHash) {
+      const CToken &rhs = body[++i];
+      const CToken *first = &rhs;
+      const CToken *last = &rhs + 1;
+      CToken operand;
+
+      if (rhs.type == CTokenType::CMacroParameter) {
+        first = args + bounds[rhs.value];
+        last = args + bounds[rhs.value + 1];
+
+        // a GNU extension: ", ## __VA_ARGS__" drops the comma when there are no variadic arguments
+        if (macro.variadic && rhs.value + 1 == macro.paramCount && !result.empty() &&
+            body[i - 2].type == CTokenType::CPunctuationComma) {
+          if (first == last) {
+            result.pop_back();
+          } else {
+            append(first, last, rhs);
+          }
+          lhsEmpty = false;
+          continue;
+        }
+      } else if (rhs.type == CTokenType::CPreprocessorHash && macro.functionLike) {
+        uint32_t param = body[++i].value;
+        operand = stringize(args + bounds[param], args + bounds[param + 1], from_body(rhs, name));
+        first = &operand;
+        last = &operand + 1;
+      } else {
+        operand = from_body(rhs, name);
+        first = &operand;
+        last = &operand + 1;
+      }
+
+      // an empty operand on either side leaves the other as it is
+      if (first != last) {
+        if (lhsEmpty) {
+          append(first, last, rhs);
+        } else {
+          result.back() = paste(result.back(), *first);
+          result.insert(result.end(), first + 1, last);
+        }
+        lhsEmpty = false;
+      }
+      continue;
+    }
+
+    if (bodyToken.type == CTokenType::CMacroParameter) {
+      uint32_t param = bodyToken.value;
+      if (i + 1 < macro.tokenCount && body[i + 1].type == CTokenType::CPreprocessorHashHash) {
+        // an operand of '##' is pasted as written
+        append(args + bounds[param], args + bounds[param + 1], bodyToken);
+        lhsEmpty = bounds[param] == bounds[param + 1];
+      } else {
+        auto [first, last] = expanded(param);
+        append(buffers.expanded.data() + first, buffers.expanded.data() + last, bodyToken);
+      }
+      continue;
+    }
+
+    result.push_back(from_body(bodyToken, name));
+    lhsEmpty = false;
+  }
+}
+
+void Parser::expand_argument(const CToken *first, const CToken *last, std::vector<CToken> &out) {
+  // arguments without a macro in them, the usual case, are copied as they are
+  bool hasMacro = std::any_of(first, last, [&](const CToken &arg) {
+    Symbol name = macro_name(arg);
+    return name != Interner::none && macros.defined(name);
+  });
+  if (!hasMacro) {
+    out.insert(out.end(), first, last);
+    return;
+  }
+
+  size_t outerFloor = pendingFloor;
+  bool outerIsolated = isolated;
+  pendingFloor = pending.size();
+  isolated = true;
+  pending.insert(pending.end(), std::make_reverse_iterator(last), std::make_reverse_iterator(first));
+
+  while (true) {
+    CToken arg = read_token();
+    if (arg.type == CTokenType::CEndOfFile) {
+      break;
+    }
+    Symbol name = macro_name(arg);
+    if (name == Interner::none || !expand(arg, name)) {
+      out.push_back(arg);
+    }
+  }
+
+  pending.resize(pendingFloor);
+  pendingFloor = outerFloor;
+  isolated = outerIsolated;
+}
+
+CToken Parser::stringize(const CToken *first, const CToken *last, const CToken &hash) {
+  // the string's value is the arguments' spelling, with any whitespace between tokens made a single space, and
+  // the quotes and backslashes of string and char constants escaped
+  scratchText.assign(1, '"');
+  bool escaped = false;
+  for (const CToken *arg = first; arg != last; arg++) {
+    if (arg != first && (arg->flags & (CToken::leading_space | CToken::start_of_line))) {
+      scratchText += ' ';
+    }
+    if (arg->type == CTokenType::CConstantString || arg->type == CTokenType::CConstantChar) {
+      escaped |= append_escaped(scratchText, arg->getSpelling(strings));
+    } else {
+      scratchText += arg->getSpelling(strings);
+    }
+  }
+  scratchText += '"';
+
+  CToken result = hash;
+  result.type = CTokenType::CConstantString;
+  result.value = strings.intern(scratchText);
+  result.flags = (hash.flags & (CToken::start_of_line | CToken::leading_space)) | (escaped ? CToken::has_escapes : 0);
+  return result;
+}
+
+CToken Parser::paste(const CToken &lhs, const CToken &rhs) {
+  string lhsSpelling(lhs.getSpelling(strings));
+  string rhsSpelling(rhs.getSpelling(strings));
+  scratchText = lhsSpelling + rhsSpelling;
+  size_t length = scratchText.size();
+  scratchText.append(SourceBuffer::padding, '\0');
+
+  Lexer lexer(std::string_view(scratchText.data(), length), strings);
+  CToken result = lexer.next();
+  if (result.type == CTokenType::CUnknown || result.type == CTokenType::CEndOfFile ||
+      lexer.next().type != CTokenType::CEndOfFile) {
+    throw std::runtime_error("Pasting " + lhsSpelling + " and " + rhsSpelling + " does not give a valid token");
+  }
+
+  // spaced as the left operand was, and flagged as the lexer found the result
+  result.flags = (lhs.flags & (CToken::start_of_line | CToken::leading_space)) | (result.flags & CToken::has_escapes);
+  result.hideset = lhs.hideset;
+  result.location = lhs.location;
+  return result;
+}
@@ -0,0 +1,266 @@
+#include "parser.h"
+#include "pch.h"
+#include "keywords.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+
+static int64_t modification_time(const struct stat &st) {
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+// Builds the file in memory, keeping every section aligned for the reader
+class PCHWriter {
+public:
+  PCHWriter() : data(sizeof(pch::Header), '\0') {}
+  
+  template <typename T>
+  pch::Section write(const std::vector<T> &records) {
+    pch::Section section = {align(), records.size()};
+    data.append(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(T));
+    return section;
+  }
+  
+  pch::Section write(const string &bytes) {
+    pch::Section section = {align(), bytes.size()};
+    data += bytes;
+    return section;
+  }
+  
+  void finish(const pch::Header &header) { std::memcpy(data.data(), &header, sizeof(header)); }
+  
+  string data;
+  
+private:
+  uint64_t align() {
+    data.resize((data.size() + 7) / 8 * 8, '\0');
+    return data.size();
+  }
+};
+
+// The records of a section, checked to lie inside the file
+template <typename T>
+static const T *section_records(const SourceBuffer &buffer, const pch::Section &section) {
+  if (section.offset % alignof(T) != 0 || section.offset > buffer.size() ||
+      section.count > (buffer.size() - section.offset) / sizeof(T)) {
+    throw std::runtime_error("Invalid precompiled header " + buffer.filename + ": section out of bounds");
+  }
+  return reinterpret_cast<const T *>(buffer.begin() + section.offset);
+}
+
+void Parser::emit_pch(const string &path) {
+  TRACE_SCOPE("EmitPCH", path);
+  // paths are stored as symbols, so they have to be interned before the string table is written
+  std::vector<std::pair<string, FileID>> dependencies;
+  for (const auto &[id, filename] : filePaths) {
+    dependencies.emplace_back(filename, id);
+  }
+  std::sort(dependencies.begin(), dependencies.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+  
+  std::vector<pch::FileEntry> files;
+  std::unordered_map<FileID, uint32_t> fileIndex;
+  for (const auto &[filename, id] : dependencies) {
+    struct stat st{};
+    if (stat(filename.c_str(), &st) != 0) {
+      throw std::runtime_error("Could not read " + filename + " while writing precompiled header");
+    }
+    fileIndex[id] = static_cast<uint32_t>(files.size());
+    files.push_back({strings.intern(filename), 0, static_cast<uint64_t>(st.st_size), modification_time(st)});
+  }
+  
+  std::vector<pch::StringEntry> stringEntries;
+  string stringData;
+  for (Symbol symbol = 1; symbol < strings.size(); symbol++) {
+    std::string_view str = strings.get(symbol);
+    stringEntries.push_back({stringData.size(), str.size()});
+    stringData += str;
+  }
+  
+  std::vector<pch::MacroEntry> macroEntries;
+  std::vector<Symbol> macroParams;
+  std::vector<pch::TokenEntry> macroTokens;
+  macros.for_each([&](const Macro &macro) {
+    macroEntries.push_back({macro.name, macro.functionLike, macro.variadic, macro.hasOperators,
+                            static_cast<uint8_t>(macro.builtin), macro.paramCount, macro.tokenCount});
+    macroParams.insert(macroParams.end(), macros.params(macro), macros.params(macro) + macro.paramCount);
+    for (const CToken *t = macros.tokens(macro); t != macros.tokens(macro) + macro.tokenCount; t++) {
+      macroTokens.push_back({t->type, t->flags, 0, t->value});
+    }
+  });
+  
+  std::vector<pch::GuardEntry> guards;
+  for (const auto &[id, macro] : includeGuards) {
+    if (auto it = fileIndex.find(id); it != fileIndex.end()) {
+      guards.push_back({it->second, macro});
+    }
+  }
+  std::sort(guards.begin(), guards.end(), [](const auto &a, const auto &b) { return a.file < b.file; });
+  
+  std::vector<uint32_t> once;
+  for (const auto &id : onceFiles) {
+    if (auto it = fileIndex.find(id); it != fileIndex.end()) {
+      once.push_back(it->second);
+    }
+  }
+  std::sort(once.begin(), once.end());
+  
+  PCHWriter writer;
+  pch::Header header{};
+  std::memcpy(header.magic, pch::magic, sizeof(header.magic));
+  header.version = pch::format_version;
+  std::strncpy(header.compiler, compiler_version, sizeof(header.compiler) - 1);
+  header.strings = writer.write(stringEntries);
+  header.stringData = writer.write(stringData);
+  header.macros = writer.write(macroEntries);
+  header.macroParams = writer.write(macroParams);
+  header.macroTokens = writer.write(macroTokens);
+  header.files = writer.write(files);
+  header.guards = writer.write(guards);
+  header.once = writer.write(once);
+  writer.finish(header);
+  
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(writer.data.data(), static_cast<std::streamsize>(writer.data.size()));
+  if (!out.good()) {
+    throw std::runtime_error("Could not write precompiled header: " + path);
+  }
+}
+
+void Parser::include_pch(const string &path) {
+  TRACE_SCOPE("LoadPCH", path);
+  if (strings.size() != 1) {
+    throw std::runtime_error("A precompiled header has to be loaded before any file is read");
+  }
+  
+  auto loaded = SourceBuffer::from_file(path);
+  if (!loaded) {
+    throw std::runtime_error("Could not open precompiled header: " + path);
+  }
+  const SourceBuffer &buffer = *sources.add(std::move(loaded));
+  
+  auto invalid = [&](const string &reason) {
+    return std::runtime_error("Invalid precompiled header " + path + ": " + reason);
+  };
+  
+  if (buffer.size() < sizeof(pch::Header)) {
+    throw invalid("file too short");
+  }
+  const auto &header = *reinterpret_cast<const pch::Header *>(buffer.begin());
+  if (std::memcmp(header.magic, pch::magic, sizeof(header.magic)) != 0) {
+    throw invalid("not a precompiled header");
+  }
+  if (header.version != pch::format_version ||
+      std::strncmp(header.compiler, compiler_version, sizeof(header.compiler)) != 0) {
+    throw invalid("written by a different version of the compiler");
+  }
+  
+  // the strings are used in place, so interning them copies nothing
+  auto stringEntries = section_records<pch::StringEntry>(buffer, header.strings);
+  auto stringData = section_records<char>(buffer, header.stringData);
+  for (uint64_t i = 0; i < header.strings.count; i++) {
+    const pch::StringEntry &entry = stringEntries[i];
+    if (entry.offset > header.stringData.count || entry.length > header.stringData.count - entry.offset) {
+      throw invalid("string out of bounds");
+    }
+    if (strings.intern_stored({stringData + entry.offset, entry.length}) != i + 1) {
+      throw invalid("string table is not unique");
+    }
+  }
+  
+  auto symbol = [&](Symbol symbol) {
+    if (symbol >= strings.size()) {
+      throw invalid("symbol out of range");
+    }
+    return symbol;
+  };
+  
+  auto files = section_records<pch::FileEntry>(buffer, header.files);
+  std::vector<FileID> fileIDs;
+  for (uint64_t i = 0; i < header.files.count; i++) {
+    string filename(strings.get(symbol(files[i].path)));
+    
+    struct stat st{};
+    if (stat(filename.c_str(), &st) != 0 || static_cast<uint64_t>(st.st_size) != files[i].size ||
+        modification_time(st) != files[i].mtime) {
+      throw std::runtime_error("Precompiled header " + path + " is out of date: " + filename + " has changed");
+    }
+    
+    FileID id = {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+    fileIDs.push_back(id);
+    filePaths.emplace(id, filename);
+  }
+  
+  auto file = [&](uint32_t index) {
+    if (index >= fileIDs.size()) {
+      throw invalid("file index out of range");
+    }
+    return fileIDs[index];
+  };
+  
+  auto macroEntries = section_records<pch::MacroEntry>(buffer, header.macros);
+  auto macroParams = section_records<Symbol>(buffer, header.macroParams);
+  auto macroTokens = section_records<pch::TokenEntry>(buffer, header.macroTokens);
+  uint64_t nextParam = 0;
+  uint64_t nextToken = 0;
+  std::vector<Symbol> params;
+  std::vector<CToken> tokens;
+  for (uint64_t i = 0; i < header.macros.count; i++) {
+    const pch::MacroEntry &entry = macroEntries[i];
+    if (entry.paramCount > header.macroParams.count - nextParam ||
+        entry.tokenCount > header.macroTokens.count - nextToken || entry.builtin > uint8_t(Macro::Builtin::Line)) {
+      throw invalid("macro out of bounds");
+    }
+    
+    params.clear();
+    for (uint32_t p = 0; p < entry.paramCount; p++) {
+      params.push_back(symbol(macroParams[nextParam++]));
+    }
+    tokens.clear();
+    for (uint32_t t = 0; t < entry.tokenCount; t++) {
+      const pch::TokenEntry &stored = macroTokens[nextToken++];
+      if (stored.type > CTokenType::CMacroParameter) {
+        throw invalid("unknown token type");
+      }
+      // a parameter's value is its index rather than a symbol
+      bool isParam = stored.type == CTokenType::CMacroParameter;
+      if (isParam ? stored.value >= entry.paramCount : stored.value >= strings.size()) {
+        throw invalid("symbol out of range");
+      }
+      // constants are decoded as they would have been when lexed
+      Symbol value = stored.value;
+      if (stored.type == CTokenType::CConstantInteger || stored.type == CTokenType::CConstantFloat) {
+        value = strings.intern_number_stored(strings.get(value));
+      }
+      tokens.emplace_back(stored.type, value);
+      tokens.back().flags = stored.flags;
+    }
+    
+    Macro macro;
+    macro.name = symbol(entry.name);
+    macro.functionLike = entry.functionLike;
+    macro.variadic = entry.variadic;
+    macro.hasOperators = entry.hasOperators;
+    macro.builtin = static_cast<Macro::Builtin>(entry.builtin);
+    macros.define(macro, params, tokens);
+    if (std::string_view name = strings.get(macro.name); !name.empty()) {
+      CTokenType keyword = lookup_keyword(name.data(), name.size());
+      if (keyword != CTokenType::CIdentifier) {
+        keywordMacros[static_cast<uint8_t>(keyword)] = macro.name;
+      }
+    }
+  }
+  
+  auto guards = section_records<pch::GuardEntry>(buffer, header.guards);
+  for (uint64_t i = 0; i < header.guards.count; i++) {
+    includeGuards[file(guards[i].file)] = symbol(guards[i].macro);
+  }
+  
+  auto once = section_records<uint32_t>(buffer, header.once);
+  for (uint64_t i = 0; i < header.once.count; i++) {
+    onceFiles.insert(file(once[i]));
+  }
+}
@@ -0,0 +1,162 @@
+#include "stats.h"
+#include "token.h"
+
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+static int open_counter(uint64_t config, int group) {
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // this thread only, on whichever CPU it runs
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+
+PerfCounters::PerfCounters() {
+#ifdef __linux__
+  group = open_counter(PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (group < 0) {
+    return;
+  }
+  members[0] = open_counter(PERF_COUNT_HW_INSTRUCTIONS, group);
+  members[1] = open_counter(PERF_COUNT_HW_CACHE_MISSES, group);
+  if (members[0] < 0 || members[1] < 0) {
+    // counting only some of them would make the report misleading
+    for (int &fd : members) {
+      if (fd >= 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+    close(group);
+    group = -1;
+  }
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (int fd : members) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  if (group >= 0) {
+    close(group);
+  }
+#endif
+}
+
+PerfCounters::Values PerfCounters::read() const {
+  Values values;
+#ifdef __linux__
+  // the number of counters, then each counter's value in the order they joined the group
+  uint64_t data[4] = {};
+  if (group >= 0 && ::read(group, data, sizeof(data)) == sizeof(data) && data[0] == 3) {
+    values.cycles = data[1];
+    values.instructions = data[2];
+    values.cacheMisses = data[3];
+  }
+#endif
+  return values;
+}
+
+static double thread_cpu_ms() {
+  timespec time{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return static_cast<double>(time.tv_sec) * 1e3 + static_cast<double>(time.tv_nsec) / 1e6;
+}
+
+PhaseTimer::PhaseTimer(CompileStats *stats, const PerfCounters *counters, const char *name)
+    : stats(stats), counters(counters), name(name) {
+  if (stats) {
+    wallStart = std::chrono::steady_clock::now();
+    cpuStart = thread_cpu_ms();
+    countersStart = counters->read();
+  }
+}
+
+PhaseTimer::~PhaseTimer() {
+  if (!stats) {
+    return;
+  }
+  PerfCounters::Values end = counters->read();
+  CompileStats::Phase phase;
+  phase.name = name;
+  phase.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+  phase.cpuMs = thread_cpu_ms() - cpuStart;
+  phase.counted = counters->available();
+  phase.counters = {end.cycles - countersStart.cycles, end.instructions - countersStart.instructions,
+                    end.cacheMisses - countersStart.cacheMisses};
+  stats->phases.push_back(phase);
+}
+
+void CompileStats::print(std::ostream &out, const string &input) const {
+  std::ios::fmtflags flags = out.flags();
+  out << "*** Statistics for " << input << "\n";
+
+  out << "Phases:\n"
+      << "  " << std::left << std::setw(12) << "phase" << std::right << std::setw(12) << "wall ms" << std::setw(12)
+      << "cpu ms" << std::setw(16) << "cycles" << std::setw(16) << "instructions" << std::setw(14) << "cache misses"
+      << "\n";
+  for (const Phase &phase : phases) {
+    out << "  " << std::left << std::setw(12) << phase.name << std::right << std::fixed << std::setprecision(3)
+        << std::setw(12) << phase.wallMs << std::setw(12) << phase.cpuMs;
+    if (phase.counted) {
+      out << std::setw(16) << phase.counters.cycles << std::setw(16) << phase.counters.instructions << std::setw(14)
+          << phase.counters.cacheMisses;
+    } else {
+      out << std::setw(16) << "-" << std::setw(16) << "-" << std::setw(14) << "-";
+    }
+    out << "\n";
+  }
+
+  uint64_t bytes = 0;
+  uint64_t tokens = 0;
+  for (const File &file : files) {
+    bytes += file.bytes;
+    tokens += file.tokens;
+  }
+  out << "Files: " << files.size() << " read, " << bytes << " bytes lexed, " << tokens << " tokens read\n"
+      << "  " << std::setw(8) << "entered" << std::setw(12) << "bytes" << std::setw(10) << "tokens" << "  path\n";
+  for (const File &file : files) {
+    out << "  " << std::setw(8) << file.entered << std::setw(12) << file.bytes << std::setw(10) << file.tokens
+        << "  " << file.path << "\n";
+  }
+
+  out << "Include depth: max " << (includeDepths.empty() ? 0 : includeDepths.size() - 1) << "\n";
+  for (size_t depth = 0; depth < includeDepths.size(); depth++) {
+    out << "  " << std::setw(8) << depth << std::setw(10) << includeDepths[depth] << "\n";
+  }
+  out << "Include lookups: " << includeLookups << ", " << failedLookups << " found no file\n";
+
+  std::vector<size_t> types;
+  for (size_t type = 0; type < tokensByType.size(); type++) {
+    if (tokensByType[type] != 0) {
+      types.push_back(type);
+    }
+  }
+  std::stable_sort(types.begin(), types.end(),
+                   [&](size_t a, size_t b) { return tokensByType[a] > tokensByType[b]; });
+  out << "Tokens by type:\n";
+  for (size_t type : types) {
+    CToken token(static_cast<CTokenType>(type), Interner::none);
+    out << "  " << std::setw(10) << tokensByType[type] << "  " << token.getTypeAsString() << "\n";
+  }
+
+  out << "AST nodes: " << astNodes << "\n";
+  out.flags(flags);
+}
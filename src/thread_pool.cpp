@@ -0,0 +1,105 @@
+#include "thread_pool.h"
+
+// the pool and queue of the worker running on this thread, if any
+static thread_local const ThreadPool *currentPool = nullptr;
+static thread_local size_t currentQueue = 0;
+
+ThreadPool::ThreadPool(unsigned int threads) {
+  threads = threads ? threads : 1;
+  for (unsigned int i = 0; i < threads; i++) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+  for (unsigned int i = 0; i < threads; i++) {
+    this->threads.emplace_back([this, i] { run(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  available.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  bool nested = currentPool == this;
+  size_t target;
+  {
+    std::lock_guard lock(mutex);
+    target = nested ? currentQueue : nextQueue++ % queues.size();
+    pending++;
+    // counted before it is pushed so the count never drops below the tasks actually queued, as a worker may take
+    // the task as soon as it is pushed
+    queued++;
+  }
+
+  {
+    Queue &queue = *queues[target];
+    std::lock_guard lock(queue.mutex);
+    (nested ? queue.nested : queue.submitted).push_back(std::move(task));
+  }
+  available.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock lock(mutex);
+  finished.wait(lock, [this] { return pending == 0; });
+}
+
+bool ThreadPool::take(size_t self, std::function<void()> &task) {
+  for (size_t i = 0; i < queues.size(); i++) {
+    Queue &queue = *queues[(self + i) % queues.size()];
+    std::lock_guard lock(queue.mutex);
+
+    // the newest task our own tasks submitted is the one most likely to still be in cache. Otherwise the oldest
+    // task from outside goes first, whoever's queue it is in, and of another worker's own the oldest, as it is
+    // the one they are least likely to get to soon.
+    if (i == 0 && !queue.nested.empty()) {
+      task = std::move(queue.nested.back());
+      queue.nested.pop_back();
+      return true;
+    }
+    std::deque<std::function<void()>> &tasks = queue.submitted.empty() ? queue.nested : queue.submitted;
+    if (!tasks.empty()) {
+      task = std::move(tasks.front());
+      tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(size_t self) {
+  currentPool = this;
+  currentQueue = self;
+
+  while (true) {
+    std::function<void()> task;
+    if (!take(self, task)) {
+      std::unique_lock lock(mutex);
+      available.wait(lock, [this] { return stopping || queued > 0; });
+      if (stopping && queued == 0) {
+        return;
+      }
+      // another worker may take the task first, in which case this just looks again
+      continue;
+    }
+
+    {
+      std::lock_guard lock(mutex);
+      queued--;
+    }
+
+    task();
+
+    std::lock_guard lock(mutex);
+    if (--pending == 0) {
+      finished.notify_all();
+    }
+  }
+}
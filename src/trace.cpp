@@ -0,0 +1,183 @@
+#include "trace.h"
+
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+namespace detail {
+std::atomic<bool> recording = false;
+}
+
+namespace {
+
+struct ThreadBuffer {
+  uint64_t thread = llvm::get_threadid();
+
+  // spans ever recorded; the ring holds the last ring_capacity of them
+  size_t count = 0;
+  std::vector<Event> ring = std::vector<Event>(ring_capacity);
+};
+
+std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+// when recording started, by the clock LLVM's profiler writes its start time with
+int64_t originSinceEpochUs = 0;
+
+// the buffer of every thread that has recorded, kept after the threads finish so their spans can be written
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+thread_local ThreadBuffer *threadBuffer = nullptr;
+
+void write_escaped(std::ostream &out, std::string_view text) {
+  for (char ch : text) {
+    if (ch == '"' || ch == '\\') {
+      out << '\\' << ch;
+    } else if (static_cast<unsigned char>(ch) < 0x20) {
+      out << ' ';
+    } else {
+      out << ch;
+    }
+  }
+}
+
+// Writes the passes LLVM's profiler traced, shifted onto the same timeline as the spans recorded here
+void write_llvm_events(std::ostream &out, bool &first, int64_t pid) {
+  if (!llvm::timeTraceProfilerEnabled()) {
+    return;
+  }
+
+  llvm::SmallString<4096> text;
+  llvm::raw_svector_ostream stream(text);
+  llvm::timeTraceProfilerWrite(stream);
+  llvm::timeTraceProfilerCleanup();
+
+  llvm::Expected<llvm::json::Value> parsed = llvm::json::parse(text);
+  if (!parsed) {
+    llvm::consumeError(parsed.takeError());
+    return;
+  }
+  llvm::json::Object *root = parsed->getAsObject();
+  llvm::json::Array *events = root ? root->getArray("traceEvents") : nullptr;
+  if (!events) {
+    return;
+  }
+  int64_t shift = root->getInteger("beginningOfTime").getValueOr(originSinceEpochUs) - originSinceEpochUs;
+
+  for (llvm::json::Value &value : *events) {
+    llvm::json::Object *event = value.getAsObject();
+    // metadata and the per-name totals LLVM adds are left out, as they do not belong on a thread's timeline
+    if (!event || event->getString("ph").getValueOr("") != "X" ||
+        event->getString("name").getValueOr("").startswith("Total ")) {
+      continue;
+    }
+    (*event)["pid"] = pid;
+    (*event)["ts"] = event->getInteger("ts").getValueOr(0) + shift;
+
+    std::string json;
+    llvm::raw_string_ostream eventStream(json);
+    eventStream << llvm::json::Value(std::move(*event));
+    out << (first ? "\n" : ",\n") << eventStream.str();
+    first = false;
+  }
+}
+
+} // namespace
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void record(const char *name, std::string_view detail, uint64_t start, uint64_t end) {
+  if (!threadBuffer) {
+    auto buffer = std::make_unique<ThreadBuffer>();
+    threadBuffer = buffer.get();
+    std::lock_guard lock(registryMutex);
+    registry.push_back(std::move(buffer));
+  }
+
+  Event &event = threadBuffer->ring[threadBuffer->count++ % ring_capacity];
+  event.name = name;
+  event.start = start;
+  event.duration = end - start;
+  size_t length = std::min(detail.size(), sizeof(event.detail) - 1);
+  std::memcpy(event.detail, detail.data() + detail.size() - length, length);
+  event.detail[length] = '\0';
+}
+
+void start() {
+  {
+    std::lock_guard lock(registryMutex);
+    for (auto &buffer : registry) {
+      buffer->count = 0;
+    }
+  }
+  origin = std::chrono::steady_clock::now();
+  originSinceEpochUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::system_clock::now().time_since_epoch()).count();
+  if (!llvm::timeTraceProfilerEnabled()) {
+    llvm::timeTraceProfilerInitialize(0, "CLLVM");
+  }
+  detail::recording.store(true, std::memory_order_relaxed);
+}
+
+void write_chrome_json(std::ostream &out) {
+  detail::recording.store(false, std::memory_order_relaxed);
+  auto pid = static_cast<int64_t>(llvm::sys::Process::getProcessId());
+
+  out << "{\"traceEvents\": [";
+  bool first = true;
+  std::lock_guard lock(registryMutex);
+  for (const auto &buffer : registry) {
+    size_t kept = std::min(buffer->count, ring_capacity);
+    for (size_t i = buffer->count - kept; i < buffer->count; i++) {
+      const Event &event = buffer->ring[i % ring_capacity];
+      out << (first ? "\n" : ",\n") << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": " << pid
+          << ", \"tid\": " << buffer->thread << ", \"ts\": " << event.start / 1000.0
+          << ", \"dur\": " << event.duration / 1000.0 << ", \"args\": {\"detail\": \"";
+      write_escaped(out, event.detail);
+      out << "\"}}";
+      first = false;
+    }
+    if (buffer->count > kept) {
+      out << ",\n{\"name\": \"Dropped spans\", \"ph\": \"i\", \"s\": \"t\", \"pid\": " << pid
+          << ", \"tid\": " << buffer->thread << ", \"ts\": 0, \"args\": {\"count\": " << buffer->count - kept << "}}";
+    }
+  }
+  write_llvm_events(out, first, pid);
+  out << "\n]}\n";
+}
+
+#if CLLVM_TRACING
+void Span::begin(const char *spanName, std::string_view spanDetail) {
+  name = spanName;
+  start = now();
+  length = static_cast<uint8_t>(std::min(spanDetail.size(), sizeof(detail)));
+  std::memcpy(detail, spanDetail.data() + spanDetail.size() - length, length);
+}
+#endif
+
+LLVMPassScope::LLVMPassScope() {
+  if (enabled() && !llvm::timeTraceProfilerEnabled()) {
+    llvm::timeTraceProfilerInitialize(0, "CLLVM");
+    started = true;
+  }
+}
+
+LLVMPassScope::~LLVMPassScope() {
+  if (started) {
+    llvm::timeTraceProfilerFinishThread();
+  }
+}
+
+} // namespace trace
@@ -0,0 +1,594 @@
+#include <gtest/gtest.h>
+#include <codegen.h>
+#include <compile_cache.h>
+#include <compile_server.h>
+#include <driver.h>
+#include <header_cache.h>
+#include <lexer.h>
+#include <lto.h>
+#include <thread_pool.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <set>
+#include <thread>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/MD5.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "scratch_dir.h"
+
+// Changes the working directory, and changes it back when the test ends, passed or not
+class WorkingDirectory {
+public:
+  WorkingDirectory() : previous(std::filesystem::current_path()) {}
+  explicit WorkingDirectory(const std::filesystem::path &path) : WorkingDirectory() { change(path); }
+
+  WorkingDirectory(const WorkingDirectory &) = delete;
+  WorkingDirectory &operator=(const WorkingDirectory &) = delete;
+
+  ~WorkingDirectory() {
+    std::error_code ec;
+    std::filesystem::current_path(previous, ec);
+  }
+
+  void change(const std::filesystem::path &path) { std::filesystem::current_path(path); }
+
+private:
+  std::filesystem::path previous;
+};
+
+// Answers requests on a thread of its own, and stops the server and waits for the thread when the test ends
+class ServingThread {
+public:
+  explicit ServingThread(CompileServer &server) : server(server), thread([&server] { server.run(); }) {}
+
+  ServingThread(const ServingThread &) = delete;
+  ServingThread &operator=(const ServingThread &) = delete;
+
+  ~ServingThread() { stop(); }
+
+  void stop() {
+    if (thread.joinable()) {
+      server.stop();
+      thread.join();
+    }
+  }
+
+private:
+  CompileServer &server;
+  std::thread thread;
+};
+
+TEST(ThreadPool, RunsNestedTasks) {
+  std::atomic<int> count = 0;
+  {
+    ThreadPool pool(4);
+    for (int i = 0; i < 100; i++) {
+      pool.submit([&] {
+        count++;
+        for (int j = 0; j < 10; j++) {
+          pool.submit([&] { count++; });
+        }
+      });
+    }
+    pool.wait();
+    ASSERT_EQ(count, 1100);
+  }
+}
+
+TEST(ThreadPool, RunsSubmittedTasksInOrder) {
+  std::mutex mutex;
+  std::vector<int> started;
+  {
+    ThreadPool pool(1);
+    // the worker is kept busy until everything is queued, so the order is up to the queue
+    std::promise<void> queued;
+    pool.submit([&, ready = queued.get_future().share()] { ready.wait(); });
+    for (int i = 0; i < 6; i++) {
+      pool.submit([&, i] {
+        std::lock_guard lock(mutex);
+        started.push_back(i * 10);
+        // a worker's own tasks run newest first, before the next task from outside
+        for (int j = 2; j >= 1; j--) {
+          pool.submit([&, i, j] {
+            std::lock_guard nestedLock(mutex);
+            started.push_back(i * 10 + j);
+          });
+        }
+      });
+    }
+    queued.set_value();
+    pool.wait();
+  }
+  EXPECT_EQ(started, std::vector<int>({0, 1, 2, 10, 11, 12, 20, 21, 22, 30, 31, 32, 40, 41, 42, 50, 51, 52}));
+}
+
+TEST(Driver, DiagnosticsInInputOrder) {
+  ScratchDir dir("driver_order");
+  WorkingDirectory inDir(dir.path());
+  
+  auto options = std::make_shared<Options>();
+  options->jobs = 4;
+  string expected;
+  for (int i = 0; i < 16; i++) {
+    string name = "file_" + std::to_string(i) + ".c";
+    if (i % 3 == 0) {
+      dir.write(name, "#include \"missing_" + std::to_string(i) + ".h\"\n");
+      expected += name + ": error: Could not find include file: missing_" + std::to_string(i) + ".h\n";
+    } else {
+      dir.write(name, "int x;\n");
+    }
+    options->inputs.push_back(name);
+  }
+  
+  std::ostringstream out;
+  size_t failures = compile_all(options, out);
+  
+  ASSERT_EQ(failures, 6);
+  ASSERT_EQ(out.str(), expected);
+  ASSERT_TRUE(std::filesystem::exists(dir / "file_1.o"));
+  
+}
+
+TEST(Driver, InputsWithTheSameObjectRejected) {
+  auto parse = [](std::vector<string> args) {
+    std::vector<char *> argv = {const_cast<char *>("CLLVM")};
+    for (string &arg : args) {
+      argv.push_back(arg.data());
+    }
+    return Options::parse(static_cast<int>(argv.size()), argv.data());
+  };
+  
+  try {
+    parse({"-j2", "a/x.c", "b/x.c"});
+    FAIL();
+  } catch (const std::runtime_error &e) {
+    EXPECT_STREQ(e.what(), "a/x.c and b/x.c would both be compiled to x.o");
+  }
+  
+  // nothing is written for them when preprocessing
+  EXPECT_EQ(parse({"-E", "a/x.c", "b/x.c"})->inputs.size(), 2);
+  EXPECT_EQ(parse({"a/x.c", "b/y.c"})->object_path("b/y.c"), "y.o");
+}
+
+TEST(Driver, CacheSizeParsed) {
+  auto parse = [](string size) {
+    std::vector<char *> argv = {const_cast<char *>("CLLVM"), const_cast<char *>("--cache-size"), size.data(),
+                                const_cast<char *>("x.c")};
+    return Options::parse(static_cast<int>(argv.size()), argv.data());
+  };
+  
+  EXPECT_EQ(parse("512")->cache_size, 512);
+  EXPECT_EQ(parse("2K")->cache_size, 2048);
+  EXPECT_EQ(parse("3G")->cache_size, uint64_t(3) << 30);
+  EXPECT_EQ(parse("17179869183G")->cache_size, uint64_t(17179869183) << 30);
+  for (string size : {"-1", "-1G", "+1", " 1", "", "1T", "17179869184G", "99999999999999999999"}) {
+    try {
+      parse(size);
+      ADD_FAILURE() << size;
+    } catch (const std::runtime_error &e) {
+      EXPECT_EQ(string(e.what()), "Invalid size: " + size);
+    }
+  }
+  
+}
+
+TEST(Driver, CodeGenThreadsParsed) {
+  auto parse = [](string arg) {
+    std::vector<char *> argv = {const_cast<char *>("CLLVM"), arg.data(), const_cast<char *>("x.c")};
+    return Options::parse(static_cast<int>(argv.size()), argv.data());
+  };
+  
+  EXPECT_EQ(parse("-fcodegen-threads=4")->codegen_threads, 4);
+  for (string count : {"-1", "+2", " 2", "0", "2x", "", "257", "99999999999999999999"}) {
+    try {
+      parse("-fcodegen-threads=" + count);
+      ADD_FAILURE() << count;
+    } catch (const std::runtime_error &e) {
+      EXPECT_EQ(string(e.what()), "Invalid thread count: " + count);
+    }
+  }
+  
+}
+
+#if CLLVM_TRACING
+TEST(Driver, TimeTrace) {
+  ScratchDir dir("driver_trace");
+  dir.write("a.h", "int a;\n");
+  dir.write("main.c", "#include \"a.h\"\nint f(int x) { return x + a; }\n");
+  
+  auto options = std::make_shared<Options>();
+  options->jobs = 2;
+  options->include_dirs = {dir.path().string()};
+  options->inputs = {(dir / "main.c").string()};
+  options->output = (dir / "main.o").string();
+  options->time_trace = (dir / "trace.json").string();
+  
+  std::ostringstream out;
+  ASSERT_EQ(compile_all(options, out), 0) << out.str();
+  
+  std::ifstream file(options->time_trace);
+  std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  ASSERT_EQ(json.rfind("{\"traceEvents\": [", 0), 0);
+  for (const char *name : {"\"Compile\"", "\"Parse\"", "\"Source\"", "\"CodeGen\"", "\"OptModule\""}) {
+    EXPECT_NE(json.find(name), std::string::npos) << name;
+  }
+  EXPECT_NE(json.find("\"detail\": \"" + (dir / "a.h").string()), std::string::npos);
+  
+}
+
+TEST(Driver, InputsStartInOrder) {
+  ScratchDir dir("driver_start_order");
+  auto options = std::make_shared<Options>();
+  options->jobs = 1;
+  options->preprocess_only = true;
+  options->time_trace = (dir / "trace.json").string();
+  for (int i = 0; i < 6; i++) {
+    options->inputs.push_back(dir.write("in" + std::to_string(i) + ".c", "int x;\n"));
+  }
+  
+  std::ostringstream out;
+  ASSERT_EQ(compile_all(options, out), 0) << out.str();
+  
+  // on one worker each compilation ends before the next starts, so its spans are in the order they started
+  std::ifstream file(options->time_trace);
+  std::vector<string> compiled;
+  string line;
+  const string detail = "\"detail\": \"";
+  while (std::getline(file, line)) {
+    size_t at = line.find(detail);
+    if (line.rfind("{\"name\": \"Compile\"", 0) == 0 && at != string::npos) {
+      compiled.push_back(line.substr(at + detail.size(), line.find('"', at + detail.size()) - at - detail.size()));
+    }
+  }
+  EXPECT_EQ(compiled, options->inputs);
+  
+}
+#endif
+
+TEST(Driver, Stats) {
+  ScratchDir dir("driver_stats");
+  dir.write("sys/b.h", "#ifndef B_H\n#define B_H\nint b;\n#endif\n");
+  dir.write("a.h", "#include <b.h>\nint a;\n");
+  dir.write("main.c", "#include \"a.h\"\n#include <b.h>\nint x;\n");
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs = {dir.path().string(), (dir / "sys").string()};
+  options->inputs = {(dir / "main.c").string()};
+  options->output = (dir / "main.o").string();
+  options->stats = true;
+  
+  std::ostringstream out;
+  ASSERT_EQ(compile_all(options, out), 0) << out.str();
+  string report = out.str();
+  
+  ASSERT_EQ(report.rfind("*** Statistics for " + options->inputs[0] + "\n", 0), 0) << report;
+  EXPECT_NE(report.find("\n  Parse "), string::npos) << report;
+  EXPECT_NE(report.find("\n  CodeGen "), string::npos) << report;
+  EXPECT_NE(report.find("Files: 3 read"), string::npos) << report;
+  EXPECT_NE(report.find("Include depth: max 2\n"), string::npos) << report;
+  // a.h is found in the first directory, and b.h both times in the second
+  EXPECT_NE(report.find("Include lookups: 5, 2 found no file\n"), string::npos) << report;
+  // int x, int a and int b
+  EXPECT_NE(report.find("         3  int\n"), string::npos) << report;
+  
+  // what was read before a failure is still counted
+  dir.write("bad.c", "#include \"a.h\"\n#include \"missing.h\"\n");
+  options->inputs = {(dir / "bad.c").string()};
+  out.str("");
+  ASSERT_EQ(compile_all(options, out), 1) << out.str();
+  report = out.str();
+  EXPECT_NE(report.find("error: "), string::npos) << report;
+  EXPECT_NE(report.find("Files: 3 read"), string::npos) << report;
+  
+}
+
+TEST(Driver, CompileServer) {
+  ScratchDir dir("driver_server");
+  for (const char *project : {"one", "two"}) {
+    dir.write(std::filesystem::path(project) / "main.c", "#include \"a.h\"\n#include \"b.h\"\nint x = VALUE;\n");
+  }
+  dir.write("one/inc/a.h", "#define VALUE 1\n");
+  dir.write("two/inc/a.h", "#define VALUE 3\n");
+  dir.write("two/inc/b.h", "int b;\n");
+  
+  string socket = (dir / "server.sock").string();
+  CompileServer server(socket);
+  ServingThread serving(server);
+  WorkingDirectory inProject;
+  
+  // relative paths are taken from the client's working directory
+  auto compile = [&](const char *project, string &out, string &err) {
+    inProject.change(dir / project);
+    std::ostringstream outStream;
+    std::ostringstream errStream;
+    int status = run_client(socket, {"-E", "-I", "inc", "main.c"}, outStream, errStream);
+    out = outStream.str();
+    err = errStream.str();
+    return status;
+  };
+  string out;
+  string err;
+  
+  ASSERT_EQ(compile("one", out, err), 1);
+  EXPECT_EQ(err, "main.c: error: Could not find include file: b.h\n");
+  
+  // the directory changed, so the missing file is looked for again
+  dir.write("one/inc/b.h", "int b;\n");
+  ASSERT_EQ(compile("one", out, err), 0) << err;
+  EXPECT_NE(out.find("x = 1"), string::npos) << out;
+  
+  // the same relative include directory, but in another project
+  ASSERT_EQ(compile("two", out, err), 0) << err;
+  EXPECT_NE(out.find("x = 3"), string::npos) << out;
+  
+  // edited in place, so only its modification time and contents change
+  auto header = dir / "one" / "inc" / "a.h";
+  auto written = std::filesystem::last_write_time(header);
+  std::ofstream(header) << "#define VALUE 2\n";
+  std::filesystem::last_write_time(header, written + std::chrono::seconds(1));
+  ASSERT_EQ(compile("one", out, err), 0) << err;
+  EXPECT_NE(out.find("x = 2"), string::npos) << out;
+  
+  size_t hits = HeaderCache::shared().hits();
+  ASSERT_EQ(compile("one", out, err), 0) << err;
+  EXPECT_NE(out.find("x = 2"), string::npos) << out;
+  EXPECT_EQ(HeaderCache::shared().hits(), hits + 2);
+  
+  serving.stop();
+  EXPECT_EQ(server.requests_answered(), 5);
+  
+}
+
+TEST(Driver, HeaderCacheDropsChangedFiles) {
+  ScratchDir dir("driver_header_cache");
+  string kept = dir.write("kept.h", "int kept;\n");
+  string saved = dir.write("saved.h", "int a;\n");
+  string removed = dir.write("removed.h", "int r;\n");
+  
+  HeaderCache cache;
+  auto held = cache.open(saved);
+  ASSERT_TRUE(held && cache.open(kept) && cache.open(removed));
+  cache.revalidate();
+  EXPECT_EQ(cache.size(), 3);
+  
+  // saved as editors do, by renaming a new file over the old one, which gives it another ID
+  std::filesystem::rename(dir.write("saved.h.new", "int b;\n"), saved);
+  std::filesystem::remove(removed);
+  cache.revalidate();
+  EXPECT_EQ(cache.size(), 1);
+  
+  // a header already handed out stays as it was read
+  EXPECT_EQ(std::string_view(held->source->begin(), held->source->size()), "int a;\n");
+  
+}
+
+TEST(Driver, CompileServerRejectsMalformedRequests) {
+  ScratchDir dir("driver_server_malformed");
+  string main = dir.write("main.c", "int x = 1;\n");
+  string socketPath = (dir / "server.sock").string();
+  CompileServer server(socketPath);
+  ServingThread serving(server);
+  
+  // sends words as they are, and returns whether the server answered them before closing the connection
+  auto send_words = [&](const std::vector<uint32_t> &words) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    socketPath.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    EXPECT_EQ(connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    EXPECT_EQ(write(fd, words.data(), words.size() * sizeof(uint32_t)),
+              static_cast<ssize_t>(words.size() * sizeof(uint32_t)));
+    CompileResponse response;
+    bool answered = receive_response(fd, response);
+    close(fd);
+    return answered;
+  };
+  
+  // too many arguments, then a directory and an argument that are too long
+  EXPECT_FALSE(send_words({0xFFFFFFF0u, 0}));
+  EXPECT_FALSE(send_words({1, 0xFFFFFFF0u}));
+  EXPECT_FALSE(send_words({1, 0, 0xFFFFFFF0u}));
+  
+  // and the server is still there for the next request
+  std::ostringstream out;
+  std::ostringstream err;
+  EXPECT_EQ(run_client(socketPath, {"-E", main}, out, err), 0) << err.str();
+  EXPECT_NE(out.str().find("x = 1"), string::npos) << out.str();
+  
+  // tracing is for the whole process, so it is refused rather than mixing the spans of several requests
+  std::ostringstream traceErr;
+  EXPECT_EQ(run_client(socketPath, {"-ftime-trace", "-E", main}, out, traceErr), 1);
+  EXPECT_EQ(traceErr.str(), "error: -ftime-trace cannot be sent to a compile server\n");
+  
+  serving.stop();
+  EXPECT_EQ(server.requests_answered(), 2);
+  
+}
+
+TEST(Driver, CompileCache) {
+  ScratchDir dir("driver_cache");
+  dir.write("a.h", "#define N 1\nint a;\n");
+  dir.write("main.c", "#include \"a.h\"\nint x = N;\n");
+  dir.write("other.c", "int y;\n");
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs = {dir.path().string()};
+  options->inputs = {(dir / "main.c").string()};
+  options->output = (dir / "main.o").string();
+  options->cache_dir = (dir / "cache").string();
+  options->verbose = true;
+  
+  auto compile = [&] {
+    std::ostringstream out;
+    EXPECT_EQ(compile_all(options, out), 0) << out.str();
+    return out.str();
+  };
+  
+  EXPECT_EQ(compile(), "Compile cache: 0 hits, 1 misses\n");
+  std::filesystem::remove(options->output);
+  
+  // a comment and an unused macro leave the preprocessed tokens as they were
+  dir.write("a.h", "// touched\n#define N 1\n#define UNUSED 2\nint a;\n");
+  EXPECT_EQ(compile(), "Compile cache: 1 hits, 0 misses\n");
+  ASSERT_TRUE(std::filesystem::exists(options->output));
+  
+  dir.write("a.h", "#define N 2\nint a;\n");
+  EXPECT_EQ(compile(), "Compile cache: 0 hits, 1 misses\n");
+  
+  auto objects = [&] {
+    size_t count = 0;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(dir / "cache")) {
+      count += entry.path().extension() == ".o";
+    }
+    return count;
+  };
+  ASSERT_EQ(objects(), 2);
+  
+  // room for little more than one object, so storing another removes the least recently used
+  options->cache_size = std::filesystem::file_size(options->output) * 3 / 2;
+  options->inputs = {(dir / "other.c").string()};
+  options->output = (dir / "other.o").string();
+  EXPECT_EQ(compile(), "Compile cache: 0 hits, 1 misses\n");
+  ASSERT_EQ(objects(), 1);
+  EXPECT_EQ(compile(), "Compile cache: 1 hits, 0 misses\n");
+  
+}
+
+// Spellings that only just fit in the hasher's block, with the line hashed after them
+TEST(Driver, TokenHasherLongSpellings) {
+  for (size_t length = 4084; length <= 4096; length++) {
+    SourceManager sources;
+    Interner strings;
+    string literal = "\"" + string(length - 2, 'x') + "\"";
+    const SourceBuffer *buffer = sources.add(SourceBuffer::from_text("int a;\n" + literal + "\nb\n"));
+    Lexer lexer(*buffer, strings, sources.start_of(*buffer));
+    
+    // each token's type, spelling length, spelling and line, hashed in one go
+    TokenHasher hasher(true);
+    string bytes;
+    for (CToken token = lexer.next(); token.type != CTokenType::CEndOfFile; token = lexer.next()) {
+      hasher.add(token, strings, sources);
+      std::string_view spelling = strings.get(token.value);
+      auto size = static_cast<uint32_t>(spelling.size());
+      auto line = static_cast<uint32_t>(sources.position(token.location).line);
+      bytes += static_cast<char>(token.type);
+      bytes.append(reinterpret_cast<const char *>(&size), sizeof(size));
+      bytes += spelling;
+      bytes.append(reinterpret_cast<const char *>(&line), sizeof(line));
+    }
+    llvm::MD5 md5;
+    md5.update(bytes);
+    md5.update("extra");
+    llvm::MD5::MD5Result expected;
+    md5.final(expected);
+    EXPECT_EQ(hasher.finish("extra"), string(expected.digest().str())) << length;
+  }
+}
+
+TEST(Driver, CodeGenThreads) {
+  ScratchDir dir("driver_codegen");
+  CodeGen::initialize_targets();
+  
+  auto options = std::make_shared<Options>();
+  options->codegen_threads = 4;
+  CodeGen codegen("split", options);
+  llvm::Module &module = codegen.module();
+  llvm::LLVMContext &context = module.getContext();
+  llvm::Type *i32 = llvm::Type::getInt32Ty(context);
+  auto *type = llvm::FunctionType::get(i32, {i32}, false);
+  
+  // an internal helper, which partitions other than its own call through a promoted name
+  auto *helper = llvm::Function::Create(type, llvm::Function::InternalLinkage, "helper", module);
+  llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", helper));
+  builder.CreateRet(builder.CreateMul(helper->getArg(0), builder.getInt32(3)));
+  for (int i = 0; i < 8; i++) {
+    auto *function = llvm::Function::Create(type, llvm::Function::ExternalLinkage, "f" + std::to_string(i), module);
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+    llvm::Value *called = builder.CreateCall(helper, {function->getArg(0)});
+    builder.CreateRet(builder.CreateAdd(called, builder.getInt32(i)));
+  }
+  
+  string path = (dir / "split.o").string();
+  codegen.emit_object(path);
+  
+  auto object = llvm::object::ObjectFile::createObjectFile(path);
+  ASSERT_TRUE(static_cast<bool>(object)) << llvm::toString(object.takeError());
+  ASSERT_TRUE(object->getBinary()->isRelocatableObject());
+  std::set<string> defined;
+  for (const llvm::object::SymbolRef &symbol : object->getBinary()->symbols()) {
+    auto name = symbol.getName();
+    auto flags = symbol.getFlags();
+    if (name && flags && !(*flags & llvm::object::SymbolRef::SF_Undefined)) {
+      defined.insert(name->str());
+    }
+  }
+  for (int i = 0; i < 8; i++) {
+    EXPECT_TRUE(defined.count("f" + std::to_string(i))) << i;
+  }
+  
+}
+
+TEST(Driver, LinkTimeOptimization) {
+  ScratchDir dir("driver_lto");
+  CodeGen::initialize_targets();
+  
+  for (auto mode : {Options::LTOMode::Full, Options::LTOMode::Thin}) {
+    auto options = std::make_shared<Options>();
+    options->lto = mode;
+    
+    // get() in one module and its caller in another, so only optimizing across them can inline it
+    std::vector<string> inputs;
+    for (const char *name : {"get", "use"}) {
+      CodeGen codegen(name, options);
+      llvm::Module &module = codegen.module();
+      llvm::LLVMContext &context = module.getContext();
+      auto *type = llvm::FunctionType::get(llvm::Type::getInt32Ty(context), false);
+      llvm::Function *get = llvm::Function::Create(type, llvm::Function::ExternalLinkage, "get", module);
+      llvm::IRBuilder<> builder(context);
+      if (string(name) == "get") {
+        builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", get));
+        builder.CreateRet(builder.getInt32(42));
+      } else {
+        auto *use = llvm::Function::Create(type, llvm::Function::ExternalLinkage, "use", module);
+        builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", use));
+        builder.CreateRet(builder.CreateAdd(builder.CreateCall(get), builder.getInt32(1)));
+      }
+      inputs.push_back((dir / (string(name) + ".o")).string());
+      codegen.emit_object(inputs.back());
+      
+      std::ifstream file(inputs.back(), std::ios::binary);
+      char magic[2] = {};
+      file.read(magic, 2);
+      ASSERT_EQ(string(magic, 2), "BC");
+    }
+    
+    string output = (dir / "linked.o").string();
+    link_lto(inputs, output, 2);
+    
+    auto object = llvm::object::ObjectFile::createObjectFile(output);
+    ASSERT_TRUE(static_cast<bool>(object)) << llvm::toString(object.takeError());
+    ASSERT_TRUE(object->getBinary()->isRelocatableObject());
+    std::set<string> defined;
+    std::set<string> undefined;
+    for (const llvm::object::SymbolRef &symbol : object->getBinary()->symbols()) {
+      auto name = symbol.getName();
+      auto flags = symbol.getFlags();
+      if (name && flags && !name->empty()) {
+        (*flags & llvm::object::SymbolRef::SF_Undefined ? undefined : defined).insert(name->str());
+      }
+    }
+    EXPECT_TRUE(defined.count("get"));
+    EXPECT_TRUE(defined.count("use"));
+    EXPECT_FALSE(undefined.count("get"));
+  }
+  
+}
@@ -1,7 +1,14 @@
 #include <gtest/gtest.h>
 #include <lexer.h>
+#include <token_buffer.h>
+#include <scan.h>
+#include <literal.h>
+#include <keywords.h>
+#include <random>
 #include <filesystem>
 
+#include "scratch_dir.h"
+
 static string CWD = std::filesystem::path(__FILE__).parent_path().string();
 static string TEST_DIR = CWD + "/test_files/";
 
@@ -13,19 +20,21 @@ TEST(Lexer, TestFileOpenAndRead) {
     FAIL();
   }
   
-  Lexer lexer(static_cast<std::istream &>(source));
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(source), strings);
 }
 
 TEST(Lexer, AllKeywords) {
   string source = "auto break case char const continue default do double else enum extern float for goto if inline int long register restrict return short signed sizeof static struct switch typedef union unsigned void volatile while _Bool _Complex _Imaginary";
   std::istringstream sourceStream(source);
   
-  Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
   
   for (int i = 0; i < 32; i++) {
     token = lexer.next();
-    ASSERT_EQ(token->type, CTokenType(i));
+    ASSERT_EQ(token.type, CTokenType(i));
   }
 }
 
@@ -34,12 +43,13 @@ TEST(Lexer, AllKeywordsWithExtraChars) {
   string source = "autoo breakk casee charr constt continuee defaultt doo doublee elsee enumm externn floatt forr gotoo iff inlinee intt longg registerr restricct returnn shortt signedd sizeoff staticc structt switchh typedeff unionn unsignedd voidd volatilee whilee _Booll _Complexx _Imaginaryy";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
   
   for (int i = 0; i < 32; i++) {
     token = lexer.next();
-    ASSERT_EQ(token->type, CTokenType::CIdentifier);
+    ASSERT_EQ(token.type, CTokenType::CIdentifier);
   }
 }
 
@@ -48,12 +58,13 @@ TEST(Lexer, AllKeywordsWithCharsMissing) {
   string source = "aut brak cas cha cons cont defaul d doubl els enu exter floa fo got i inlin in lo registe restric retur shor signe sizeo stat struc switc typede unio unsigne voi volatil whil _Boo _Compl _Imaginar";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
   
   for (int i = 0; i < 32; i++) {
     token = lexer.next();
-    ASSERT_EQ(token->type, CTokenType::CIdentifier);
+    ASSERT_EQ(token.type, CTokenType::CIdentifier);
   }
 }
 
@@ -61,88 +72,92 @@ TEST(Lexer, Punctuation) {
   string source = "(){}[],;:?\\.->...";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
-  
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationOpenParen);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationCloseParen);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationOpenBrace);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationCloseBrace);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationOpenBracket);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationCloseBracket);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationComma);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationSemicolon);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationColon);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationQuestionMark);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationBackslash);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationDot);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationArrow);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPunctuationEllipsis);
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
+  
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationOpenParen);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationCloseParen);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationOpenBrace);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationCloseBrace);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationOpenBracket);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationCloseBracket);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationComma);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationSemicolon);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationColon);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationQuestionMark);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationBackslash);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationDot);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationArrow);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPunctuationEllipsis);
 }
 
 TEST(Lexer, Operators) {
   string source = ">=<=&&||!&|^~<<>> =+=-=*=/=%=&=|=^=<<=>>=";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
-  
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorGreaterEqual);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorLessEqual);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorAnd);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorOr);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorNot);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorBitwiseAnd);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorBitwiseOr);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorBitwiseXor);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorBitwiseNot);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorLeftShift);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorRightShift);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorAssignment);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorPlusAssign);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorMinusAssign);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorMultiplyAssign);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorDivideAssign);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorModuloAssign);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorAndAssign);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorOrAssign);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorXorAssign);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorLeftShiftAssign);
-  ASSERT_EQ(lexer.next()->type, CTokenType::COperatorRightShiftAssign);
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
+  
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorGreaterEqual);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorLessEqual);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorAnd);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorOr);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorNot);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorBitwiseAnd);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorBitwiseOr);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorBitwiseXor);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorBitwiseNot);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorLeftShift);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorRightShift);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorAssignment);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorPlusAssign);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorMinusAssign);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorMultiplyAssign);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorDivideAssign);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorModuloAssign);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorAndAssign);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorOrAssign);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorXorAssign);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorLeftShiftAssign);
+  ASSERT_EQ(lexer.next().type, CTokenType::COperatorRightShiftAssign);
 }
 
 TEST(Lexer, Preprocessor) {
   string source = "#define #include #if #ifdef #ifndef #else #elif #endif #undef #line #error #pragma ##";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
   
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorDefine);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorInclude);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorIf);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorIfdef);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorIfndef);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorElse);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorElif);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorEndif);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorUndef);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorLine);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorError);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorPragma);
-  ASSERT_EQ(lexer.next()->type, CTokenType::CPreprocessorHashHash);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorDefine);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorInclude);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorIf);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorIfdef);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorIfndef);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorElse);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorElif);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorEndif);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorUndef);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorLine);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorError);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorPragma);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorHashHash);
 }
 
 TEST(Lexer, Integers) {
   string source = "0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
   
   for (int i = 0; i < 16; i++) {
     token = lexer.next();
-    ASSERT_EQ(token->type, CTokenType::CConstantInteger);
+    ASSERT_EQ(token.type, CTokenType::CConstantInteger);
   }
 }
 
@@ -150,25 +165,73 @@ TEST(Lexer, Floats) {
   string source = "0.0 1.0 2.0 3.0 4.0 5.0 6.0 7.0 8.0 9.0 10.0 11.0 12.0 13.0 14.0 15.0";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
   
   for (int i = 0; i < 16; i++) {
     token = lexer.next();
-    ASSERT_EQ(token->type, CTokenType::CConstantFloat);
+    ASSERT_EQ(token.type, CTokenType::CConstantFloat);
   }
 }
 
+TEST(Lexer, NumericConstants) {
+  string source = "42 0x1fUL 017 4294967295 0xffffffff 9223372036854775808 10ll 3u 08 18446744073709551616 "
+                  "1.5e-3f .5 0x1p-3 1e+5L 0x1e5 1.2.3 10px";
+  std::istringstream sourceStream(source);
+  
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  auto next = [&](CTokenType type) {
+    CToken token = lexer.next();
+    EXPECT_EQ(token.type, type) << strings.get(token.value);
+    return strings.number(token.value);
+  };
+  auto integer = [&](uint64_t value, Number::Type type) {
+    Number number = next(CTokenType::CConstantInteger);
+    EXPECT_TRUE(number.valid());
+    EXPECT_EQ(number.integer, value);
+    EXPECT_EQ(number.type, type);
+  };
+  auto floating = [&](double value, Number::Type type) {
+    Number number = next(CTokenType::CConstantFloat);
+    EXPECT_TRUE(number.valid());
+    EXPECT_EQ(number.floating, value);
+    EXPECT_EQ(number.type, type);
+  };
+  
+  integer(42, Number::Type::Int);
+  integer(31, Number::Type::UnsignedLong);
+  integer(15, Number::Type::Int);
+  integer(4294967295, Number::Type::Long);
+  integer(0xffffffff, Number::Type::UnsignedInt);
+  integer(9223372036854775808u, Number::Type::UnsignedLongLong);
+  integer(10, Number::Type::LongLong);
+  integer(3, Number::Type::UnsignedInt);
+  EXPECT_EQ(next(CTokenType::CConstantInteger).error, Number::Error::Invalid);
+  EXPECT_EQ(next(CTokenType::CConstantInteger).error, Number::Error::TooLarge);
+  
+  floating(static_cast<double>(1.5e-3f), Number::Type::Float);
+  floating(0.5, Number::Type::Double);
+  floating(0.125, Number::Type::Double);
+  floating(1e5, Number::Type::LongDouble);
+  integer(0x1e5, Number::Type::Int);
+  EXPECT_EQ(next(CTokenType::CConstantFloat).error, Number::Error::Invalid);
+  EXPECT_EQ(next(CTokenType::CConstantInteger).error, Number::Error::Invalid);
+  ASSERT_EQ(lexer.next().type, CTokenType::CEndOfFile);
+}
+
 TEST(Lexer, Character) {
   string source = "'a' 'b' 'c' 'd' 'e' 'f' 'g' 'h' 'i' 'j' 'k' 'l' 'm' 'n' 'o' 'p' 'q' 'r' 's' 't' 'u' 'v' 'w' 'x' 'y' 'z' 'A' 'B' 'C' 'D' 'E' 'F' 'G' 'H' 'I' 'J' 'K' 'L' 'M' 'N' 'O' 'P' 'Q' 'R' 'S' 'T' 'U' 'V' 'W' 'X' 'Y' 'Z' '0' '1' '2' '3' '4' '5' '6' '7' '8' '9' ' '";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
   
   for (int i = 0; i < 62; i++) {
     token = lexer.next();
-    ASSERT_EQ(token->type, CTokenType::CConstantChar);
+    ASSERT_EQ(token.type, CTokenType::CConstantChar);
   }
 }
 
@@ -176,12 +239,13 @@ TEST(Lexer, EscapeChar) {
   string source = R"('\xff' '\xf' '\021' '\377' '\7' '\n' '\t' '\r' '\0' '\'' '\"' '\\' )";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
   
   for (int i = 0; i < 12; i++) {
     token = lexer.next();
-    ASSERT_EQ(token->type, CTokenType::CConstantChar);
+    ASSERT_EQ(token.type, CTokenType::CConstantChar);
   }
 }
 
@@ -189,20 +253,84 @@ TEST(Lexer, EscapeCharInString) {
   string source = R"("\xff" "\xf" "\021" "\377" "\7" "\n" "\t" "\r" "\0" "\'" "\"")";
   std::istringstream sourceStream(source);
   
- Lexer lexer(static_cast<std::istream &>(sourceStream));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken token;
   
   for (int i = 0; i < 10; i++) {
     token = lexer.next();
-    ASSERT_EQ(token->type, CTokenType::CConstantString);
+    ASSERT_EQ(token.type, CTokenType::CConstantString);
+  }
+}
+
+TEST(Lexer, StringLiteralsKeepTheirSpelling) {
+  std::istringstream sourceStream(R"("plain" "tab\there \"q\" \x41\101\0" "spl\
+iced" 'a' '\n' '\377' 'ab')");
+  
+  Interner strings;
+  SourceManager sources;
+  const SourceBuffer *source = sources.add(SourceBuffer::from_stream(sourceStream));
+  Lexer lexer(*source, strings, sources.start_of(*source));
+  CToken tokens[7];
+  for (CToken &token : tokens) {
+    token = lexer.next();
   }
+  ASSERT_EQ(lexer.next().type, CTokenType::CEndOfFile);
+  
+  ASSERT_EQ(tokens[0].getSpelling(strings), "\"plain\"");
+  ASSERT_FALSE(tokens[0].flags & CToken::has_escapes);
+  ASSERT_EQ(tokens[1].getSpelling(strings), R"("tab\there \"q\" \x41\101\0")");
+  ASSERT_TRUE(tokens[1].flags & CToken::has_escapes);
+  ASSERT_EQ(sources.position(tokens[3].location).line, 2);
+  
+  string decoded;
+  decode_string(strings.get(tokens[1].value), true, decoded);
+  ASSERT_EQ(decoded, string("tab\there \"q\" AA\0", 16));
+  ASSERT_EQ(concatenate_strings(tokens, tokens + 3, strings), "plain" + decoded + "spliced");
+  
+  ASSERT_EQ(tokens[3].getSpelling(strings), "'a'");
+  ASSERT_EQ(decode_char(strings.get(tokens[3].value), false), 'a');
+  ASSERT_EQ(decode_char(strings.get(tokens[4].value), true), '\n');
+  ASSERT_EQ(decode_char(strings.get(tokens[5].value), true), -1);
+  ASSERT_EQ(decode_char(strings.get(tokens[6].value), false), 'a' << 8 | 'b');
+  
+  ASSERT_THROW(decode_string(R"("\q")", true, decoded), std::runtime_error);
+  ASSERT_THROW(decode_string(R"("\x")", true, decoded), std::runtime_error);
+  ASSERT_THROW(decode_string(R"("\777")", true, decoded), std::runtime_error);
+}
+
+TEST(Lexer, SpliceAfterEscapeBackslash) {
+  // once the splices are gone these are "a\n" and '\''
+  std::istringstream sourceStream("\"a\\\\\nn\" '\\\\\n\\\n'' x");
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  CToken text = lexer.next();
+  CToken character = lexer.next();
+  ASSERT_EQ(text.type, CTokenType::CConstantString);
+  ASSERT_EQ(character.type, CTokenType::CConstantChar);
+  ASSERT_EQ(lexer.next().type, CTokenType::CIdentifier);
+  
+  std::string decoded;
+  decode_string(strings.get(text.value), true, decoded);
+  ASSERT_EQ(decoded, "a\n");
+  ASSERT_EQ(decode_char(strings.get(character.value), true), '\'');
+  
+}
+
+TEST(Lexer, StringEndsAtNewline) {
+  std::istringstream sourceStream("\"abc\n\" '\n' ''");
+  
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  ASSERT_EQ(lexer.next().type, CTokenType::CUnknown);
 }
 
 TEST(Lexer, Stdio) {
   std::ifstream source("/usr/include/stdio.h");
   
- Lexer lexer(static_cast<std::istream &>(source));
-  unique_ptr<CToken> token;
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(source), strings);
+  CToken token;
 
   int count = 0;
   
@@ -215,15 +343,353 @@ TEST(Lexer, Stdio) {
     token = lexer.next();
     count ++;
     
-    actual_source += *token->value;
+    actual_source += token.getSpelling(strings);
     
-    if (token->type == CTokenType::CEndOfFile) {
+    if (token.type == CTokenType::CEndOfFile) {
       return;
     }
     
     // Fail if the token is unknown, if the actual source is longer than the expected source, or if the actual source does not match the expected source generated so far
-    if (token->type == CTokenType::CUnknown || actual_source.length() > expected_source.length() || actual_source != expected_source.substr(0, actual_source.length())) {
+    if (token.type == CTokenType::CUnknown || actual_source.length() > expected_source.length() || actual_source != expected_source.substr(0, actual_source.length())) {
       FAIL();
     }
   }
-}
\ No newline at end of file
+}
+// Large enough to be mapped, and ending exactly on a page boundary so the sentinel comes from the padding pages
+TEST(Lexer, MappedFileEndingOnPageBoundary) {
+  string source;
+  while (source.size() < 4 * 4096) {
+    source += "int x ;\n";
+  }
+  source.resize(8 * 4096, ' ');
+  ScratchDir dir("lexer_mapped");
+  string path = dir.write("mapped.c", source);
+  
+  auto buffer = SourceBuffer::from_file(path);
+  ASSERT_TRUE(buffer);
+  ASSERT_TRUE(buffer->is_mapped());
+  ASSERT_EQ(buffer->size(), source.size());
+  ASSERT_EQ(*buffer->end(), '\0');
+  
+  Interner strings;
+  Lexer lexer(*buffer, strings);
+  int count = 0;
+  while (lexer.next().type != CTokenType::CEndOfFile) {
+    count++;
+  }
+  ASSERT_EQ(count, 4 * 4096 / 8 * 3);
+}
+
+TEST(Lexer, UnterminatedString) {
+  std::istringstream sourceStream("\"abc");
+  
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  ASSERT_EQ(lexer.next().type, CTokenType::CUnknown);
+}
+
+TEST(Lexer, InvalidCharacterIsSkipped) {
+  std::istringstream sourceStream("a @ b\f\v c");
+  
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  ASSERT_EQ(lexer.next().type, CTokenType::CIdentifier);
+  ASSERT_EQ(lexer.next().type, CTokenType::CUnknown);
+  ASSERT_EQ(lexer.next().type, CTokenType::CIdentifier);
+  ASSERT_EQ(lexer.next().type, CTokenType::CIdentifier);
+  ASSERT_EQ(lexer.next().type, CTokenType::CEndOfFile);
+}
+
+TEST(Lexer, IdentifiersShareSymbols) {
+  std::istringstream sourceStream("count + count * other + count");
+  
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  
+  auto first = lexer.next();
+  auto plus = lexer.next();
+  auto second = lexer.next();
+  lexer.next();
+  auto other = lexer.next();
+  
+  ASSERT_EQ(first.type, CTokenType::CIdentifier);
+  ASSERT_EQ(first.value, second.value);
+  ASSERT_NE(first.value, other.value);
+  ASSERT_EQ(plus.value, Interner::none);
+  ASSERT_EQ(plus.getSpelling(strings), "+");
+  ASSERT_EQ(other.getSpelling(strings), "other");
+  
+  // the empty string plus the two distinct identifiers
+  ASSERT_EQ(strings.size(), 3);
+}
+
+TEST(Lexer, InternerKeepsViewsStable) {
+  Interner strings;
+  Symbol first = strings.intern("first");
+  std::string_view view = strings.get(first);
+  
+  // force the table and the string storage to grow
+  for (int i = 0; i < 100000; i++) {
+    strings.intern("name" + std::to_string(i));
+  }
+  
+  ASSERT_EQ(strings.intern("first"), first);
+  ASSERT_EQ(view.data(), strings.get(first).data());
+  ASSERT_EQ(strings.get(strings.intern("name99999")), "name99999");
+}
+
+TEST(Lexer, TokenBufferReplaysLexer) {
+  auto source = SourceBuffer::from_file("/usr/include/stdio.h");
+  ASSERT_TRUE(source);
+  
+  Interner strings;
+  auto buffer = TokenBuffer::lex(*source, strings);
+  ASSERT_EQ(buffer->type(buffer->size() - 1), CTokenType::CEndOfFile);
+  
+  Lexer lexer(*source, strings);
+  TokenReader reader(*buffer);
+  
+  for (size_t i = 0; i < buffer->size(); i++) {
+    CToken expected = lexer.next();
+    CToken actual = reader.next();
+    ASSERT_EQ(actual.type, expected.type);
+    ASSERT_EQ(actual.value, expected.value);
+    ASSERT_EQ(buffer->offset(i), lexer.token_offset());
+  }
+  
+  // reading past the end keeps returning end of file
+  ASSERT_EQ(reader.next().type, CTokenType::CEndOfFile);
+}
+
+TEST(Lexer, TokenBufferLineNumbers) {
+  std::istringstream sourceStream("int a;\n\n  b = 1;\n");
+  auto source = SourceBuffer::from_stream(sourceStream);
+  
+  Interner strings;
+  SourceManager sources;
+  auto other = SourceBuffer::from_text("// another file first\n");
+  sources.start_of(*other);
+  auto buffer = TokenBuffer::lex(*source, strings);
+  TokenReader reader(*buffer, sources.start_of(*source));
+  
+  reader.next();
+  reader.next();
+  reader.next();
+  CToken b = reader.next();
+  ASSERT_EQ(b.getSpelling(strings), "b");
+  SourcePosition at = sources.position(b.location);
+  ASSERT_EQ(at.buffer, source.get());
+  ASSERT_EQ(at.line, 3);
+  ASSERT_EQ(at.column, 3);
+}
+
+// Re-lexing around an edit has to give the same tokens as lexing the edited text from scratch
+TEST(Lexer, RelexMatchesFullLex) {
+  const std::vector<string> pieces = {"int", " ", "x", "\n", "#define A 1\n", "/*", "*/", "//", "\"s\"", "'c'", "+",
+                                      "=", "12", "0x1f", ".", "\\\n", "\t", "#", "if", "(", ")", ";", "\""};
+  std::mt19937 rng(17);
+  auto random_text = [&](size_t count) {
+    string text;
+    for (size_t i = 0; i < count; i++) {
+      text += pieces[rng() % pieces.size()];
+    }
+    return text;
+  };
+  
+  for (int round = 0; round < 300; round++) {
+    Interner strings;
+    auto source = SourceBuffer::from_text(random_text(rng() % 80));
+    auto buffer = TokenBuffer::lex(*source, strings);
+    
+    for (int step = 0; step < 10; step++) {
+      auto offset = static_cast<uint32_t>(rng() % (source->size() + 1));
+      auto removed = static_cast<uint32_t>(rng() % (source->size() - offset + 1) % 8);
+      string text = random_text(rng() % 3);
+      auto edited = SourceBuffer::from_edit(*source, offset, removed, text);
+      TokenBuffer::Damage damage = buffer->relex(*edited, offset, removed, static_cast<uint32_t>(text.size()),
+                                                 strings);
+      source = std::move(edited);
+      
+      auto expected = TokenBuffer::lex(*source, strings);
+      string context = "round " + std::to_string(round) + " step " + std::to_string(step) + ": " +
+                       string(source->begin(), source->size());
+      ASSERT_EQ(buffer->size(), expected->size()) << context;
+      ASSERT_LE(damage.first + damage.inserted, buffer->size()) << context;
+      for (size_t i = 0; i < buffer->size(); i++) {
+        ASSERT_EQ(buffer->type(i), expected->type(i)) << context << " token " << i;
+        ASSERT_EQ(buffer->flags(i), expected->flags(i)) << context << " token " << i;
+        ASSERT_EQ(buffer->offset(i), expected->offset(i)) << context << " token " << i;
+        ASSERT_EQ(buffer->payload(i), expected->payload(i)) << context << " token " << i;
+      }
+    }
+  }
+}
+
+// Every vector kernel has to agree with the scalar loops, wherever the interesting characters fall in a vector
+TEST(Lexer, ScanKernelsMatchScalar) {
+  const string alphabet = "  \t\r\n\n*//*aZ_9.#\"'\\x\x80";
+  std::mt19937 rng(7);
+  auto kernels = available_scan_kernels();
+  const ScanKernels *scalar = kernels.front();
+  
+  for (int round = 0; round < 2000; round++) {
+    std::istringstream sourceStream([&] {
+      string text(rng() % 200, ' ');
+      for (char &ch : text) {
+        ch = alphabet[rng() % alphabet.size()];
+      }
+      return text;
+    }());
+    auto source = SourceBuffer::from_stream(sourceStream);
+    
+    for (const char *p = source->begin(); p <= source->end(); p++) {
+      for (const ScanKernels *kernel : kernels) {
+        bool expectedNewline = false, actualNewline = false;
+        ASSERT_EQ(kernel->skip_whitespace(p, actualNewline), scalar->skip_whitespace(p, expectedNewline)) << kernel->name;
+        ASSERT_EQ(actualNewline, expectedNewline) << kernel->name;
+        
+        ASSERT_EQ(kernel->find_comment_end(p), scalar->find_comment_end(p)) << kernel->name;
+        
+        ASSERT_EQ(kernel->find_line_end(p), scalar->find_line_end(p)) << kernel->name;
+        ASSERT_EQ(kernel->skip_identifier(p), scalar->skip_identifier(p)) << kernel->name;
+        ASSERT_EQ(kernel->skip_digits(p), scalar->skip_digits(p)) << kernel->name;
+        ASSERT_EQ(kernel->find_inactive_stop(p), scalar->find_inactive_stop(p)) << kernel->name;
+        ASSERT_EQ(kernel->find_string_stop(p), scalar->find_string_stop(p)) << kernel->name;
+      }
+    }
+  }
+}
+
+TEST(Lexer, LinesCountedThroughComments) {
+  auto source = SourceBuffer::from_text("/* one\ntwo\n*/ a // three\n\n   b");
+  
+  Interner strings;
+  SourceManager sources;
+  Lexer lexer(*source, strings, sources.start_of(*source));
+  
+  SourcePosition a = sources.position(lexer.next().location);
+  ASSERT_EQ(a.line, 3);
+  ASSERT_EQ(a.column, 4);
+  SourcePosition b = sources.position(lexer.next().location);
+  ASSERT_EQ(b.line, 5);
+  ASSERT_EQ(b.column, 4);
+  SourcePosition end = sources.position(lexer.next().location);
+  ASSERT_EQ(end.line, 5);
+  ASSERT_EQ(end.column, 5);
+}
+
+// Each buffer has locations of its own, which stay with the text of a buffer that replaces it
+TEST(Lexer, SourceLocations) {
+  SourceManager sources;
+  auto first = SourceBuffer::from_text("ab\ncd\n");
+  auto second = SourceBuffer::from_text(string("x\0\ny", 4));
+  SourceLocation a = sources.start_of(*first);
+  SourceLocation b = sources.start_of(*second);
+  ASSERT_TRUE(a.valid());
+  ASSERT_EQ(sources.start_of(*first), a);
+  ASSERT_EQ(b.raw, a.raw + first->size() + 1);
+  
+  ASSERT_EQ(sources.position({}).buffer, nullptr);
+  ASSERT_EQ(sources.position(b + 10).buffer, nullptr);
+  SourcePosition at = sources.position(a + 4);
+  ASSERT_EQ(at.buffer, first.get());
+  ASSERT_EQ(at.line, 2);
+  ASSERT_EQ(at.column, 2);
+  
+  // a stray NUL does not end the line table
+  at = sources.position(b + 3);
+  ASSERT_EQ(at.buffer, second.get());
+  ASSERT_EQ(at.line, 2);
+  ASSERT_EQ(at.column, 1);
+  
+  // an edit that fits keeps the range, and one that does not moves it to the end
+  auto shorter = SourceBuffer::from_text("abc\nd");
+  ASSERT_EQ(sources.replace(*first, *shorter), a);
+  ASSERT_EQ(sources.position(a + 5).line, 2);
+  auto longer = SourceBuffer::from_text("abc\nd\n\ne");
+  SourceLocation moved = sources.replace(*shorter, *longer);
+  ASSERT_EQ(moved.raw, b.raw + second->size() + 1);
+  ASSERT_EQ(sources.position(moved + 8).line, 4);
+  ASSERT_EQ(sources.position(a + 5).buffer, longer.get());
+}
+
+TEST(Lexer, KeywordTablesFindEveryWord) {
+  for (const auto &keyword : keyword_hash::keywords) {
+    string word(keyword.spelling);
+    ASSERT_EQ(lookup_keyword(word.data(), word.size()), keyword.type) << word;
+    
+    // the same length with a different last character, and one character longer, are identifiers
+    string changed = word;
+    changed.back() = changed.back() == 'x' ? 'y' : 'x';
+    ASSERT_EQ(lookup_keyword(changed.data(), changed.size()), CTokenType::CIdentifier) << changed;
+    string longer = word + "_";
+    ASSERT_EQ(lookup_keyword(longer.data(), longer.size()), CTokenType::CIdentifier) << longer;
+  }
+  
+  for (const auto &directive : keyword_hash::directives) {
+    string name(directive.spelling);
+    ASSERT_EQ(lookup_directive(name.data(), name.size()), directive.type) << name;
+    ASSERT_EQ(lookup_keyword(name.data(), name.size()) == CTokenType::CIdentifier, name != "if" && name != "else");
+  }
+  
+  ASSERT_EQ(lookup_directive("warning", 7), CTokenType::CUnknown);
+  ASSERT_EQ(lookup_keyword("x", 1), CTokenType::CIdentifier);
+}
+
+TEST(Lexer, DirectiveWithBlanks) {
+  std::istringstream sourceStream("#  define X\n#\tifndef Y\n# warning");
+  
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorDefine);
+  ASSERT_EQ(lexer.next().type, CTokenType::CIdentifier);
+  ASSERT_EQ(lexer.next().type, CTokenType::CPreprocessorIfndef);
+  ASSERT_EQ(lexer.next().type, CTokenType::CIdentifier);
+  
+  // an unknown directive is a lone '#' followed by its name, which the parser deals with
+  CToken hash = lexer.next();
+  ASSERT_EQ(hash.type, CTokenType::CPreprocessorHash);
+  ASSERT_TRUE(hash.flags & CToken::start_of_line);
+  CToken name = lexer.next();
+  ASSERT_EQ(name.type, CTokenType::CIdentifier);
+  ASSERT_EQ(strings.get(name.value), "warning");
+  ASSERT_EQ(name.flags, CToken::leading_space);
+}
+
+TEST(Lexer, TokenFlags) {
+  std::istringstream sourceStream("a b/**/c\\\nd\n  e(f\n");
+  
+  Interner strings;
+  Lexer lexer(static_cast<std::istream &>(sourceStream), strings);
+  
+  // a comment counts as a space, and a line continued with a backslash does not start a new line
+  std::vector<uint8_t> expected = {CToken::start_of_line, CToken::leading_space, CToken::leading_space, 0,
+                                   CToken::start_of_line | CToken::leading_space, 0, 0};
+  for (uint8_t flags : expected) {
+    ASSERT_EQ(lexer.next().flags, flags);
+  }
+}
+
+TEST(Lexer, SkipsInactiveGroups) {
+  // only a directive at the start of a line can end the group, so none of these can
+  std::istringstream sourceStream("if 0\nx /* \n#endif */ \"#endif\" it's\n"
+                                  "// #endif\n  x \\\n#endif\n# if 1\n#else\n#endif\n'\\\n#endif'\n"
+                                  "  /* a */ # elif 2\n#endif\n");
+  
+  Interner strings;
+  SourceManager sources;
+  const SourceBuffer *source = sources.add(SourceBuffer::from_stream(sourceStream));
+  Lexer lexer(*source, strings, sources.start_of(*source));
+  lexer.next();
+  lexer.next();
+  
+  CToken end = lexer.skip_inactive();
+  ASSERT_EQ(end.type, CTokenType::CPreprocessorElif);
+  ASSERT_EQ(end.flags & CToken::start_of_line, CToken::start_of_line);
+  ASSERT_EQ(sources.position(end.location).line, 12);
+  ASSERT_EQ(lexer.next().type, CTokenType::CConstantInteger);
+  
+  ASSERT_EQ(lexer.skip_inactive().type, CTokenType::CPreprocessorEndif);
+  ASSERT_EQ(lexer.skip_inactive().type, CTokenType::CEndOfFile);
+}
@@ -3,10 +3,17 @@
 //
 
 #include <gtest/gtest.h>
+#include <incremental.h>
 #include <options.h>
 #include <parser.h>
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
 #include <memory>
+#include <random>
+#include <sstream>
+
+#include "scratch_dir.h"
 
 using std::string, std::make_unique, std::istringstream, std::unique_ptr;
 
@@ -25,4 +32,609 @@ TEST(Parser, Include) {
   
   Parser parser(stream, options);
   auto ast = parser.parse();
-}
\ No newline at end of file
+}
+
+TEST(Parser, BufferedIncludeReplay) {
+  ScratchDir dir("parser_buffered");
+  dir.write("a.h", "int a;\n");
+  dir.write("main.c", "#include \"a.h\"\n#include \"a.h\"\nint main;\n");
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs.push_back(dir.path().string());
+  options->buffer_tokens = true;
+  
+  Parser parser((dir / "main.c").string(), options);
+  ASSERT_NO_THROW(parser.parse());
+  
+}
+
+TEST(Parser, CircularIncludeThroughSymlink) {
+  ScratchDir dir("parser_circular");
+  dir.write("a.h", "#include \"link.h\"\n");
+  std::filesystem::create_symlink(dir / "a.h", dir / "link.h");
+  dir.write("main.c", "#include \"a.h\"\n");
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs = {dir.path().string()};
+  
+  Parser parser((dir / "main.c").string(), options);
+  ASSERT_THROW(parser.parse(), std::runtime_error);
+  
+}
+
+TEST(Parser, IncludeCacheRemembersMisses) {
+  ScratchDir dir("parser_cache");
+  dir.write("found.h", "int a;\n");
+  
+  IncludeCache cache;
+  ASSERT_EQ(cache.lookup(dir.path().string(), "missing.h"), nullptr);
+  ASSERT_EQ(cache.lookup(dir.path().string(), "missing.h"), nullptr);
+  
+  auto found = cache.lookup(dir.path().string(), "found.h");
+  ASSERT_NE(found, nullptr);
+  ASSERT_EQ(found->id, FileID::of((dir / "found.h").string()));
+  ASSERT_EQ(cache.lookup(dir.path().string(), "found.h"), found);
+  
+  ASSERT_EQ(cache.hits(), 2);
+  ASSERT_EQ(cache.misses(), 2);
+  
+}
+
+// Writes each file into a fresh directory, and parses main.c with that directory on the include path
+static unique_ptr<Parser> parse_files(const string &name, const std::vector<std::pair<string, string>> &files) {
+  ScratchDir dir(name);
+  for (const auto &[filename, contents] : files) {
+    dir.write(filename, contents);
+  }
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs = {dir.path().string()};
+  auto parser = std::make_unique<Parser>((dir / "main.c").string(), options);
+  parser->parse();
+  return parser;
+}
+
+TEST(Parser, GuardedHeaderSkipped) {
+  auto parser = parse_files("parser_guard", {
+    {"a.h", "/* guarded */\n#ifndef A_H\n#define A_H\n#if X\nint x;\n#else\nint y;\n#endif\nint a;\n#endif\n"},
+    {"main.c", "#include \"a.h\"\n#include \"a.h\"\n#include \"a.h\"\nint main;\n"},
+  });
+  ASSERT_EQ(parser->skipped_includes(), 2);
+}
+
+TEST(Parser, UndefinedGuardIncludedAgain) {
+  auto parser = parse_files("parser_guard_undef", {
+    {"a.h", "#ifndef A_H\n#define A_H\nint a;\n#endif\n"},
+    {"main.c", "#include \"a.h\"\n#undef A_H\n#include \"a.h\"\n#include \"a.h\"\n"},
+  });
+  ASSERT_EQ(parser->skipped_includes(), 1);
+}
+
+TEST(Parser, CodeOutsideGuardIncludedAgain) {
+  auto parser = parse_files("parser_guard_outside", {
+    {"a.h", "#ifndef A_H\n#define A_H\nint a;\n#endif\nint b;\n"},
+    {"b.h", "#ifndef B_H\n#define B_H\nint a;\n#else\nint b;\n#endif\n"},
+    {"main.c", "#include \"a.h\"\n#include \"a.h\"\n#include \"b.h\"\n#include \"b.h\"\n"},
+  });
+  ASSERT_EQ(parser->skipped_includes(), 0);
+}
+
+TEST(Parser, PragmaOnceSkipped) {
+  auto parser = parse_files("parser_once", {
+    {"a.h", "#pragma once\nint a;\n"},
+    {"main.c", "#include \"a.h\"\n#include \"a.h\"\n"},
+  });
+  ASSERT_EQ(parser->skipped_includes(), 1);
+}
+
+TEST(Parser, PrecompiledHeaderSkipsHeader) {
+  ScratchDir dir("parser_pch");
+  dir.write("inner.h", "#pragma once\nint inner;\n");
+  dir.write("prefix.h", "#ifndef PREFIX_H\n#define PREFIX_H\n#include \"inner.h\"\n#define FEATURE\n#endif\n");
+  dir.write("main.c", "#include \"prefix.h\"\n#include \"inner.h\"\n#undef FEATURE\nint main;\n");
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs = {dir.path().string()};
+  string pch = (dir / "prefix.pch").string();
+  {
+    Parser parser((dir / "prefix.h").string(), options);
+    parser.parse();
+    parser.emit_pch(pch);
+  }
+  
+  options->include_pch = pch;
+  Parser parser((dir / "main.c").string(), options);
+  parser.parse();
+  ASSERT_EQ(parser.skipped_includes(), 2);
+  
+  // a header the precompiled header was built from has changed
+  std::ofstream(dir / "inner.h", std::ios::app) << "int more;\n";
+  ASSERT_THROW(Parser((dir / "main.c").string(), options), std::runtime_error);
+  
+  std::ofstream(pch, std::ios::trunc) << "not a precompiled header";
+  ASSERT_THROW(Parser((dir / "main.c").string(), options), std::runtime_error);
+  
+}
+
+class CountingVisitor : public ASTVisitor<CountingVisitor> {
+public:
+  int includes = 0;
+  int directives = 0;
+  
+  void visit_include(const AST &, NodeID) { includes++; }
+  void visit_directive(const AST &, NodeID) { directives++; }
+};
+
+TEST(Parser, DirectivesInTree) {
+  ScratchDir dir("parser_tree");
+  dir.write("a.h", "#pragma once\n#define A 1\n");
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs = {dir.path().string()};
+  std::istringstream source("#include \"a.h\"\n#include \"a.h\"\n#ifdef A\n#undef A\n#endif\nint main;\n");
+  Parser parser(source, options);
+  auto ast = parser.parse();
+  
+  const ASTNode &root = (*ast)[ast->root()];
+  ASSERT_EQ(root.kind, ASTKind::TranslationUnit);
+  ASSERT_EQ(root.childCount, 7);
+  
+  CountingVisitor counter;
+  counter.visit(*ast, ast->root());
+  ASSERT_EQ(counter.includes, 2);
+  ASSERT_EQ(counter.directives, 2);
+  
+  std::ostringstream printed;
+  print_ast(*ast, parser.interner(), printed);
+  ASSERT_EQ(printed.str(), "TranslationUnit\n  Include a.h\n  Pragma once\n  Define A\n  Include a.h\n"
+                           "  Directive #ifdef\n  Undef A\n  Directive #endif\n");
+  
+}
+
+TEST(Parser, PipelinedLexingMatchesSerial) {
+  ScratchDir dir("parser_pipeline");
+  dir.write("sys/lib.h", "#ifndef LIB_H\n#define LIB_H\nint lib;\n#endif\n");
+  dir.write("a.h", "#include <lib.h>\n#pragma once\nint a;\n");
+  string main;
+  for (int i = 0; i < 2000; i++) {
+    main += "#include \"a.h\"\n#include <lib.h>\nint x" + std::to_string(i) + " = 1;\n";
+  }
+  dir.write("main.c", main);
+  
+  auto print = [&](bool pipelined) {
+    auto options = std::make_shared<Options>();
+    options->include_dirs = {dir.path().string(), (dir / "sys").string()};
+    options->pipeline_lexing = pipelined;
+    Parser parser((dir / "main.c").string(), options);
+    auto ast = parser.parse();
+    
+    std::ostringstream printed;
+    print_ast(*ast, parser.interner(), printed);
+    printed << parser.skipped_includes() << " includes skipped\n";
+    return printed.str();
+  };
+  
+  ASSERT_EQ(print(true), print(false));
+  
+  // the producer is waiting on an include the parser cannot find when the parser gives up
+  dir.write("main.c", "int a;\n#include \"missing.h\"\nint b;\n");
+  auto options = std::make_shared<Options>();
+  options->pipeline_lexing = true;
+  ASSERT_THROW(Parser((dir / "main.c").string(), options).parse(), std::runtime_error);
+  
+}
+
+// The preprocessor interns the spellings it makes up while the producer is still lexing ahead
+TEST(Parser, PipelinedMacrosMatchSerial) {
+  ScratchDir dir("parser_pipeline_macros");
+  string main = "#define STR(x) #x\n#define CAT(a, b) a ## b\n#define XCAT(a, b) CAT(a, b)\n"
+                "#define AT XCAT(line_, __LINE__)\n";
+  for (int i = 0; i < 4000; i++) {
+    auto n = std::to_string(i);
+    main += "const char *AT = STR(v" + n + " + " + n + ") __FILE__;\nint CAT(x, " + n + ") = CAT(1, " + n + ");\n";
+    main += "#if defined(CAT) && CAT(0x, " + n + ") >= " + n + "\nint XCAT(y, __LINE__);\n#endif\n";
+  }
+  string path = dir.write("main.c", main);
+  
+  auto preprocessed = [&](bool pipelined) {
+    auto options = std::make_shared<Options>();
+    options->pipeline_lexing = pipelined;
+    Parser parser(path, options);
+    std::ostringstream out;
+    parser.preprocess(out);
+    return out.str();
+  };
+  
+  string serial = preprocessed(false);
+  ASSERT_NE(serial.find("const char *line_5 = \"v0 + 0\" \""), string::npos);
+  ASSERT_NE(serial.find("int y8;"), string::npos);
+  ASSERT_EQ(preprocessed(true), serial);
+}
+
+// Preprocesses source, returning the tokens it produces
+static string preprocess(const string &source, bool stripSpaces = false) {
+  auto options = std::make_shared<Options>();
+  std::istringstream stream(source);
+  Parser parser(stream, options);
+  std::ostringstream out;
+  parser.preprocess(out);
+  
+  string text = out.str();
+  if (stripSpaces) {
+    text.erase(std::remove_if(text.begin(), text.end(), [](char ch) { return ch == ' ' || ch == '\n'; }), text.end());
+  }
+  return text;
+}
+
+TEST(Parser, ExpandsMacros) {
+  ASSERT_EQ(preprocess("#define N 10\n#define SQ(x) ((x) * (x))\n#define F (1)\nint a = SQ(N + 1); F SQ\n"),
+            "int a = ((10 + 1) * (10 + 1)); (1) SQ\n");
+  
+  // a keyword can be defined, and an object-like macro's body may start with '('
+  ASSERT_EQ(preprocess("#define inline\n#define G (a)(b)\ninline int g = G;\n#undef inline\ninline\n"),
+            "int g = (a)(b);\ninline\n");
+  
+  ASSERT_EQ(preprocess("#define L __LINE__\n\nL __LINE__\n"), "3 3\n");
+}
+
+TEST(Parser, StringizeAndPaste) {
+  ASSERT_EQ(preprocess("#define STR(x) #x\n#define XSTR(x) STR(x)\n#define CAT(a, b) a ## b\n#define V 42\n"
+                       "STR(  a  +   \"q\\n\"  'c' ) XSTR(V) CAT(x, y) CAT(, z) CAT(1, ) CAT(V, V) CAT(+, =)\n"),
+            "\"a + \\\"q\\\\n\\\" 'c'\" \"42\" xy z 1 VV +=\n");
+  
+  ASSERT_THROW(preprocess("#define CAT(a, b) a ## b\nCAT(+, -)\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#define BAD(a) a ##\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#define BAD(a) #b\n"), std::runtime_error);
+}
+
+TEST(Parser, VariadicMacros) {
+  ASSERT_EQ(preprocess("#define LOG(fmt, ...) printf(fmt, __VA_ARGS__)\n"
+                       "#define ELOG(fmt, ...) printf(fmt, ## __VA_ARGS__)\n"
+                       "#define NAMED(args...) f(args)\n"
+                       "LOG(\"%d %d\", 1, (2, 3)) ELOG(\"x\") ELOG(\"y\", 3) NAMED(a, b)\n"),
+            "printf(\"%d %d\", 1, (2, 3)) printf(\"x\") printf(\"y\", 3) f(a, b)\n");
+  
+  ASSERT_THROW(preprocess("#define TWO(a, b) a b\nTWO(1)\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#define ONE(a) a\nONE(1\n"), std::runtime_error);
+}
+
+TEST(Parser, ManyDistinctHideSets) {
+  // each expansion leaves its token hidden from a set of its own, more of them than 16 bits could number
+  string source;
+  string expected;
+  for (int i = 0; i < 70000; i++) {
+    source += "#define M" + std::to_string(i) + " x\nM" + std::to_string(i) + "\n";
+    expected += "x";
+  }
+  ASSERT_EQ(preprocess(source, true), expected);
+  
+}
+
+TEST(Parser, EmptyIncludeFilename) {
+  for (const char *source : {"#include \"\"\n", "#include <>\n"}) {
+    try {
+      preprocess(source);
+      FAIL() << source;
+    } catch (const std::runtime_error &e) {
+      ASSERT_STREQ(e.what(), "Empty include filename") << source;
+    }
+  }
+}
+
+// The examples of macro replacement in the C99 standard, 6.10.3.5
+TEST(Parser, StandardMacroExamples) {
+  string definitions = "#define x 3\n#define f(a) f(x * (a))\n#undef x\n#define x 2\n#define g f\n#define z z[0]\n"
+                       "#define h g(~\n#define m(a) a(w)\n#define w 0,1\n#define t(a) a\n#define p() int\n"
+                       "#define q(x) x\n#define r(x,y) x ## y\n#define str(x) # x\n";
+  ASSERT_EQ(preprocess(definitions + "f(y+1) + f(f(z)) % t(t(g)(0) + t)(1);\n"
+                                     "g(x+(3,4)-w) | h 5) & m\n(f)^m(m);\n"
+                                     "p() i[q()] = { q(1), r(2,3), r(4,), r(,5), r(,) };\n"
+                                     "char c[2][6] = { str(hello), str() };\n", true),
+            "f(2*(y+1))+f(2*(f(2*(z[0]))))%f(2*(0))+t(1);"
+            "f(2*(2+(3,4)-0,1))|f(2*(~5))&f(2*(0,1))^m(0,1);"
+            "inti[]={1,23,4,5,};"
+            "charc[2][6]={\"hello\",\"\"};");
+  
+  string stringizing = "#define str(s) # s\n#define xstr(s) str(s)\n"
+                       "#define debug(s, t) printf(\"x\" # s \"= %d, x\" # t \"= %s\", \\\n x ## s, x ## t)\n"
+                       "#define glue(a, b) a ## b\n#define xglue(a, b) glue(a, b)\n"
+                       "#define HIGHLOW \"hello\"\n#define LOW LOW \", world\"\n";
+  ASSERT_EQ(preprocess(stringizing + "debug(1, 2);\nglue(HIGH, LOW);\nxglue(HIGH, LOW)\n"),
+            "printf(\"x\" \"1\" \"= %d, x\" \"2\" \"= %s\", x1, x2);\n\"hello\";\n\"hello\" \", world\"\n");
+}
+
+TEST(Parser, PrecompiledHeaderKeepsMacros) {
+  ScratchDir dir("parser_pch_macros");
+  dir.write("prefix.h", "#define SQ(x) ((x) * (x))\n#define CAT(a, ...) a ## __VA_ARGS__\n#define const\n");
+  dir.write("main.c", "const int a = CAT(S, Q)(2);\n");
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs = {dir.path().string()};
+  string pch = (dir / "prefix.pch").string();
+  {
+    Parser parser((dir / "prefix.h").string(), options);
+    parser.parse();
+    parser.emit_pch(pch);
+  }
+  
+  options->include_pch = pch;
+  Parser parser((dir / "main.c").string(), options);
+  std::ostringstream out;
+  parser.preprocess(out);
+  ASSERT_EQ(out.str(), "int a = ((2) * (2));\n");
+  
+}
+
+TEST(Parser, ConditionalCompilation) {
+  ASSERT_EQ(preprocess("#define A 2\n#if A * 3 == 6 && defined(A) && !defined B\na\n#elif 1 / 0\nb\n#else\nc\n#endif\n"
+                       "#ifdef B\nd\n#elif (-1 < 0u) + 0x10 == 16L\ne\n#elif 1\nf\n#endif\n"
+                       "#ifndef A\n#error not here\n#else\n#if 0 ? 1 / 0 : 'a' == 97\ng\n#endif\n#endif\n"
+                       "#if 0\n#if 1\n#else\n#endif\n#include \"missing.h\"\n#elif 0\n#else\nh\n#endif\n"),
+            "a\ne\ng\nh\n");
+  
+  ASSERT_THROW(preprocess("#if 1\n#else\n#else\n#endif\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#if 0\n#else\n#elif 1\n#endif\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#endif\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#if 0\nint a;\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#if 1\nint a;\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#if 1 +\n#endif\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#if 1 / 0\n#endif\n"), std::runtime_error);
+  ASSERT_THROW(preprocess("#error stop\n"), std::runtime_error);
+}
+
+TEST(Parser, SkippedGroupsMatchAcrossModes) {
+  ScratchDir dir("parser_skip");
+  dir.write("a.h", "#ifndef A_H\n#define A_H\n#if 0\n#include \"missing.h\"\n#endif\nint a;\n#endif\n");
+  dir.write("main.c", "#include \"a.h\"\n#ifdef A_H\nint b;\n#else\n#include <missing.h>\nint c;\n#endif\n"
+                     "#include \"a.h\"\n#if 0\n#include \"a.h\"\n#else\nint d;\n#endif\n");
+  
+  auto print = [&](bool pipelined, bool buffered) {
+    auto options = std::make_shared<Options>();
+    options->include_dirs = {dir.path().string()};
+    options->pipeline_lexing = pipelined;
+    options->buffer_tokens = buffered;
+    Parser parser((dir / "main.c").string(), options);
+    std::ostringstream out;
+    parser.preprocess(out);
+    EXPECT_EQ(parser.skipped_includes(), 1);
+    return out.str();
+  };
+  
+  ASSERT_EQ(print(false, false), "int a;\nint b;\nint d;\n");
+  ASSERT_EQ(print(false, true), print(false, false));
+  ASSERT_EQ(print(true, false), print(false, false));
+  
+}
+
+TEST(Parser, IncrementalMatchesFullParse) {
+  ScratchDir dir("parser_incremental");
+  dir.write("a.h", "#ifndef A_H\n#define A_H\n#define LIMIT 4\nint a;\n#endif\n");
+  dir.write("b.h", "#pragma once\n#if LIMIT > 2\n#define BIG\n#endif\nint b;\n");
+  
+  auto options = std::make_shared<Options>();
+  options->include_dirs = {dir.path().string()};
+  
+  // enough code between the directives for the parser to save its state several times
+  string text = "#include \"a.h\"\n#include \"b.h\"\n";
+  for (int i = 0; i < 2000; i++) {
+    text += "int v" + std::to_string(i) + " = " + std::to_string(i) + " + LIMIT;\n";
+    if (i % 250 == 0) {
+      text += "#define M" + std::to_string(i) + " " + std::to_string(i) + "\n#if M" + std::to_string(i) +
+              " > LIMIT\n#undef LIMIT\n#define LIMIT M" + std::to_string(i) + "\n#endif\n#pragma mark" +
+              std::to_string(i) + "\n";
+    }
+  }
+  text += "#include \"a.h\"\n#ifdef BIG\n#pragma big\n#endif\n";
+  
+  IncrementalParser incremental((dir / "main.c").string(), text, options);
+  
+  // the tree, and the line and column of every node, which have to have moved with the edits
+  auto print = [](const AST &ast, const Interner &strings, const SourceManager &sources) {
+    std::ostringstream out;
+    print_ast(ast, strings, out);
+    for (NodeID id = 0; id < ast.size(); id++) {
+      SourcePosition at = sources.position(ast.location(id));
+      out << at.line << ':' << at.column << ' ';
+    }
+    return out.str();
+  };
+  auto full_parse = [&] {
+    std::istringstream stream{string(incremental.text())};
+    Parser parser(stream, options);
+    auto ast = parser.parse();
+    return print(*ast, parser.interner(), parser.source_manager());
+  };
+  auto printed = [&] {
+    return print(incremental.tree(), incremental.interner(), incremental.source_manager());
+  };
+  ASSERT_EQ(printed(), full_parse());
+  
+  auto offset_of = [&](const string &needle) {
+    size_t at = incremental.text().find(needle);
+    EXPECT_NE(at, std::string_view::npos) << needle;
+    return static_cast<uint32_t>(at);
+  };
+  
+  // code between directives leaves the tree alone
+  incremental.apply({{offset_of("v600 = 600"), 10, "v600 = 7"}});
+  ASSERT_EQ(incremental.last_update().tokensParsed, 0);
+  ASSERT_EQ(printed(), full_parse());
+  
+  // a directive deep in the file is parsed until the parser is back in a state it was in before
+  incremental.apply({{offset_of("#pragma mark1000"), 16, "#pragma moved"}});
+  ASSERT_TRUE(incremental.last_update().reused);
+  ASSERT_LT(incremental.last_update().tokensParsed, 3 * IncrementalParser::checkpoint_interval);
+  ASSERT_EQ(printed(), full_parse());
+  
+  // a change that carries on to the end of the file
+  incremental.apply({{offset_of("#define M0 0"), 12, "#define M0 9"}});
+  ASSERT_EQ(printed(), full_parse());
+  
+  // several edits at once, lines moving, a directive commented out, and an edit that opens a comment
+  incremental.apply({{offset_of("int v10 "), 0, "#define EXTRA\n"}, {offset_of("#undef LIMIT"), 0, "// "},
+                     {offset_of("int v1999"), 0, "/* "}});
+  ASSERT_EQ(printed(), full_parse());
+  incremental.apply({{offset_of("/* "), 3, ""}});
+  ASSERT_EQ(printed(), full_parse());
+  
+  // an error leaves the tree incomplete until it is fixed
+  ASSERT_THROW(incremental.apply({{offset_of("int v1500"), 0, "#error stop\n"}}), std::runtime_error);
+  incremental.apply({{offset_of("#error stop\n"), 12, ""}});
+  ASSERT_EQ(printed(), full_parse());
+  
+  // random edits of every kind
+  std::mt19937 rng(23);
+  const std::vector<string> insertions = {"\n", "#", "#define R 1\n", "#if 0\n", "#endif\n", "x", " ", "/*", "*/", "1"};
+  for (int round = 0; round < 60; round++) {
+    auto size = static_cast<uint32_t>(incremental.text().size());
+    auto offset = static_cast<uint32_t>(rng() % (size + 1));
+    auto removed = static_cast<uint32_t>(rng() % (size - offset + 1) % 4);
+    string before(incremental.text().substr(offset, removed));
+    const string &inserted = insertions[rng() % insertions.size()];
+    try {
+      incremental.apply({{offset, removed, inserted}});
+    } catch (const std::runtime_error &) {
+      ASSERT_THROW(full_parse(), std::runtime_error) << "round " << round;
+      // undone, so the edits that follow have a file that parses
+      incremental.apply({{offset, static_cast<uint32_t>(inserted.size()), before}});
+    }
+    ASSERT_EQ(printed(), full_parse()) << "round " << round;
+  }
+  
+}
+
+// Writes an expression with each operator before its operands, as in (+ a (* b c))
+static void write_prefix(const AST &ast, NodeID id, const Interner &strings, std::ostream &out) {
+  const ASTNode &node = ast[id];
+  switch (node.kind) {
+    case ASTKind::Identifier:
+    case ASTKind::Constant:
+      out << strings.get(node.value);
+      return;
+    case ASTKind::String:
+      if (node.childCount == 0) {
+        out << strings.get(node.value);
+        return;
+      }
+      out << "(string";
+      break;
+    case ASTKind::Conditional:
+      out << "(?:";
+      break;
+    case ASTKind::Call:
+      out << "(call";
+      break;
+    case ASTKind::Index:
+      out << "([]";
+      break;
+    case ASTKind::Postfix:
+      out << "(post" << fixed_spelling(node.token);
+      break;
+    case ASTKind::Member:
+      out << '(' << fixed_spelling(node.token) << strings.get(node.value);
+      break;
+    default:
+      out << '(' << fixed_spelling(node.token);
+      break;
+  }
+  for (const NodeID *child = ast.children_begin(id); child != ast.children_end(id); child++) {
+    out << ' ';
+    write_prefix(ast, *child, strings, out);
+  }
+  out << ')';
+}
+
+static string parse_expression(const string &source) {
+  std::istringstream stream(source);
+  Parser parser(stream, std::make_shared<Options>());
+  AST ast;
+  NodeID expression = parser.parse_expression(ast);
+  std::ostringstream out;
+  write_prefix(ast, expression, parser.interner(), out);
+  return out.str();
+}
+
+TEST(Parser, ExpressionPrecedence) {
+  ASSERT_EQ(parse_expression("a + b * c - d"), "(- (+ a (* b c)) d)");
+  ASSERT_EQ(parse_expression("a << 1 < b == c & d ^ e | f && g || h"),
+            "(|| (&& (| (^ (& (== (< (<< a 1) b) c) d) e) f) g) h)");
+  ASSERT_EQ(parse_expression("a || b && c | d ^ e & f == g < h >> 1 + i % j"),
+            "(|| a (&& b (| c (^ d (& e (== f (< g (>> h (+ 1 (% i j))))))))))");
+  ASSERT_EQ(parse_expression("(a + b) * c"), "(* (+ a b) c)");
+  ASSERT_EQ(parse_expression("a = b, c += d"), "(, (= a b) (+= c d))");
+  
+  // assignment and ?: group right to left, the rest left to right
+  ASSERT_EQ(parse_expression("a = b -= c"), "(= a (-= b c))");
+  ASSERT_EQ(parse_expression("a - b - c"), "(- (- a b) c)");
+  ASSERT_EQ(parse_expression("a ? b : c ? d : e"), "(?: a b (?: c d e))");
+  ASSERT_EQ(parse_expression("a || b ? c, d : e = f"), "(= (?: (|| a b) (, c d) e) f)");
+  ASSERT_EQ(parse_expression("x = a ? b : c"), "(= x (?: a b c))");
+}
+
+TEST(Parser, ExpressionPrefixAndPostfix) {
+  ASSERT_EQ(parse_expression("-a * !b"), "(* (- a) (! b))");
+  ASSERT_EQ(parse_expression("*p++ = ~-x"), "(= (* (post++ p)) (~ (- x)))");
+  ASSERT_EQ(parse_expression("sizeof a[1].b->c"), "(sizeof (->c (.b ([] a 1))))");
+  ASSERT_EQ(parse_expression("&f(a, b = 1, (c, d))()"), "(& (call (call f a (= b 1) (, c d))))");
+  ASSERT_EQ(parse_expression("1.5f + 'c' + \"a\" \"b\""), "(+ (+ 1.5f 'c') (string \"a\" \"b\"))");
+  ASSERT_EQ(parse_expression("a--- -b"), "(- (post-- a) (- b))");
+}
+
+TEST(Parser, DeepExpressions) {
+  // operands and operators cost no stack, however many there are
+  const int operands = 50000;
+  string chain = "x";
+  string conditionals = "x";
+  string prefixes(operands, '!');
+  const char *operators[] = {" + ", " * ", " = ", " << ", " && ", " , "};
+  for (int i = 1; i < operands; i++) {
+    chain += operators[i % 6] + std::to_string(i);
+    conditionals += " ? " + std::to_string(i) + " : x";
+  }
+  prefixes += "x";
+  for (const string &source : {chain, conditionals, prefixes}) {
+    std::istringstream stream(source);
+    Parser parser(stream, std::make_shared<Options>());
+    AST ast;
+    parser.parse_expression(ast);
+    ASSERT_GE(ast.size(), static_cast<size_t>(operands));
+  }
+  
+  // nesting is bounded
+  auto nested = [](unsigned depth) {
+    return string(depth, '(') + "x" + string(depth, ')');
+  };
+  ASSERT_EQ(parse_expression(nested(Parser::max_expression_depth)), "x");
+  ASSERT_THROW(parse_expression(nested(Parser::max_expression_depth + 1)), std::runtime_error);
+  string subscripts = "a";
+  for (int i = 0; i < 100000; i++) {
+    subscripts += "[a";
+  }
+  ASSERT_THROW(parse_expression(subscripts), std::runtime_error);
+  ASSERT_THROW(parse_expression("f" + string(100000, '(')), std::runtime_error);
+}
+
+TEST(Parser, ExpressionErrorsAndDirectives) {
+  ASSERT_THROW(parse_expression("a +"), std::runtime_error);
+  ASSERT_THROW(parse_expression("(a"), std::runtime_error);
+  ASSERT_THROW(parse_expression("a ? b"), std::runtime_error);
+  ASSERT_THROW(parse_expression("a->1"), std::runtime_error);
+  ASSERT_THROW(parse_expression("f(a,)"), std::runtime_error);
+  ASSERT_THROW(parse_expression("(int)a"), std::runtime_error);
+  
+  // directives within an expression take effect where they are, and go into the tree after it
+  std::istringstream stream("#define A 1\na +\n#define B A * 2\nB\n#undef B\n+ c");
+  Parser parser(stream, std::make_shared<Options>());
+  AST ast;
+  NodeID expression = parser.parse_expression(ast);
+  std::ostringstream out;
+  write_prefix(ast, expression, parser.interner(), out);
+  ASSERT_EQ(out.str(), "(+ (+ a (* 1 2)) c)");
+  
+  ast.add(ASTKind::TranslationUnit, Interner::none, SourceLocation(), 0);
+  std::ostringstream printed;
+  print_ast(ast, parser.interner(), printed);
+  ASSERT_EQ(printed.str(), "TranslationUnit\n  Define A\n  Binary +\n    Binary +\n      Identifier a\n"
+                           "      Binary *\n        Constant 1\n        Constant 2\n    Identifier c\n"
+                           "  Define B\n  Undef B\n");
+}
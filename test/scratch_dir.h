@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+// A new directory under the system's temporary directory for one test, removed with everything in it when the
+// test ends, passed or not. Names are made unique with the process ID and a counter, so tests running at once in
+// different processes never share one.
+class ScratchDir {
+public:
+  explicit ScratchDir(const std::string &name) {
+    static std::atomic<unsigned int> made = 0;
+    dir = std::filesystem::temp_directory_path() /
+          ("cllvm_" + name + "_" + std::to_string(getpid()) + "_" + std::to_string(made++));
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+  }
+
+  ScratchDir(const ScratchDir &) = delete;
+  ScratchDir &operator=(const ScratchDir &) = delete;
+
+  ~ScratchDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+  }
+
+  [[nodiscard]] const std::filesystem::path &path() const { return dir; }
+
+  std::filesystem::path operator/(const std::filesystem::path &relative) const { return dir / relative; }
+
+  // Writes contents to the file at relative, making any directories it is in, and returns its full path
+  std::string write(const std::filesystem::path &relative, std::string_view contents) const {
+    std::filesystem::path file = dir / relative;
+    std::filesystem::create_directories(file.parent_path());
+    std::ofstream(file, std::ios::binary) << contents;
+    return file.string();
+  }
+
+private:
+  std::filesystem::path dir;
+};